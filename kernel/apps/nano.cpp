@@ -32,6 +32,7 @@ void Nano::run(const char* filename) {
         if (node) {
             MesaOS::FS::read_fs(node, 0, node->length, (uint8_t*)buffer);
             cursor_pos = strlen(buffer);
+            MesaOS::FS::put_node(node);
         }
     }
 
@@ -53,6 +54,8 @@ void Nano::save() {
     
     if (node) {
         MesaOS::FS::write_fs(node, 0, strlen(buffer), (uint8_t*)buffer);
+        MesaOS::FS::close_fs(node);
+        MesaOS::FS::put_node(node);
     }
 }
 
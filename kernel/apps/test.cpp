@@ -1,6 +1,7 @@
 #include "test.hpp"
 #include "../drivers/vga.hpp"
 #include "../shell.hpp"
+#include "../timer.hpp"
 
 namespace MesaOS::Apps {
 
@@ -49,9 +50,7 @@ void Test::run(const char* arg) {
     vga.write_string("\nPress any key to exit this test application...\n");
 
     // Simple delay and exit (simplified for kernel environment)
-    for (volatile int i = 0; i < 10000000; i++) {
-        // Small delay
-    }
+    MesaOS::System::Timer::sleep_ms(2000);
     running = false;
 
     // Return to shell
@@ -0,0 +1,116 @@
+#include "top.hpp"
+#include "drivers/vga.hpp"
+#include "drivers/pit.hpp"
+#include "arch/i386/cpu.hpp"
+#include "scheduler.hpp"
+#include <string.h>
+
+namespace MesaOS::Apps {
+
+bool Top::running = false;
+uint32_t Top::last_refresh = 0;
+uint64_t Top::last_tsc = 0;
+
+// CPU time seen at the previous refresh, used to compute per-interval usage
+static const int MAX_TRACKED = 32;
+static uint32_t prev_pid[MAX_TRACKED];
+static uint64_t prev_cycles[MAX_TRACKED];
+static int prev_count = 0;
+
+static uint64_t previous_cycles(uint32_t pid) {
+    for (int i = 0; i < prev_count; i++) {
+        if (prev_pid[i] == pid) return prev_cycles[i];
+    }
+    return 0;
+}
+
+static void pad(MesaOS::Drivers::VGADriver& vga, const char* text, size_t width) {
+    vga.write_string(text);
+    for (size_t k = strlen(text); k < width; k++) vga.write_string(" ");
+}
+
+void Top::run() {
+    running = true;
+    prev_count = 0;
+    last_tsc = MesaOS::Arch::x86::rdtsc();
+    refresh_screen();
+}
+
+void Top::refresh_screen() {
+    MesaOS::Drivers::VGADriver vga;
+    vga.initialize();
+
+    uint64_t now = MesaOS::Arch::x86::rdtsc();
+    uint64_t interval = now - last_tsc;
+    if (interval == 0) interval = 1;
+
+    char buf[24];
+    vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::BLACK, MesaOS::Drivers::VGAColor::LIGHT_GREY));
+    vga.write_string(" MesaOS Task Manager | Uptime: ");
+    vga.write_string(itoa(MesaOS::Drivers::PIT::get_ticks() / 100, buf, 10));
+    vga.write_string("s | Switches: ");
+    pad(vga, itoa(MesaOS::System::Scheduler::get_context_switches(), buf, 10), 10);
+    vga.write_string(" | Any key exits  \n");
+
+    vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::WHITE, MesaOS::Drivers::VGAColor::BLACK));
+    vga.write_string("PID  NAME        STATE     %CPU  CPU(Mcyc)  WAIT(Mcyc)  CSW     VOL     INVOL\n");
+
+    int count = 0;
+    MesaOS::System::Process* proc = MesaOS::System::Scheduler::get_process_list();
+    while (proc) {
+        uint64_t cycles = proc->cpu_cycles;
+        // Charge the slice still in progress for the running task
+        if (proc->state == MesaOS::System::RUNNING) cycles += now - proc->last_switch_tsc;
+
+        uint64_t delta = cycles - previous_cycles(proc->pid);
+        uint32_t percent = (uint32_t)((delta * 100) / interval);
+        if (percent > 100) percent = 100;
+
+        pad(vga, itoa(proc->pid, buf, 10), 5);
+        pad(vga, proc->name, 12);
+        if (proc->state == MesaOS::System::READY) pad(vga, "READY", 10);
+        else if (proc->state == MesaOS::System::RUNNING) pad(vga, "RUNNING", 10);
+        else if (proc->state == MesaOS::System::BLOCKED) pad(vga, "SLEEPING", 10);
+        else pad(vga, "SUSPENDED", 10);
+        pad(vga, itoa(percent, buf, 10), 6);
+        pad(vga, ulltoa(cycles / 1000000, buf, 10), 11);
+        pad(vga, ulltoa(proc->wait_cycles / 1000000, buf, 10), 12);
+        pad(vga, itoa(proc->nr_switches, buf, 10), 8);
+        pad(vga, itoa(proc->nr_voluntary, buf, 10), 8);
+        vga.write_string(itoa(proc->nr_involuntary, buf, 10));
+        vga.write_string("\n");
+
+        if (count < MAX_TRACKED) {
+            prev_pid[count] = proc->pid;
+            prev_cycles[count] = cycles;
+            count++;
+        }
+        proc = proc->next;
+    }
+    prev_count = count;
+    last_tsc = now;
+    last_refresh = MesaOS::Drivers::PIT::get_ticks();
+}
+
+void Top::update() {
+    if (!running) return;
+    if (MesaOS::Drivers::PIT::get_ticks() - last_refresh < 100) return; // 1s at 100Hz
+
+    // Scrollback and TTY switching still run in IRQ context; keep them from drawing mid-frame
+    asm volatile("cli");
+    if (running) refresh_screen();
+    asm volatile("sti");
+}
+
+void Top::handle_input(char c) {
+    (void)c;
+    running = false;
+    MesaOS::Drivers::VGADriver vga;
+    vga.initialize();
+}
+
+bool Top::is_running() {
+    return running;
+}
+
+} // namespace MesaOS::Apps
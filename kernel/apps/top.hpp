@@ -0,0 +1,24 @@
+#ifndef TOP_HPP
+#define TOP_HPP
+
+#include <stdint.h>
+
+namespace MesaOS::Apps {
+
+class Top {
+public:
+    static void run();
+    static void handle_input(char c);
+    static void update(); // Called from the shell task loop, redraws once a second
+    static bool is_running();
+
+private:
+    static bool running;
+    static uint32_t last_refresh;
+    static uint64_t last_tsc;
+    static void refresh_screen();
+};
+
+} // namespace MesaOS::Apps
+
+#endif
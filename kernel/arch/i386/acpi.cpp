@@ -0,0 +1,127 @@
+#include "acpi.hpp"
+#include "memory/paging.hpp"
+#include <string.h>
+
+namespace MesaOS::Arch::x86 {
+
+struct RSDPDescriptor {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+} __attribute__((packed));
+
+bool ACPI::madt_found = false;
+uint32_t ACPI::local_apic_address = 0xFEE00000;
+uint32_t ACPI::ioapic_address = 0xFEC00000;
+uint32_t ACPI::ioapic_gsi_base = 0;
+IRQOverride ACPI::overrides[16];
+
+// Only the first 64MB are identity mapped; firmware tables usually sit at the top of RAM
+static void map_physical(uint32_t address, uint32_t length) {
+    if (address + length <= 64 * 1024 * 1024) return;
+    for (uint32_t page = address & ~0xFFF; page < address + length; page += 4096) {
+        MesaOS::Memory::Paging::map_page(page, page, false, false);
+    }
+}
+
+static bool checksum_ok(const void* table, uint32_t length) {
+    const uint8_t* bytes = (const uint8_t*)table;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < length; i++) sum += bytes[i];
+    return sum == 0;
+}
+
+static RSDPDescriptor* scan_rsdp(uint32_t start, uint32_t length) {
+    for (uint32_t addr = start; addr < start + length; addr += 16) {
+        if (memcmp((void*)addr, "RSD PTR ", 8) == 0 && checksum_ok((void*)addr, 20)) {
+            return (RSDPDescriptor*)addr;
+        }
+    }
+    return 0;
+}
+
+// Reads the BIOS data area through a volatile pointer. GCC treats any constant
+// address below 4KB as an offset from a null pointer and warns, so the asm
+// hides where the pointer came from.
+static inline uint16_t bda_read16(uint32_t addr) {
+    volatile uint16_t* p;
+    asm("" : "=r"(p) : "0"(addr));
+    return *p;
+}
+
+bool ACPI::initialize() {
+    // The RSDP is in the first KB of the EBDA or in the BIOS area 0xE0000-0xFFFFF
+    uint32_t ebda = (uint32_t)bda_read16(0x40E) << 4;
+    RSDPDescriptor* rsdp = ebda ? scan_rsdp(ebda, 1024) : 0;
+    if (!rsdp) rsdp = scan_rsdp(0xE0000, 0x20000);
+    if (!rsdp) return false;
+
+    ACPIHeader* rsdt = (ACPIHeader*)rsdp->rsdt_address;
+    map_physical((uint32_t)rsdt, sizeof(ACPIHeader));
+    map_physical((uint32_t)rsdt, rsdt->length);
+    if (memcmp(rsdt->signature, "RSDT", 4) != 0) return false;
+
+    uint32_t entries = (rsdt->length - sizeof(ACPIHeader)) / 4;
+    uint32_t* tables = (uint32_t*)((uint8_t*)rsdt + sizeof(ACPIHeader));
+    for (uint32_t i = 0; i < entries; i++) {
+        ACPIHeader* table = (ACPIHeader*)tables[i];
+        map_physical((uint32_t)table, sizeof(ACPIHeader));
+        if (memcmp(table->signature, "APIC", 4) == 0) {
+            map_physical((uint32_t)table, table->length);
+            parse_madt(table);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ACPI::parse_madt(ACPIHeader* madt) {
+    uint8_t* ptr = (uint8_t*)madt + sizeof(ACPIHeader);
+    local_apic_address = *(uint32_t*)ptr;
+    ptr += 8; // Local APIC address + flags
+
+    bool ioapic_seen = false;
+    uint8_t* end = (uint8_t*)madt + madt->length;
+    while (ptr + 2 <= end && ptr[1] >= 2) {
+        uint8_t type = ptr[0];
+        if (type == 1 && !ioapic_seen) {
+            // I/O APIC: id, reserved, address, GSI base. Only the first one is used.
+            ioapic_address = *(uint32_t*)(ptr + 4);
+            ioapic_gsi_base = *(uint32_t*)(ptr + 8);
+            ioapic_seen = true;
+        } else if (type == 2) {
+            // Interrupt source override: bus, source IRQ, GSI, flags
+            uint8_t source = ptr[3];
+            if (source < 16) {
+                overrides[source].present = true;
+                overrides[source].gsi = *(uint32_t*)(ptr + 4);
+                overrides[source].flags = *(uint16_t*)(ptr + 8);
+            }
+        }
+        ptr += ptr[1];
+    }
+    madt_found = true;
+}
+
+bool ACPI::has_madt() { return madt_found; }
+uint32_t ACPI::get_local_apic_address() { return local_apic_address; }
+uint32_t ACPI::get_ioapic_address() { return ioapic_address; }
+uint32_t ACPI::get_ioapic_gsi_base() { return ioapic_gsi_base; }
+
+uint32_t ACPI::irq_to_gsi(uint8_t irq, uint16_t* flags) {
+    if (irq < 16 && overrides[irq].present) {
+        if (flags) *flags = overrides[irq].flags;
+        return overrides[irq].gsi;
+    }
+    // Without a MADT, assume the usual PC wiring where the PIT is on pin 2
+    if (!madt_found && irq == 0) {
+        if (flags) *flags = 0;
+        return 2;
+    }
+    if (flags) *flags = 0;
+    return irq;
+}
+
+} // namespace MesaOS::Arch::x86
@@ -0,0 +1,54 @@
+#ifndef ACPI_HPP
+#define ACPI_HPP
+
+#include <stdint.h>
+
+namespace MesaOS::Arch::x86 {
+
+struct ACPIHeader {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+// MADT interrupt source override flags (polarity bits 0-1, trigger bits 2-3)
+#define MADT_POLARITY_LOW  0x3
+#define MADT_TRIGGER_LEVEL 0xC
+
+struct IRQOverride {
+    bool present;
+    uint32_t gsi;
+    uint16_t flags;
+};
+
+class ACPI {
+public:
+    // Locates the RSDP and parses the MADT. Returns false if no MADT was found.
+    static bool initialize();
+    static bool has_madt();
+    static uint32_t get_local_apic_address();
+    static uint32_t get_ioapic_address();
+    static uint32_t get_ioapic_gsi_base();
+
+    // Global system interrupt an ISA IRQ is wired to, honouring overrides
+    static uint32_t irq_to_gsi(uint8_t irq, uint16_t* flags);
+
+private:
+    static void parse_madt(ACPIHeader* madt);
+
+    static bool madt_found;
+    static uint32_t local_apic_address;
+    static uint32_t ioapic_address;
+    static uint32_t ioapic_gsi_base;
+    static IRQOverride overrides[16];
+};
+
+} // namespace MesaOS::Arch::x86
+
+#endif
@@ -0,0 +1,163 @@
+#include "apic.hpp"
+#include "cpu.hpp"
+#include "acpi.hpp"
+#include "io_port.hpp"
+#include "memory/paging.hpp"
+
+namespace MesaOS::Arch::x86 {
+
+#define MSR_APIC_BASE       0x1B
+#define APIC_BASE_ENABLE    (1 << 11)
+
+#define LAPIC_ID            0x020
+#define LAPIC_TPR           0x080
+#define LAPIC_EOI           0x0B0
+#define LAPIC_SVR           0x0F0
+
+volatile uint32_t* LocalAPIC::registers = 0;
+uint32_t LocalAPIC::base = 0;
+bool LocalAPIC::enabled = false;
+
+// The local APIC comes up in virtual wire mode (LINT0 left as configured by the
+// BIOS), so the PICs keep working until IOAPIC::initialize() takes over.
+bool LocalAPIC::initialize() {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & (1 << 9))) return false; // CPUID.1:EDX[9] = APIC on chip
+
+    uint64_t msr = rdmsr(MSR_APIC_BASE);
+    base = (uint32_t)msr & 0xFFFFF000;
+    if (ACPI::has_madt()) base = ACPI::get_local_apic_address();
+    wrmsr(MSR_APIC_BASE, msr | APIC_BASE_ENABLE);
+
+    // The register page sits far above the identity-mapped low memory
+    MesaOS::Memory::Paging::map_page(base, base, false, true);
+    registers = (volatile uint32_t*)base;
+
+    write(LAPIC_TPR, 0); // Accept every priority class
+    write(LAPIC_SVR, APIC_SPURIOUS_VECTOR | 0x100); // Software enable
+
+    enabled = true;
+    return true;
+}
+
+bool LocalAPIC::is_enabled() { return enabled; }
+uint32_t LocalAPIC::get_id() { return enabled ? read(LAPIC_ID) >> 24 : 0; }
+uint32_t LocalAPIC::get_base() { return base; }
+
+void LocalAPIC::eoi() {
+    write(LAPIC_EOI, 0);
+}
+
+uint32_t LocalAPIC::read(uint32_t reg) {
+    return registers[reg / 4];
+}
+
+void LocalAPIC::write(uint32_t reg, uint32_t value) {
+    registers[reg / 4] = value;
+}
+
+#define IOAPIC_REGSEL       0x00
+#define IOAPIC_WINDOW       0x10
+#define IOAPIC_VERSION      0x01
+#define IOAPIC_REDTBL       0x10
+
+#define IOAPIC_MASKED       (1 << 16)
+#define IOAPIC_LEVEL        (1 << 15)
+#define IOAPIC_ACTIVE_LOW   (1 << 13)
+
+volatile uint32_t* IOAPIC::registers = 0;
+uint32_t IOAPIC::gsi_base = 0;
+uint32_t IOAPIC::max_redirection = 0;
+bool IOAPIC::enabled = false;
+
+bool IOAPIC::initialize() {
+    if (!LocalAPIC::is_enabled()) return false;
+
+    uint32_t address = ACPI::get_ioapic_address();
+    gsi_base = ACPI::get_ioapic_gsi_base();
+    MesaOS::Memory::Paging::map_page(address, address, false, true);
+    registers = (volatile uint32_t*)address;
+
+    uint32_t version = read(IOAPIC_VERSION);
+    if (version == 0xFFFFFFFF) return false; // Nothing decodes the address
+    max_redirection = (version >> 16) & 0xFF;
+
+    // Start from a fully masked table, then route the ISA IRQs to the PIC vectors
+    for (uint32_t i = 0; i <= max_redirection; i++) {
+        set_entry(gsi_base + i, IOAPIC_MASKED);
+    }
+    for (uint8_t irq = 0; irq < 16; irq++) {
+        // IRQ2 is the PIC cascade; its pin usually carries the PIT instead
+        if (irq == 2) continue;
+        route_irq(irq, 32 + irq);
+    }
+
+    // Mask every line on both PICs; they stay remapped to 32-47 so a
+    // spurious interrupt from them still lands on a known vector
+    outb(0x21, 0xFF);
+    outb(0xA1, 0xFF);
+
+    enabled = true;
+    return true;
+}
+
+bool IOAPIC::is_enabled() { return enabled; }
+uint32_t IOAPIC::get_max_redirection() { return max_redirection; }
+
+void IOAPIC::route_irq(uint8_t irq, uint8_t vector, bool pci) {
+    uint16_t flags = 0;
+    uint32_t gsi = ACPI::irq_to_gsi(irq, &flags);
+    if (gsi < gsi_base || gsi > gsi_base + max_redirection) return;
+
+    // ISA defaults are edge/active high; PCI INTx is level/active low unless overridden
+    bool level = pci;
+    bool active_low = pci;
+    if (flags & 0x3) active_low = (flags & 0x3) == MADT_POLARITY_LOW;
+    if (flags & 0xC) level = (flags & 0xC) == MADT_TRIGGER_LEVEL;
+
+    // Fixed delivery, physical destination: this CPU
+    uint64_t entry = vector;
+    if (level) entry |= IOAPIC_LEVEL;
+    if (active_low) entry |= IOAPIC_ACTIVE_LOW;
+    entry |= (uint64_t)LocalAPIC::get_id() << 56;
+    set_entry(gsi, entry);
+}
+
+void IOAPIC::mask_irq(uint8_t irq) {
+    uint32_t gsi = ACPI::irq_to_gsi(irq, 0);
+    set_entry(gsi, get_entry(gsi) | IOAPIC_MASKED);
+}
+
+void IOAPIC::unmask_irq(uint8_t irq) {
+    uint32_t gsi = ACPI::irq_to_gsi(irq, 0);
+    set_entry(gsi, get_entry(gsi) & ~(uint64_t)IOAPIC_MASKED);
+}
+
+uint32_t IOAPIC::read(uint32_t reg) {
+    registers[IOAPIC_REGSEL / 4] = reg;
+    return registers[IOAPIC_WINDOW / 4];
+}
+
+void IOAPIC::write(uint32_t reg, uint32_t value) {
+    registers[IOAPIC_REGSEL / 4] = reg;
+    registers[IOAPIC_WINDOW / 4] = value;
+}
+
+void IOAPIC::set_entry(uint32_t gsi, uint64_t entry) {
+    uint32_t pin = gsi - gsi_base;
+    if (pin > max_redirection) return;
+    // Destination first, so the entry is never live with a stale target
+    write(IOAPIC_REDTBL + pin * 2 + 1, (uint32_t)(entry >> 32));
+    write(IOAPIC_REDTBL + pin * 2, (uint32_t)entry);
+}
+
+uint64_t IOAPIC::get_entry(uint32_t gsi) {
+    uint32_t pin = gsi - gsi_base;
+    if (pin > max_redirection) return IOAPIC_MASKED;
+    uint64_t low = read(IOAPIC_REDTBL + pin * 2);
+    uint64_t high = read(IOAPIC_REDTBL + pin * 2 + 1);
+    return (high << 32) | low;
+}
+
+} // namespace MesaOS::Arch::x86
@@ -0,0 +1,58 @@
+#ifndef APIC_HPP
+#define APIC_HPP
+
+#include <stdint.h>
+
+namespace MesaOS::Arch::x86 {
+
+#define APIC_SPURIOUS_VECTOR 0xFF
+
+// MSI/MSI-X vectors delivered through the local APIC
+#define MSI_VECTOR_BASE 64
+#define MSI_VECTOR_COUNT 16
+
+class LocalAPIC {
+public:
+    static bool initialize();
+    static bool is_enabled();
+    static uint32_t get_id();
+    static uint32_t get_base();
+    static void eoi();
+
+    static uint32_t read(uint32_t reg);
+    static void write(uint32_t reg, uint32_t value);
+
+private:
+    static volatile uint32_t* registers;
+    static uint32_t base;
+    static bool enabled;
+};
+
+// Routes the legacy ISA IRQs (and PCI INTx lines) in place of the 8259 PICs
+class IOAPIC {
+public:
+    // Needs the local APIC. Masks both PICs once the redirection table is set up.
+    static bool initialize();
+    static bool is_enabled();
+    static uint32_t get_max_redirection();
+
+    // ISA IRQ number -> IDT vector. PCI lines default to level/active low.
+    static void route_irq(uint8_t irq, uint8_t vector, bool pci = false);
+    static void mask_irq(uint8_t irq);
+    static void unmask_irq(uint8_t irq);
+
+private:
+    static uint32_t read(uint32_t reg);
+    static void write(uint32_t reg, uint32_t value);
+    static void set_entry(uint32_t gsi, uint64_t entry);
+    static uint64_t get_entry(uint32_t gsi);
+
+    static volatile uint32_t* registers;
+    static uint32_t gsi_base;
+    static uint32_t max_redirection;
+    static bool enabled;
+};
+
+} // namespace MesaOS::Arch::x86
+
+#endif
@@ -1,7 +1,8 @@
 /* Declare constants for the multiboot header. */
 .set ALIGN,    1<<0             /* align loaded modules on page boundaries */
 .set MEMINFO,  1<<1             /* provide memory map */
-.set FLAGS,    ALIGN | MEMINFO  /* this is the Multiboot 'flag' field */
+.set VIDEO,    1<<2             /* ask for a linear framebuffer */
+.set FLAGS,    ALIGN | MEMINFO | VIDEO /* this is the Multiboot 'flag' field */
 .set MAGIC,    0x1BADB002       /* 'magic number' lets bootloader find the header */
 .set CHECKSUM, -(MAGIC + FLAGS) /* checksum of above, to prove we are multiboot */
 
@@ -13,6 +14,14 @@ Multiboot header as per spec.
 .long MAGIC
 .long FLAGS
 .long CHECKSUM
+/* Address fields, unused without the a.out kludge flag */
+.long 0, 0, 0, 0, 0
+/* Preferred video mode: linear, 1024x768x32. The loader may pick another
+   or stay in text mode; the kernel checks what it got. */
+.long 0
+.long 1024
+.long 768
+.long 32
 
 /*
 The stack for the kernel.
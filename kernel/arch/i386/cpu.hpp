@@ -0,0 +1,49 @@
+#ifndef CPU_HPP
+#define CPU_HPP
+
+#include <stdint.h>
+
+namespace MesaOS::Arch::x86 {
+
+// Read the Time Stamp Counter
+static inline uint64_t rdtsc() {
+    uint32_t low, high;
+    asm volatile ( "rdtsc" : "=a"(low), "=d"(high) );
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    asm volatile ( "cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0) );
+}
+
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t low, high;
+    asm volatile ( "rdmsr" : "=a"(low), "=d"(high) : "c"(msr) );
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    asm volatile ( "wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)) );
+}
+
+// Full barrier: orders earlier stores before later loads, which x86 can
+// otherwise reorder. A locked op rather than mfence, which needs SSE2.
+static inline void memory_barrier() {
+    asm volatile("lock; addl $0, (%%esp)" : : : "memory", "cc");
+}
+
+// Disable interrupts, returning EFLAGS so restore_flags() puts IF back as it
+// was; nests, unlike a bare cli/sti pair
+static inline uint32_t save_flags_cli() {
+    uint32_t flags;
+    asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void restore_flags(uint32_t flags) {
+    asm volatile("push %0; popf" : : "r"(flags) : "memory", "cc");
+}
+
+} // namespace MesaOS::Arch::x86
+
+#endif
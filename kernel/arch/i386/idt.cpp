@@ -1,5 +1,7 @@
 #include "idt.hpp"
 #include "io_port.hpp"
+#include "isr.hpp"
+#include "apic.hpp"
 
 extern "C" void idt_flush(uint32_t);
 
@@ -17,7 +19,13 @@ extern "C" void irq0(); extern "C" void irq1(); extern "C" void irq2(); extern "
 extern "C" void irq4(); extern "C" void irq5(); extern "C" void irq6(); extern "C" void irq7();
 extern "C" void irq8(); extern "C" void irq9(); extern "C" void irq10(); extern "C" void irq11();
 extern "C" void irq12(); extern "C" void irq13(); extern "C" void irq14(); extern "C" void irq15();
+extern "C" void msi0(); extern "C" void msi1(); extern "C" void msi2(); extern "C" void msi3();
+extern "C" void msi4(); extern "C" void msi5(); extern "C" void msi6(); extern "C" void msi7();
+extern "C" void msi8(); extern "C" void msi9(); extern "C" void msi10(); extern "C" void msi11();
+extern "C" void msi12(); extern "C" void msi13(); extern "C" void msi14(); extern "C" void msi15();
+extern "C" void apic_spurious_handler();
 extern "C" void syscall_handler();
+extern "C" void yield_handler();
 
 namespace MesaOS::Arch::x86 {
 
@@ -99,11 +107,26 @@ void IDT::initialize() {
     set_gate(45, (uint32_t)irq13, 0x08, 0x8E);
     set_gate(46, (uint32_t)irq14, 0x08, 0x8E);
     set_gate(47, (uint32_t)irq15, 0x08, 0x8E);
+
+    // MSI/MSI-X vectors handed out by PCIDriver::allocate_msi_vector()
+    void (*msi_stubs[MSI_VECTOR_COUNT])() = {
+        msi0, msi1, msi2, msi3, msi4, msi5, msi6, msi7,
+        msi8, msi9, msi10, msi11, msi12, msi13, msi14, msi15
+    };
+    for (int i = 0; i < MSI_VECTOR_COUNT; i++) {
+        set_gate(MSI_VECTOR_BASE + i, (uint32_t)msi_stubs[i], 0x08, 0x8E);
+    }
+    set_gate(APIC_SPURIOUS_VECTOR, (uint32_t)apic_spurious_handler, 0x08, 0x8E);
     
     // Syscall gate (INT 0x80 = 128) - User callable (0xEE = 0x8E | 0x60)
     set_gate(128, (uint32_t)syscall_handler, 0x08, 0xEE);
 
+    // Yield gate (INT 0x81 = 129) - Kernel only
+    set_gate(129, (uint32_t)yield_handler, 0x08, 0x8E);
+
     idt_flush((uint32_t)&pointer);
+
+    initialize_interrupt_handlers();
 }
 
 void IDT::set_gate(uint8_t num, uint32_t base, uint16_t selector, uint8_t flags) {
@@ -24,6 +24,15 @@
         jmp irq_common_stub
 .endm
 
+.macro MSI num, target
+    .global msi\num
+    msi\num:
+        cli
+        push $0
+        push $\target
+        jmp irq_common_stub
+.endm
+
 ISR_NOERRCODE 0
 ISR_NOERRCODE 1
 ISR_NOERRCODE 2
@@ -74,11 +83,30 @@ IRQ 13, 45
 IRQ 14, 46
 IRQ 15, 47
 
+# MSI/MSI-X vectors, acknowledged through the local APIC
+MSI 0, 64
+MSI 1, 65
+MSI 2, 66
+MSI 3, 67
+MSI 4, 68
+MSI 5, 69
+MSI 6, 70
+MSI 7, 71
+MSI 8, 72
+MSI 9, 73
+MSI 10, 74
+MSI 11, 75
+MSI 12, 76
+MSI 13, 77
+MSI 14, 78
+MSI 15, 79
+
 .extern isr_handler
 .extern irq_handler
 
 isr_common_stub:
     pusha           # Pushes edi, esi, ebp, esp, ebx, edx, ecx, eax
+    cld             # The string routines in libc assume DF=0
 
     mov %ds, %ax    # Lower 16-bits of eax = ds.
     push %eax       # save the data segment descriptor
@@ -107,6 +135,7 @@ isr_common_stub:
 
 irq_common_stub:
     pusha
+    cld
 
     mov %ds, %ax
     push %eax
@@ -146,3 +175,16 @@ syscall_handler:
     push $0      # Error code (none)
     push $128    # Interrupt number
     jmp isr_common_stub
+
+# Yield interrupt (INT 0x81 = 129) - voluntary reschedule from kernel tasks
+.global yield_handler
+yield_handler:
+    cli
+    push $0      # Error code (none)
+    push $129    # Interrupt number
+    jmp isr_common_stub
+
+# Local APIC spurious interrupt (vector 0xFF) - must not be acknowledged
+.global apic_spurious_handler
+apic_spurious_handler:
+    iret
@@ -35,6 +35,15 @@ static inline uint32_t inl(uint16_t port) {
     return ret;
 }
 
+// Block transfers of 16-bit words, as used by ATA PIO data ports
+static inline void insw(uint16_t port, void* buffer, uint32_t count) {
+    asm volatile ( "rep insw" : "+D"(buffer), "+c"(count) : "d"(port) : "memory" );
+}
+
+static inline void outsw(uint16_t port, const void* buffer, uint32_t count) {
+    asm volatile ( "rep outsw" : "+S"(buffer), "+c"(count) : "d"(port) : "memory" );
+}
+
 static inline void io_wait() {
     outb(0x80, 0);
 }
@@ -1,6 +1,8 @@
 #include "isr.hpp"
 #include "drivers/vga.hpp"
 #include "io_port.hpp"
+#include "cpu.hpp"
+#include "apic.hpp"
 #include <string.h>
 #include "scheduler.hpp"
 #include "signals.hpp"
@@ -8,103 +10,161 @@
 #include "memory/pmm.hpp"
 #include "logging.hpp"
 #include "panic.hpp"
+#include "trace.hpp"
 
 namespace MesaOS::Arch::x86 {
 
-ISRHandler interrupt_handlers[256];
+IRQDescriptor irq_descriptors[256];
 
-void register_interrupt_handler(uint8_t n, ISRHandler handler) {
-    interrupt_handlers[n] = handler;
+// Handlers are chained from a static pool so registration works before the heap is up
+static const int MAX_IRQ_ACTIONS = 64;
+static IRQAction action_pool[MAX_IRQ_ACTIONS];
+static IRQAction* free_actions = 0;
+static bool pool_ready = false;
+
+static IRQAction* allocate_action() {
+    if (!pool_ready) {
+        for (int i = 0; i < MAX_IRQ_ACTIONS - 1; i++) action_pool[i].next = &action_pool[i + 1];
+        action_pool[MAX_IRQ_ACTIONS - 1].next = 0;
+        free_actions = &action_pool[0];
+        pool_ready = true;
+    }
+    IRQAction* action = free_actions;
+    if (action) free_actions = action->next;
+    return action;
 }
 
-void register_irq_handler(uint8_t n, ISRHandler handler) {
-    interrupt_handlers[n] = handler;
+void register_interrupt_handler(uint8_t n, ISRHandler handler, const char* name) {
+    register_irq_handler(n, handler, name);
 }
 
-} // namespace MesaOS::Arch::x86
+void register_irq_handler(uint8_t n, ISRHandler handler, const char* name) {
+    IRQDescriptor* desc = &irq_descriptors[n];
 
-extern "C" uint32_t isr_handler(uint32_t esp) {
-    MesaOS::Arch::x86::Registers* regs = (MesaOS::Arch::x86::Registers*)esp;
+    // Re-registering the same handler (e.g. a driver initialized twice) only renames it
+    IRQAction** tail = &desc->actions;
+    while (*tail) {
+        if ((*tail)->handler == handler) {
+            (*tail)->name = name;
+            return;
+        }
+        tail = &(*tail)->next;
+    }
+
+    IRQAction* action = allocate_action();
+    if (!action) return;
+    action->handler = handler;
+    action->name = name;
+    action->next = 0;
+    *tail = action;
+}
 
-    // Handle syscalls (INT 0x80 = 128)
-    if (regs->int_no == 128) {
-        if (MesaOS::Arch::x86::interrupt_handlers[128] != 0) {
-            MesaOS::Arch::x86::ISRHandler handler = MesaOS::Arch::x86::interrupt_handlers[128];
-            handler(regs);
+void unregister_irq_handler(uint8_t n, ISRHandler handler) {
+    IRQAction** link = &irq_descriptors[n].actions;
+    while (*link) {
+        if ((*link)->handler == handler) {
+            IRQAction* action = *link;
+            *link = action->next;
+            action->next = free_actions;
+            free_actions = action;
+            return;
         }
-        return esp;
+        link = &(*link)->next;
+    }
+}
+
+IRQDescriptor* get_irq_descriptor(uint8_t n) {
+    return &irq_descriptors[n];
+}
+
+// Runs every handler chained on the vector. Returns false if none is registered.
+static bool dispatch_interrupt(Registers* regs) {
+    IRQDescriptor* desc = &irq_descriptors[regs->int_no & 0xFF];
+    uint64_t start = rdtsc();
+    desc->count++;
+
+    IRQAction* action = desc->actions;
+    if (!action) return false;
+    while (action) {
+        action->handler(regs);
+        action = action->next;
     }
 
-    // Handle page faults (interrupt 14)
-    if (regs->int_no == 14) {
-        // Page fault handler
-        uint32_t faulting_address;
-        asm volatile("mov %%cr2, %0" : "=r"(faulting_address));
-
-        // Check error code bits
-        bool present = regs->err_code & 0x1;        // Page present bit
-        bool rw = regs->err_code & 0x2;            // Read/write bit
-        bool user = regs->err_code & 0x4;          // User/supervisor bit
-        bool reserved = regs->err_code & 0x8;      // Reserved bit
-        bool instruction = regs->err_code & 0x10;  // Instruction fetch bit
-
-        // Handle Copy-on-Write (COW) page faults
-        if (present && rw) {
-            // Write to a present page - likely COW
-            uint32_t dir_idx = faulting_address >> 22;
-            uint32_t table_idx = (faulting_address >> 12) & 0x03FF;
-
-            // Get current page directory
-            uint32_t* current_dir;
-            asm volatile("mov %%cr3, %0" : "=r"(current_dir));
-
-            if (current_dir && (dir_idx < 1024) && (current_dir[dir_idx] & 0x1)) {
-                uint32_t* table = (uint32_t*)(current_dir[dir_idx] & ~0xFFF);
-                if (table[table_idx] & 0x1) {
-                    uint32_t flags = table[table_idx] & 0xFFF;
-                    // Check if this is a COW page (bit 9 set)
-                    if (flags & (1 << 9)) {
-                        // COW page fault - allocate new page and copy data
-                        void* new_page = MesaOS::Memory::PMM::allocate_block();
-                        if (new_page) {
-                            // Copy data from original page
-                            uint32_t original_phys = table[table_idx] & ~0xFFF;
-                            memcpy(new_page, (void*)original_phys, 4096);
-
-                            // Update page table entry: clear COW flag, set writable
-                            table[table_idx] = ((uint32_t)new_page) | (flags & ~(1 << 9)) | 0x2;
-
-                            // Invalidate TLB
-                            asm volatile("invlpg (%0)" : : "r"(faulting_address) : "memory");
-
-                            MesaOS::System::Logging::info("COW page fault handled");
-                            return esp; // Resume execution
-                        }
+    desc->cycles += rdtsc() - start;
+    return true;
+}
+
+DEFINE_TRACEPOINT(page_fault, "addr=%x err=%x eip=%x");
+
+static void page_fault_handler(Registers* regs) {
+    // Page fault handler
+    uint32_t faulting_address;
+    asm volatile("mov %%cr2, %0" : "=r"(faulting_address));
+    TRACE(page_fault, faulting_address, regs->err_code, regs->eip);
+
+    // Check error code bits
+    bool present = regs->err_code & 0x1;        // Page present bit
+    bool rw = regs->err_code & 0x2;            // Read/write bit
+    bool user = regs->err_code & 0x4;          // User/supervisor bit
+    bool reserved = regs->err_code & 0x8;      // Reserved bit
+    bool instruction = regs->err_code & 0x10;  // Instruction fetch bit
+
+    // Handle Copy-on-Write (COW) page faults
+    if (present && rw) {
+        // Write to a present page - likely COW
+        uint32_t dir_idx = faulting_address >> 22;
+        uint32_t table_idx = (faulting_address >> 12) & 0x03FF;
+
+        // Get current page directory
+        uint32_t* current_dir;
+        asm volatile("mov %%cr3, %0" : "=r"(current_dir));
+
+        if (current_dir && (dir_idx < 1024) && (current_dir[dir_idx] & 0x1)) {
+            uint32_t* table = (uint32_t*)(current_dir[dir_idx] & ~0xFFF);
+            if (table[table_idx] & 0x1) {
+                uint32_t flags = table[table_idx] & 0xFFF;
+                // Check if this is a COW page (bit 9 set)
+                if (flags & (1 << 9)) {
+                    // COW page fault - allocate new page and copy data
+                    void* new_page = MesaOS::Memory::PMM::allocate_block();
+                    if (new_page) {
+                        // Copy data from original page
+                        uint32_t original_phys = table[table_idx] & ~0xFFF;
+                        memcpy(new_page, (void*)original_phys, 4096);
+
+                        // Update page table entry: clear COW flag, set writable
+                        table[table_idx] = ((uint32_t)new_page) | (flags & ~(1 << 9)) | 0x2;
+
+                        // Invalidate TLB
+                        asm volatile("invlpg (%0)" : : "r"(faulting_address) : "memory");
+
+                        MesaOS::System::Logging::info("COW page fault handled");
+                        return; // Resume execution
                     }
                 }
             }
         }
-
-        // If not handled as COW, panic
-        char panic_msg[128] = "Page fault at address 0x";
-        char addr_buf[16];
-        itoa(faulting_address, addr_buf, 16);
-        strcat(panic_msg, addr_buf);
-        strcat(panic_msg, " - ");
-
-        if (!present) strcat(panic_msg, "Page not present ");
-        if (rw) strcat(panic_msg, "Write access ");
-        else strcat(panic_msg, "Read access ");
-        if (user) strcat(panic_msg, "User mode ");
-        else strcat(panic_msg, "Kernel mode ");
-        if (reserved) strcat(panic_msg, "Reserved bit set ");
-        if (instruction) strcat(panic_msg, "Instruction fetch");
-
-        MesaOS::System::KernelPanic::panic(panic_msg, regs);
-        return esp; // This won't be reached, but keeps compiler happy
     }
 
-    // Basic handler for other exceptions - panic with details
+    // If not handled as COW, panic
+    char panic_msg[128] = "Page fault at address 0x";
+    char addr_buf[16];
+    itoa(faulting_address, addr_buf, 16);
+    strcat(panic_msg, addr_buf);
+    strcat(panic_msg, " - ");
+
+    if (!present) strcat(panic_msg, "Page not present ");
+    if (rw) strcat(panic_msg, "Write access ");
+    else strcat(panic_msg, "Read access ");
+    if (user) strcat(panic_msg, "User mode ");
+    else strcat(panic_msg, "Kernel mode ");
+    if (reserved) strcat(panic_msg, "Reserved bit set ");
+    if (instruction) strcat(panic_msg, "Instruction fetch");
+
+    MesaOS::System::KernelPanic::panic(panic_msg, regs);
+}
+
+static void unhandled_exception(Registers* regs) {
     char panic_msg[64] = "CPU Exception - Interrupt ";
     char buf[16];
     itoa(regs->int_no, buf, 10);
@@ -115,26 +175,60 @@ extern "C" uint32_t isr_handler(uint32_t esp) {
     strcat(panic_msg, ")");
 
     MesaOS::System::KernelPanic::panic(panic_msg, regs);
-    return esp; // This won't be reached, but keeps compiler happy
+}
+
+void initialize_interrupt_handlers() {
+    register_interrupt_handler(14, page_fault_handler, "page-fault");
+}
+
+} // namespace MesaOS::Arch::x86
+
+extern "C" uint32_t isr_handler(uint32_t esp) {
+    MesaOS::Arch::x86::Registers* regs = (MesaOS::Arch::x86::Registers*)esp;
+
+    if (!MesaOS::Arch::x86::dispatch_interrupt(regs) && regs->int_no < 32) {
+        MesaOS::Arch::x86::unhandled_exception(regs);
+    }
+
+    // Handlers such as yield() may have asked for a different task to run
+    return MesaOS::System::Scheduler::reschedule_if_pending(esp);
+}
+
+// A spurious IRQ7/IRQ15 is raised without its in-service bit set
+static bool is_spurious_irq(uint32_t int_no) {
+    if (int_no != IRQ7 && int_no != IRQ15) return false;
+    uint16_t port = (int_no == IRQ7) ? 0x20 : 0xA0;
+    MesaOS::Arch::x86::outb(port, 0x0B); // OCW3: read ISR
+    return !(MesaOS::Arch::x86::inb(port) & 0x80);
 }
 
 extern "C" uint32_t irq_handler(uint32_t esp) {
     MesaOS::Arch::x86::Registers* regs = (MesaOS::Arch::x86::Registers*)esp;
+
+    // With the IOAPIC routing interrupts (and for MSIs) a single memory-mapped
+    // local APIC EOI replaces the PIC port writes. It is sent after the handlers
+    // so a level-triggered line is deasserted before it can fire again.
+    if (MesaOS::Arch::x86::IOAPIC::is_enabled() || regs->int_no >= MSI_VECTOR_BASE) {
+        MesaOS::Arch::x86::dispatch_interrupt(regs);
+        MesaOS::Arch::x86::LocalAPIC::eoi();
+        return MesaOS::System::Scheduler::reschedule_if_pending(esp);
+    }
+
+    if (is_spurious_irq(regs->int_no)) {
+        MesaOS::Arch::x86::irq_descriptors[regs->int_no].spurious++;
+        // The master still saw the cascade line from a spurious slave IRQ
+        if (regs->int_no == IRQ15) MesaOS::Arch::x86::outb(0x20, 0x20);
+        return esp;
+    }
+
     // Send EOI (End of Interrupt) to the PICs
     if (regs->int_no >= 40) {
         MesaOS::Arch::x86::outb(0xA0, 0x20); // Signal slave PIC
     }
     MesaOS::Arch::x86::outb(0x20, 0x20);     // Signal master PIC
 
-    if (MesaOS::Arch::x86::interrupt_handlers[regs->int_no] != 0) {
-        MesaOS::Arch::x86::ISRHandler handler = MesaOS::Arch::x86::interrupt_handlers[regs->int_no];
-        handler(regs);
-    }
-    
-    // For IRQ0 (Timer), we might want to return a DIFFERENT stack pointer
-    if (regs->int_no == 32) {
-        return MesaOS::System::Scheduler::schedule(esp);
-    }
+    MesaOS::Arch::x86::dispatch_interrupt(regs);
 
-    return esp;
+    // The timer handler requests preemption, so IRQ0 may return a DIFFERENT stack pointer
+    return MesaOS::System::Scheduler::reschedule_if_pending(esp);
 }
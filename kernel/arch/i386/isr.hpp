@@ -14,8 +14,25 @@ struct Registers {
 
 typedef void (*ISRHandler)(Registers*);
 
-void register_interrupt_handler(uint8_t n, ISRHandler handler);
-void register_irq_handler(uint8_t n, ISRHandler handler);
+// One handler in a vector's chain. Every handler on a shared line is run.
+struct IRQAction {
+    ISRHandler handler;
+    const char* name;
+    IRQAction* next;
+};
+
+struct IRQDescriptor {
+    IRQAction* actions;
+    uint64_t count;    // Times the vector fired
+    uint64_t cycles;   // TSC cycles spent in its handlers
+    uint32_t spurious; // Spurious PIC interrupts (IRQ7/IRQ15 only)
+};
+
+void register_interrupt_handler(uint8_t n, ISRHandler handler, const char* name = "");
+void register_irq_handler(uint8_t n, ISRHandler handler, const char* name = "");
+void unregister_irq_handler(uint8_t n, ISRHandler handler);
+IRQDescriptor* get_irq_descriptor(uint8_t n);
+void initialize_interrupt_handlers();
 extern "C" uint32_t irq_handler(uint32_t esp);
 
 #define IRQ0 32
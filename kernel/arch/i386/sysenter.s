@@ -0,0 +1,68 @@
+# Fast system call path (SYSENTER/SYSEXIT)
+#
+# Register convention on entry:
+#   eax = syscall number, ebx = arg1, esi = arg4, edi = arg5
+#   ebp = pointer to arg2/arg3 on the caller stack
+#   ecx = caller esp, edx = caller eip (SYSEXIT reloads both from there)
+#
+# Only what the C dispatcher may clobber is saved. Segment registers are
+# left alone: every segment in our GDT is flat.
+
+.extern syscall_dispatch
+
+.global sysenter_entry
+sysenter_entry:
+    cld                  # User space may have left DF set
+    push %ecx            # Caller esp
+    push %edx            # Caller eip
+    push %edi            # arg5
+    push %esi            # arg4
+    push 4(%ebp)         # arg3
+    push 0(%ebp)         # arg2
+    push %ebx            # arg1
+    push %eax            # Syscall number
+    call syscall_dispatch
+    add $24, %esp
+    pop %edx
+    pop %ecx
+
+    # User space lives in the top 1GB (see VMM). SYSEXIT always lands in
+    # ring 3, so kernel callers are returned to by hand.
+    cmp $0xC0000000, %edx
+    jae 1f
+    mov %ecx, %esp
+    jmp *%edx
+1:
+    sti                  # Takes effect after SYSEXIT
+    sysexit
+
+# uint32_t sysenter_call(num, a1, a2, a3, a4, a5)
+# cdecl stub that issues a syscall through SYSENTER
+.global sysenter_call
+sysenter_call:
+    push %ebp
+    push %ebx
+    push %esi
+    push %edi
+    pushf                # SYSENTER clears IF, restore it afterwards
+
+    mov 24(%esp), %eax   # num
+    mov 28(%esp), %ebx   # a1
+    mov 32(%esp), %ecx   # a2
+    mov 36(%esp), %edx   # a3
+    mov 40(%esp), %esi   # a4
+    mov 44(%esp), %edi   # a5
+    push %edx
+    push %ecx
+    mov %esp, %ebp       # arg2/arg3 block
+    mov %esp, %ecx       # Return stack
+    mov $1f, %edx        # Return address
+    sysenter
+1:
+    add $8, %esp
+    popf
+    pop %edi
+    pop %esi
+    pop %ebx
+    pop %ebp
+    ret
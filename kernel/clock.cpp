@@ -0,0 +1,96 @@
+#include "clock.hpp"
+#include "arch/i386/cpu.hpp"
+#include "arch/i386/io_port.hpp"
+#include "drivers/pit.hpp"
+
+namespace MesaOS::System {
+
+#define PIT_HZ 1193182
+
+uint64_t Clock::tsc_hz = 0;
+uint64_t Clock::boot_tsc = 0;
+bool Clock::invariant = false;
+
+void Clock::initialize() {
+    // Invariant TSC: CPUID.80000007H:EDX[8]
+    uint32_t eax, ebx, ecx, edx;
+    MesaOS::Arch::x86::cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    if (eax >= 0x80000007) {
+        MesaOS::Arch::x86::cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+        invariant = edx & (1 << 8);
+    }
+
+    // Best of three short runs: an SMI or emulator hiccup only ever makes one longer
+    uint64_t best = 0;
+    for (int i = 0; i < 3; i++) {
+        uint64_t hz = calibrate_tsc(10);
+        if (hz && (!best || hz < best)) best = hz;
+    }
+    tsc_hz = best;
+    boot_tsc = MesaOS::Arch::x86::rdtsc();
+}
+
+// Counts TSC cycles across a one-shot PIT channel 2 countdown. Channel 0
+// keeps running the scheduler tick. Busy-waits, so boot time only.
+uint64_t Clock::calibrate_tsc(uint32_t ms) {
+    uint32_t latch = PIT_HZ * ms / 1000;
+
+    uint32_t flags;
+    asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+
+    // Gate channel 2 on, speaker output off
+    uint8_t port61 = MesaOS::Arch::x86::inb(0x61);
+    MesaOS::Arch::x86::outb(0x61, (port61 & ~0x02) | 0x01);
+
+    // Channel 2, lobyte/hibyte, mode 0 (interrupt on terminal count)
+    MesaOS::Arch::x86::outb(0x43, 0xB0);
+    MesaOS::Arch::x86::outb(0x42, latch & 0xFF);
+    MesaOS::Arch::x86::outb(0x42, (latch >> 8) & 0xFF);
+
+    uint64_t start = MesaOS::Arch::x86::rdtsc();
+    uint32_t loops = 0;
+    while (!(MesaOS::Arch::x86::inb(0x61) & 0x20)) {
+        if (++loops > 10000000) break; // OUT2 never rose: no usable PIT
+    }
+    uint64_t end = MesaOS::Arch::x86::rdtsc();
+
+    MesaOS::Arch::x86::outb(0x61, port61);
+    asm volatile("push %0; popf" : : "r"(flags) : "memory", "cc");
+
+    if (loops > 10000000 || end <= start) return 0;
+    return (end - start) * 1000 / ms;
+}
+
+uint64_t Clock::now_cycles() {
+    return MesaOS::Arch::x86::rdtsc();
+}
+
+// Split into whole seconds and a remainder so the multiply cannot overflow
+uint64_t Clock::cycles_to_ns(uint64_t cycles) {
+    if (!tsc_hz) return 0;
+    uint64_t seconds = cycles / tsc_hz;
+    uint64_t rem = cycles - seconds * tsc_hz;
+    return seconds * 1000000000ULL + rem * 1000000000ULL / tsc_hz;
+}
+
+uint64_t Clock::now_ns() {
+    if (!tsc_hz) {
+        uint32_t hz = MesaOS::Drivers::PIT::get_frequency();
+        return hz ? (uint64_t)MesaOS::Drivers::PIT::get_ticks() * (1000000000ULL / hz) : 0;
+    }
+    return cycles_to_ns(MesaOS::Arch::x86::rdtsc() - boot_tsc);
+}
+
+uint64_t Clock::now_us() {
+    return now_ns() / 1000;
+}
+
+uint32_t Clock::now_ms() {
+    return (uint32_t)(now_ns() / 1000000);
+}
+
+uint64_t Clock::get_tsc_hz() { return tsc_hz; }
+bool Clock::is_invariant() { return invariant; }
+bool Clock::is_calibrated() { return tsc_hz != 0; }
+
+} // namespace MesaOS::System
@@ -0,0 +1,34 @@
+#ifndef CLOCK_HPP
+#define CLOCK_HPP
+
+#include <stdint.h>
+
+namespace MesaOS::System {
+
+// Monotonic clock on the TSC, calibrated against PIT channel 2 at boot.
+// Falls back to PIT ticks (10ms resolution) if calibration fails.
+class Clock {
+public:
+    static void initialize();
+
+    static uint64_t now_cycles();   // Raw TSC
+    static uint64_t now_ns();       // Nanoseconds since initialize()
+    static uint64_t now_us();
+    static uint32_t now_ms();
+    static uint64_t cycles_to_ns(uint64_t cycles);
+
+    static uint64_t get_tsc_hz();
+    static bool is_invariant();     // TSC rate unaffected by P/C-states
+    static bool is_calibrated();
+
+private:
+    static uint64_t calibrate_tsc(uint32_t ms);
+
+    static uint64_t tsc_hz;
+    static uint64_t boot_tsc;
+    static bool invariant;
+};
+
+} // namespace MesaOS::System
+
+#endif
@@ -0,0 +1,478 @@
+#include "ahci.hpp"
+#include "arch/i386/cpu.hpp"
+#include "drivers/block.hpp"
+#include "memory/pmm.hpp"
+#include "memory/paging.hpp"
+#include "memory/kheap.hpp"
+#include "timer.hpp"
+#include "clock.hpp"
+#include "trace.hpp"
+#include <string.h>
+
+namespace MesaOS::Drivers {
+
+// HBA registers
+#define HBA_CAP 0x00
+#define HBA_GHC 0x04
+#define HBA_IS  0x08
+#define HBA_PI  0x0C
+
+#define CAP_NCS(cap) ((((cap) >> 8) & 0x1F) + 1) // Command slots per port
+#define CAP_SNCQ     (1u << 30)
+#define GHC_HR       (1u << 0)
+#define GHC_IE       (1u << 1)
+#define GHC_AE       (1u << 31)
+
+// Port registers, relative to ABAR + 0x100 + port * 0x80
+#define PX_CLB  0x00
+#define PX_CLBU 0x04
+#define PX_FB   0x08
+#define PX_FBU  0x0C
+#define PX_IS   0x10
+#define PX_IE   0x14
+#define PX_CMD  0x18
+#define PX_TFD  0x20
+#define PX_SIG  0x24
+#define PX_SSTS 0x28
+#define PX_SCTL 0x2C
+#define PX_SERR 0x30
+#define PX_SACT 0x34
+#define PX_CI   0x38
+
+#define PX_CMD_ST  (1u << 0)
+#define PX_CMD_FRE (1u << 4)
+#define PX_CMD_FR  (1u << 14)
+#define PX_CMD_CR  (1u << 15)
+
+#define PX_IS_DHRS 0x01 // D2H register FIS: non-queued completion
+#define PX_IS_PSS  0x02
+#define PX_IS_DSS  0x04
+#define PX_IS_SDBS 0x08 // Set device bits FIS: NCQ completion
+#define PX_IS_ERRORS 0x78000000 // TFES, HBFS, HBDS, IFS
+
+#define TFD_ERR 0x01
+#define TFD_DRQ 0x08
+#define TFD_BSY 0x80
+
+#define SIG_ATA 0x00000101
+
+#define FIS_TYPE_REG_H2D 0x27
+
+#define CMD_READ_DMA_EXT       0x25
+#define CMD_WRITE_DMA_EXT      0x35
+#define CMD_READ_FPDMA_QUEUED  0x60
+#define CMD_WRITE_FPDMA_QUEUED 0x61
+#define CMD_READ_DMA           0xC8
+#define CMD_WRITE_DMA          0xCA
+#define CMD_IDENTIFY           0xEC
+
+#define COMMAND_TABLE_SIZE 256       // 128-byte header area + one PRD, 128-byte aligned
+#define IDENTITY_LIMIT     0x4000000 // Paging identity-maps the first 64MB
+#define AHCI_TIMEOUT       1000000   // Register polls before giving up
+#define AHCI_TIMEOUT_MS    2000
+
+DEFINE_TRACEPOINT(ahci_submit, "lba=%u count=%u slot=%u");
+
+using MesaOS::Arch::x86::save_flags_cli;
+using MesaOS::Arch::x86::restore_flags;
+
+volatile uint32_t* AHCIDriver::hba = 0;
+volatile uint32_t* AHCIDriver::port_regs = 0;
+int AHCIDriver::port = -1;
+bool AHCIDriver::present = false;
+bool AHCIDriver::ncq = false;
+bool AHCIDriver::lba48 = false;
+uint32_t AHCIDriver::queue_depth = 1;
+uint64_t AHCIDriver::sector_count = 0;
+char AHCIDriver::model[41];
+uint8_t* AHCIDriver::command_list = 0;
+uint8_t* AHCIDriver::command_tables = 0;
+uint32_t AHCIDriver::slots_busy = 0;
+volatile uint32_t AHCIDriver::slots_issued = 0;
+volatile uint32_t AHCIDriver::slots_done = 0;
+volatile uint32_t AHCIDriver::slots_failed = 0;
+MesaOS::System::WaitQueue AHCIDriver::slot_wait = { 0 };
+MesaOS::System::WaitQueue AHCIDriver::done_wait = { 0 };
+
+// IDENTIFY target; .bss sits in the identity-mapped region
+static uint16_t identify_data[256];
+
+uint32_t AHCIDriver::read_reg(uint32_t reg) { return port_regs[reg / 4]; }
+void AHCIDriver::write_reg(uint32_t reg, uint32_t value) { port_regs[reg / 4] = value; }
+
+bool AHCIDriver::initialize(PCIDevice* dev) {
+    present = false;
+
+    // BAR5 (ABAR) is the HBA's memory-mapped register block
+    uint32_t abar = PCIDriver::config_read_dword(dev->bus, dev->device, dev->function, 0x24) & ~0xF;
+    if (abar == 0) return false;
+    for (uint32_t page = abar; page < abar + 0x1100; page += 4096) {
+        MesaOS::Memory::Paging::map_page(page, page, false, true);
+    }
+    hba = (volatile uint32_t*)abar;
+
+    uint16_t command = PCIDriver::config_read_word(dev->bus, dev->device, dev->function, 0x04);
+    command |= 0x0006; // Memory space and bus master
+    PCIDriver::config_write_word(dev->bus, dev->device, dev->function, 0x04, command);
+
+    hba[HBA_GHC / 4] |= GHC_AE;
+    uint32_t cap = hba[HBA_CAP / 4];
+    uint32_t implemented = hba[HBA_PI / 4];
+
+    // First implemented port with an ATA drive that has an established link
+    port = -1;
+    for (int i = 0; i < 32; i++) {
+        if (!(implemented & (1u << i))) continue;
+        volatile uint32_t* regs = (volatile uint32_t*)(abar + 0x100 + i * 0x80);
+        uint32_t ssts = regs[PX_SSTS / 4];
+        if ((ssts & 0xF) != 3 || ((ssts >> 8) & 0xF) != 1) continue;
+        if (regs[PX_SIG / 4] != SIG_ATA) continue;
+        port = i;
+        port_regs = regs;
+        break;
+    }
+    if (port < 0) return false;
+
+    // Command list (1KB) and FIS receive area (256 bytes) share a page;
+    // 32 command tables take two more
+    command_list = (uint8_t*)MesaOS::Memory::PMM::allocate_block();
+    command_tables = (uint8_t*)MesaOS::Memory::PMM::allocate_blocks(AHCI_MAX_SLOTS * COMMAND_TABLE_SIZE / 4096);
+    if (!command_list || !command_tables) return abort_init();
+    memset(command_list, 0, 4096);
+    memset(command_tables, 0, AHCI_MAX_SLOTS * COMMAND_TABLE_SIZE);
+
+    if (!stop_port()) return abort_init();
+    write_reg(PX_CLB, (uint32_t)command_list);
+    write_reg(PX_CLBU, 0);
+    write_reg(PX_FB, (uint32_t)command_list + 1024);
+    write_reg(PX_FBU, 0);
+    write_reg(PX_SERR, 0xFFFFFFFF);
+    write_reg(PX_IS, 0xFFFFFFFF);
+    write_reg(PX_IE, 0);
+    if (!start_port()) return abort_init();
+
+    build_command(0, CMD_IDENTIFY, 0, 1, (uint32_t)identify_data, false);
+    if (!run_polled(0)) return abort_init();
+
+    for (int i = 0; i < 20; i++) {
+        model[i * 2] = (char)(identify_data[27 + i] >> 8);
+        model[i * 2 + 1] = (char)(identify_data[27 + i] & 0xFF);
+    }
+    model[40] = 0;
+    for (int i = 39; i >= 0 && model[i] == ' '; i--) model[i] = 0;
+
+    lba48 = identify_data[83] & (1 << 10);
+    if (lba48) {
+        sector_count = (uint64_t)identify_data[100] | (uint64_t)identify_data[101] << 16 |
+                       (uint64_t)identify_data[102] << 32 | (uint64_t)identify_data[103] << 48;
+    } else {
+        sector_count = (uint32_t)identify_data[60] | (uint32_t)identify_data[61] << 16;
+    }
+
+    // NCQ needs it on both ends (HBA CAP.SNCQ, IDENTIFY word 76 bit 8); the
+    // depth is the smaller of the slot count and word 75 + 1
+    queue_depth = 1;
+    ncq = (cap & CAP_SNCQ) && (identify_data[76] & (1 << 8)) && lba48;
+    if (ncq) {
+        queue_depth = (identify_data[75] & 0x1F) + 1;
+        if (queue_depth > CAP_NCS(cap)) queue_depth = CAP_NCS(cap);
+    }
+
+    PCIDriver::setup_interrupt(dev, AHCIDriver::callback, "ahci");
+    write_reg(PX_IS, 0xFFFFFFFF);
+    hba[HBA_IS / 4] = 1u << port;
+    write_reg(PX_IE, PX_IS_DHRS | PX_IS_PSS | PX_IS_DSS | PX_IS_SDBS | PX_IS_ERRORS);
+    hba[HBA_GHC / 4] |= GHC_IE;
+
+    present = true;
+    BlockLayer::register_device("sda", sector_count, read_sectors, write_sectors);
+    return true;
+}
+
+// Gives the command list and tables back to the PMM after initialize()
+// failed. If the port was pointed at them it has to stop fetching first;
+// a port that won't stop is halted with a whole-HBA reset. Always false.
+bool AHCIDriver::abort_init() {
+    if (command_list && read_reg(PX_CLB) == (uint32_t)command_list) {
+        if (!stop_port()) {
+            hba[HBA_GHC / 4] |= GHC_HR;
+            for (int i = 0; (hba[HBA_GHC / 4] & GHC_HR) && i < AHCI_TIMEOUT; i++) {}
+        }
+        write_reg(PX_CLB, 0);
+        write_reg(PX_FB, 0);
+    }
+    if (command_list) MesaOS::Memory::PMM::free_block(command_list);
+    for (uint32_t i = 0; command_tables && i < AHCI_MAX_SLOTS * COMMAND_TABLE_SIZE / 4096; i++) {
+        MesaOS::Memory::PMM::free_block(command_tables + i * 4096);
+    }
+    command_list = 0;
+    command_tables = 0;
+    return false;
+}
+
+bool AHCIDriver::stop_port() {
+    write_reg(PX_CMD, read_reg(PX_CMD) & ~PX_CMD_ST);
+    for (int i = 0; read_reg(PX_CMD) & PX_CMD_CR; i++) {
+        if (i == AHCI_TIMEOUT) return false;
+    }
+    write_reg(PX_CMD, read_reg(PX_CMD) & ~PX_CMD_FRE);
+    for (int i = 0; read_reg(PX_CMD) & PX_CMD_FR; i++) {
+        if (i == AHCI_TIMEOUT) return false;
+    }
+    return true;
+}
+
+bool AHCIDriver::start_port() {
+    for (int i = 0; read_reg(PX_TFD) & (TFD_BSY | TFD_DRQ); i++) {
+        if (i == AHCI_TIMEOUT) return false;
+    }
+    write_reg(PX_CMD, read_reg(PX_CMD) | PX_CMD_FRE);
+    write_reg(PX_CMD, read_reg(PX_CMD) | PX_CMD_ST);
+    return true;
+}
+
+// After a task file or host bus error the port stops processing the list.
+// Everything outstanding is failed back to its submitter and the port is
+// restarted; a drive still busy after that gets a COMRESET.
+// Called with interrupts disabled.
+void AHCIDriver::recover() {
+    slots_failed |= slots_issued;
+    slots_done |= slots_issued;
+    slots_issued = 0;
+
+    stop_port();
+    write_reg(PX_SERR, 0xFFFFFFFF);
+    write_reg(PX_IS, 0xFFFFFFFF);
+    if (read_reg(PX_TFD) & (TFD_BSY | TFD_DRQ)) {
+        write_reg(PX_SCTL, (read_reg(PX_SCTL) & ~0xF) | 1);
+        for (int i = 0; i < AHCI_TIMEOUT / 100; i++) read_reg(PX_SSTS); // Hold DET=1 for >1ms
+        write_reg(PX_SCTL, read_reg(PX_SCTL) & ~0xF);
+        for (int i = 0; (read_reg(PX_SSTS) & 0xF) != 3 && i < AHCI_TIMEOUT; i++) {}
+        write_reg(PX_SERR, 0xFFFFFFFF);
+    }
+    start_port();
+}
+
+void AHCIDriver::callback(MesaOS::Arch::x86::Registers* regs) {
+    (void)regs;
+    if (!port_regs) return;
+
+    uint32_t status = read_reg(PX_IS);
+    write_reg(PX_IS, status);
+    hba[HBA_IS / 4] = 1u << port;
+
+    if (status & PX_IS_ERRORS) {
+        recover();
+    } else {
+        // A slot is finished once the HBA has cleared both its CI bit and,
+        // for queued commands, its SACT bit (set device bits FIS)
+        uint32_t pending = read_reg(PX_SACT) | read_reg(PX_CI);
+        uint32_t done = slots_issued & ~pending;
+        slots_issued &= ~done;
+        slots_done |= done;
+    }
+    MesaOS::System::Scheduler::wake_all(&done_wait);
+}
+
+// Fills the command header and table for one slot: a register H2D FIS and
+// a single PRD covering the physically contiguous buffer
+void AHCIDriver::build_command(int slot, uint8_t command, uint64_t lba, uint32_t count,
+                               uint32_t phys, bool write) {
+    uint32_t* header = (uint32_t*)(command_list + slot * 32);
+    uint8_t* table = command_tables + slot * COMMAND_TABLE_SIZE;
+
+    header[0] = 5 | (write ? (1 << 6) : 0) | (1 << 16); // FIS length in dwords, W, PRDTL = 1
+    header[1] = 0;
+    header[2] = (uint32_t)table;
+    header[3] = 0;
+
+    memset(table, 0, 0x90);
+    uint8_t* fis = table;
+    fis[0] = FIS_TYPE_REG_H2D;
+    fis[1] = 0x80; // Command, not control
+    fis[2] = command;
+    fis[4] = (uint8_t)lba;
+    fis[5] = (uint8_t)(lba >> 8);
+    fis[6] = (uint8_t)(lba >> 16);
+    fis[8] = (uint8_t)(lba >> 24);
+    fis[9] = (uint8_t)(lba >> 32);
+    fis[10] = (uint8_t)(lba >> 40);
+
+    if (command == CMD_READ_FPDMA_QUEUED || command == CMD_WRITE_FPDMA_QUEUED) {
+        // Sector count moves to the feature registers; the tag goes in count
+        fis[3] = (uint8_t)count;
+        fis[11] = (uint8_t)(count >> 8);
+        fis[12] = (uint8_t)(slot << 3);
+        fis[7] = 0x40;
+    } else if (command == CMD_READ_DMA || command == CMD_WRITE_DMA) {
+        fis[12] = (uint8_t)count;
+        fis[7] = 0x40 | ((lba >> 24) & 0x0F);
+    } else if (command != CMD_IDENTIFY) {
+        fis[12] = (uint8_t)count;
+        fis[13] = (uint8_t)(count >> 8);
+        fis[7] = 0x40;
+    }
+
+    uint32_t* prd = (uint32_t*)(table + 0x80);
+    prd[0] = phys;
+    prd[1] = 0;
+    prd[2] = 0;
+    prd[3] = count * 512 - 1;
+}
+
+// Used before interrupts are wired up (IDENTIFY)
+bool AHCIDriver::run_polled(int slot) {
+    asm volatile("" : : : "memory");
+    write_reg(PX_CI, 1u << slot);
+    for (int i = 0; read_reg(PX_CI) & (1u << slot); i++) {
+        if (i == AHCI_TIMEOUT || (read_reg(PX_IS) & PX_IS_ERRORS)) {
+            uint32_t flags = save_flags_cli();
+            recover();
+            restore_flags(flags);
+            return false;
+        }
+    }
+    write_reg(PX_IS, 0xFFFFFFFF);
+    return !(read_reg(PX_TFD) & TFD_ERR);
+}
+
+// Claims a free slot within the queue depth. A caller that already holds
+// slots must not sleep here (two batches could wait on each other), so it
+// passes wait = false and runs what it has first.
+int AHCIDriver::alloc_slot(bool wait) {
+    uint32_t flags = save_flags_cli();
+    uint32_t usable = queue_depth == 32 ? 0xFFFFFFFF : (1u << queue_depth) - 1;
+    uint32_t start = MesaOS::System::Clock::now_ms();
+    int slot = -1;
+
+    for (;;) {
+        uint32_t free = usable & ~slots_busy;
+        if (free) {
+            slot = __builtin_ctz(free);
+            slots_busy |= 1u << slot;
+            break;
+        }
+        if (!wait) break;
+
+        MesaOS::System::Process* self = MesaOS::System::Scheduler::get_current();
+        if (!self || self->pid == 0) {
+            asm volatile("sti; hlt; cli");
+            if (MesaOS::System::Clock::now_ms() - start >= AHCI_TIMEOUT_MS) break;
+        } else {
+            MesaOS::System::Scheduler::block(&slot_wait);
+        }
+    }
+    restore_flags(flags);
+    return slot;
+}
+
+void AHCIDriver::submit(int slot, uint64_t lba, uint32_t count, uint8_t* buffer, bool write) {
+    uint8_t command;
+    if (ncq) command = write ? CMD_WRITE_FPDMA_QUEUED : CMD_READ_FPDMA_QUEUED;
+    else if (lba48) command = write ? CMD_WRITE_DMA_EXT : CMD_READ_DMA_EXT;
+    else command = write ? CMD_WRITE_DMA : CMD_READ_DMA;
+
+    TRACE(ahci_submit, (uint32_t)lba, count, slot);
+    build_command(slot, command, lba, count, (uint32_t)buffer, write);
+
+    uint32_t bit = 1u << slot;
+    uint32_t flags = save_flags_cli();
+    slots_done &= ~bit;
+    slots_failed &= ~bit;
+    slots_issued |= bit;
+    asm volatile("" : : : "memory");
+    if (ncq) write_reg(PX_SACT, bit);
+    write_reg(PX_CI, bit);
+    restore_flags(flags);
+}
+
+// Sleeps until every slot in mask has completed, then releases them
+bool AHCIDriver::wait_slots(uint32_t mask) {
+    uint32_t flags = save_flags_cli();
+    MesaOS::System::Process* self = MesaOS::System::Scheduler::get_current();
+    uint32_t start = MesaOS::System::Clock::now_ms();
+
+    while ((slots_done & mask) != mask) {
+        bool timed_out;
+        if (!self || self->pid == 0) {
+            asm volatile("sti; hlt; cli");
+            timed_out = MesaOS::System::Clock::now_ms() - start >= AHCI_TIMEOUT_MS;
+        } else {
+            timed_out = !MesaOS::System::Timer::sleep_on(&done_wait, AHCI_TIMEOUT_MS);
+        }
+        if (timed_out && (slots_done & mask) != mask) recover();
+    }
+
+    bool ok = !(slots_failed & mask);
+    slots_busy &= ~mask;
+    MesaOS::System::Scheduler::wake_all(&slot_wait);
+    restore_flags(flags);
+    return ok;
+}
+
+// Buffers in the identity-mapped region are handed to the HBA directly, as
+// many commands at once as there are free slots. Anything else (user
+// mappings, odd addresses) goes one command at a time through a heap bounce
+// buffer, which is identity-mapped.
+bool AHCIDriver::transfer(uint64_t lba, uint32_t count, uint8_t* buffer, bool write) {
+    if (!present) return false;
+    if (lba + count > sector_count) return false;
+
+    uint32_t addr = (uint32_t)buffer;
+    if (!(addr & 1) && addr + count * 512 <= IDENTITY_LIMIT) {
+        while (count > 0) {
+            uint32_t mask = 0;
+            while (count > 0) {
+                int slot = alloc_slot(mask == 0);
+                if (slot < 0) break;
+                uint32_t chunk = count > AHCI_MAX_SECTORS ? AHCI_MAX_SECTORS : count;
+                submit(slot, lba, chunk, buffer, write);
+                mask |= 1u << slot;
+                lba += chunk;
+                count -= chunk;
+                buffer += chunk * 512;
+            }
+            if (!mask || !wait_slots(mask)) return false;
+        }
+        return true;
+    }
+
+    uint8_t* bounce = (uint8_t*)kmalloc(AHCI_MAX_SECTORS * 512);
+    if (!bounce) return false;
+    bool ok = true;
+    while (ok && count > 0) {
+        uint32_t chunk = count > AHCI_MAX_SECTORS ? AHCI_MAX_SECTORS : count;
+        int slot = alloc_slot(true);
+        if (slot < 0) {
+            ok = false;
+            break;
+        }
+        if (write) memcpy(bounce, buffer, chunk * 512);
+        submit(slot, lba, chunk, bounce, write);
+        ok = wait_slots(1u << slot);
+        if (ok && !write) memcpy(buffer, bounce, chunk * 512);
+        lba += chunk;
+        count -= chunk;
+        buffer += chunk * 512;
+    }
+    kfree(bounce);
+    return ok;
+}
+
+bool AHCIDriver::read_sectors(uint64_t lba, uint32_t count, uint8_t* buffer) {
+    return transfer(lba, count, buffer, false);
+}
+
+bool AHCIDriver::write_sectors(uint64_t lba, uint32_t count, const uint8_t* buffer) {
+    return transfer(lba, count, (uint8_t*)buffer, true);
+}
+
+bool AHCIDriver::is_present() { return present; }
+bool AHCIDriver::has_lba48() { return lba48; }
+uint64_t AHCIDriver::get_sector_count() { return sector_count; }
+const char* AHCIDriver::get_model() { return model; }
+int AHCIDriver::get_port() { return port; }
+bool AHCIDriver::ncq_enabled() { return ncq; }
+uint32_t AHCIDriver::get_queue_depth() { return queue_depth; }
+
+} // namespace MesaOS::Drivers
@@ -0,0 +1,75 @@
+#ifndef AHCI_HPP
+#define AHCI_HPP
+
+#include <stdint.h>
+#include "drivers/pci.hpp"
+#include "arch/i386/isr.hpp"
+#include "scheduler.hpp"
+
+namespace MesaOS::Drivers {
+
+// AHCI HBA, first port with a SATA disk attached. Transfers are split into
+// commands of up to AHCI_MAX_SECTORS and, when both the HBA and the drive
+// support native command queuing, issued together as READ/WRITE FPDMA
+// QUEUED in up to 32 slots. Same block interface as IDEDriver.
+#define AHCI_MAX_SLOTS   32
+#define AHCI_MAX_SECTORS 256 // Per command: 128KB, one PRD entry
+
+class AHCIDriver {
+public:
+    static bool initialize(PCIDevice* dev);
+
+    // Return false on a device error or timeout
+    static bool read_sectors(uint64_t lba, uint32_t count, uint8_t* buffer);
+    static bool write_sectors(uint64_t lba, uint32_t count, const uint8_t* buffer);
+
+    static bool is_present();
+    static bool has_lba48();
+    static uint64_t get_sector_count();
+    static const char* get_model();
+    static int get_port();
+    static bool ncq_enabled();
+    static uint32_t get_queue_depth(); // Commands that may be outstanding at once
+
+    static void callback(MesaOS::Arch::x86::Registers* regs);
+
+private:
+    static uint32_t read_reg(uint32_t reg);
+    static void write_reg(uint32_t reg, uint32_t value);
+    static bool stop_port();
+    static bool start_port();
+    static bool abort_init();
+    static void recover();
+
+    static int alloc_slot(bool wait);
+    static void build_command(int slot, uint8_t command, uint64_t lba, uint32_t count,
+                              uint32_t phys, bool write);
+    static bool run_polled(int slot);
+    static void submit(int slot, uint64_t lba, uint32_t count, uint8_t* buffer, bool write);
+    static bool wait_slots(uint32_t mask);
+    static bool transfer(uint64_t lba, uint32_t count, uint8_t* buffer, bool write);
+
+    static volatile uint32_t* hba;
+    static volatile uint32_t* port_regs;
+    static int port;
+    static bool present;
+    static bool ncq;
+    static bool lba48;
+    static uint32_t queue_depth;
+    static uint64_t sector_count;
+    static char model[41];
+
+    static uint8_t* command_list;   // 32 headers, followed by the FIS receive area
+    static uint8_t* command_tables; // One per slot
+
+    static uint32_t slots_busy;              // Allocated to a submitter
+    static volatile uint32_t slots_issued;   // Handed to the HBA
+    static volatile uint32_t slots_done;     // Completed since submission
+    static volatile uint32_t slots_failed;   // Completed with an error
+    static MesaOS::System::WaitQueue slot_wait;
+    static MesaOS::System::WaitQueue done_wait;
+};
+
+} // namespace MesaOS::Drivers
+
+#endif
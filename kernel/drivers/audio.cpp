@@ -3,6 +3,7 @@
 #include "logging.hpp"
 #include "memory/kheap.hpp"
 #include "arch/i386/io_port.hpp"
+#include "timer.hpp"
 #include <string.h>
 
 namespace MesaOS::Drivers {
@@ -95,11 +96,8 @@ bool AudioDriver::play_buffer(const uint8_t* buffer, uint32_t size) {
         MesaOS::System::Logging::info("PC Speaker melody playback completed");
     } else {
         // Fallback simulation for other audio devices
-        for (volatile uint32_t i = 0; i < size / 100; i++) {
-            if (i % 1000 == 0) {
-                // Small delay to show progress
-            }
-        }
+        // Take as long as the buffer would play at 8kHz 8-bit mono
+        MesaOS::System::Timer::sleep_ms(size / 8);
         MesaOS::System::Logging::info("Audio playback completed - simulation");
     }
 
@@ -176,7 +174,7 @@ void AudioDriver::play_melody_pc_speaker(const uint8_t* buffer, uint32_t size) {
         play_tone_pc_speaker(freq, note_duration_ms);
 
         // Small pause between notes
-        for (volatile uint32_t pause = 0; pause < 50000; pause++);
+        MesaOS::System::Timer::sleep_ms(50);
     }
 
     // Turn off speaker
@@ -186,7 +184,7 @@ void AudioDriver::play_melody_pc_speaker(const uint8_t* buffer, uint32_t size) {
 void AudioDriver::play_tone_pc_speaker(uint16_t frequency, uint32_t duration_ms) {
     if (frequency == 0) {
         // Rest - just wait
-        for (volatile uint32_t i = 0; i < duration_ms * 1000; i++);
+        MesaOS::System::Timer::sleep_ms(duration_ms);
         return;
     }
 
@@ -194,7 +192,7 @@ void AudioDriver::play_tone_pc_speaker(uint16_t frequency, uint32_t duration_ms)
     set_pit_frequency(frequency);
 
     // Wait for the duration
-    for (volatile uint32_t i = 0; i < duration_ms * 1000; i++);
+    MesaOS::System::Timer::sleep_ms(duration_ms);
 }
 
 void AudioDriver::enable_pc_speaker() {
@@ -0,0 +1,375 @@
+#include "block.hpp"
+#include "arch/i386/cpu.hpp"
+#include "memory/kheap.hpp"
+#include "clock.hpp"
+#include "trace.hpp"
+#include <string.h>
+
+namespace MesaOS::Drivers {
+
+// Deadline scheduler: requests are served in ascending LBA order from the
+// last position (one-way elevator) unless one has waited past its expiry.
+// Reads expire sooner because a task is usually blocked on them. Neither
+// rule lets I/O to the same sectors pass each other unless both are reads.
+#define READ_EXPIRE_MS  500
+#define WRITE_EXPIRE_MS 5000
+
+DEFINE_TRACEPOINT(block_dispatch, "lba=%u sectors=%u bios=%u");
+
+using MesaOS::Arch::x86::save_flags_cli;
+using MesaOS::Arch::x86::restore_flags;
+
+BlockDevice BlockLayer::devices[BLOCK_MAX_DEVICES];
+int BlockLayer::device_count = 0;
+BlockDevice* BlockLayer::default_device = 0;
+bool BlockLayer::worker_running = false;
+uint32_t BlockLayer::next_seq = 0;
+MesaOS::System::WaitQueue BlockLayer::worker_wait;
+
+BlockDevice* BlockLayer::register_device(const char* name, uint64_t sector_count,
+                                         bool (*read)(uint64_t, uint32_t, uint8_t*),
+                                         bool (*write)(uint64_t, uint32_t, const uint8_t*)) {
+    if (device_count >= BLOCK_MAX_DEVICES) return 0;
+
+    BlockDevice* dev = &devices[device_count++];
+    memset(dev, 0, sizeof(BlockDevice));
+    strncpy(dev->name, name, sizeof(dev->name) - 1);
+    dev->sector_count = sector_count;
+    dev->read = read;
+    dev->write = write;
+    return dev;
+}
+
+BlockDevice* BlockLayer::find(const char* name) {
+    for (int i = 0; i < device_count; i++) {
+        if (strcmp(devices[i].name, name) == 0) return &devices[i];
+    }
+    return 0;
+}
+
+BlockDevice* BlockLayer::get_devices() { return devices; }
+int BlockLayer::get_device_count() { return device_count; }
+
+BlockDevice* BlockLayer::get_default() {
+    if (default_device) return default_device;
+    return device_count > 0 ? &devices[0] : 0;
+}
+
+void BlockLayer::set_default(BlockDevice* dev) { default_device = dev; }
+
+// True if a queued request overlaps bio's sectors and one of the two is a
+// write. Called with interrupts disabled.
+bool BlockLayer::conflicts(BlockDevice* dev, Bio* bio) {
+    for (Bio* req = dev->queue; req; req = req->next) {
+        if ((req->write || bio->write) && req->lba < bio->lba + bio->count &&
+            bio->lba < req->lba + req->total) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// True if req holds a bio that overlaps an older bio of other, with at
+// least one of the two requests a write, so other has to be dispatched
+// first: reads see the data written before them and the newest write lands
+// last. Since conflicts() keeps such bios from merging into older requests,
+// this never holds both ways.
+bool BlockLayer::must_follow(Bio* req, Bio* other) {
+    if ((!req->write && !other->write) || req->lba >= other->lba + other->total ||
+        other->lba >= req->lba + req->total) {
+        return false;
+    }
+    for (Bio* r = req; r; r = r->merged) {
+        for (Bio* o = other; o; o = o->merged) {
+            if ((int32_t)(o->seq - r->seq) < 0 && r->lba < o->lba + o->count &&
+                o->lba < r->lba + r->count) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Joins bio onto a queued request of the same direction that it extends at
+// either end. A bio overlapping queued writes, or a write overlapping any
+// queued I/O, stays on its own so it can't be carried ahead of that I/O.
+// Called with interrupts disabled.
+bool BlockLayer::try_merge(BlockDevice* dev, Bio* bio) {
+    if (conflicts(dev, bio)) return false;
+    for (Bio** link = &dev->queue; *link; link = &(*link)->next) {
+        Bio* req = *link;
+        if (req->write != bio->write || req->total + bio->count > BLOCK_MAX_MERGE) continue;
+
+        if (req->lba + req->total == bio->lba) {
+            // Back merge: append to the request's chain
+            if (req->merged_tail) req->merged_tail->merged = bio;
+            else req->merged = bio;
+            req->merged_tail = bio;
+            req->total += bio->count;
+            return true;
+        }
+        if (bio->lba + bio->count == req->lba) {
+            // Front merge: bio heads the request and takes its queue slot
+            bio->merged = req;
+            bio->merged_tail = req->merged_tail ? req->merged_tail : req;
+            bio->total = bio->count + req->total;
+            if ((int32_t)(req->expires - bio->expires) < 0) bio->expires = req->expires;
+            bio->next = req->next;
+            *link = bio;
+            return true;
+        }
+    }
+    return false;
+}
+
+void BlockLayer::insert_sorted(BlockDevice* dev, Bio* req) {
+    Bio** link = &dev->queue;
+    while (*link && (*link)->lba <= req->lba) link = &(*link)->next;
+    req->next = *link;
+    *link = req;
+}
+
+// Oldest request if it has expired, else the next one at or beyond the
+// elevator position, wrapping to the lowest LBA; then any older overlapping
+// request of the other direction ahead of that. Called with interrupts
+// disabled.
+Bio* BlockLayer::pick_next(BlockDevice* dev) {
+    if (!dev->queue) return 0;
+
+    uint32_t now = MesaOS::System::Clock::now_ms();
+    Bio** oldest = &dev->queue;
+    Bio** ahead = 0;
+    for (Bio** link = &dev->queue; *link; link = &(*link)->next) {
+        if ((int32_t)((*link)->expires - (*oldest)->expires) < 0) oldest = link;
+        if (!ahead && (*link)->lba >= dev->head_pos) ahead = link;
+    }
+
+    Bio** pick;
+    if ((int32_t)(now - (*oldest)->expires) >= 0) {
+        pick = oldest;
+        dev->expired++;
+    } else {
+        pick = ahead ? ahead : &dev->queue;
+    }
+    for (Bio** link = &dev->queue; *link; ) {
+        if (*link != *pick && must_follow(*pick, *link)) {
+            pick = link;
+            link = &dev->queue; // The new pick may have to wait too
+        } else {
+            link = &(*link)->next;
+        }
+    }
+
+    Bio* req = *pick;
+    *pick = req->next;
+    req->next = 0;
+    dev->head_pos = req->lba + req->total;
+    return req;
+}
+
+void BlockLayer::submit(BlockDevice* dev, Bio* bio) {
+    bio->status = BIO_PENDING;
+    bio->next = 0;
+    bio->merged = 0;
+    bio->merged_tail = 0;
+    bio->total = bio->count;
+    bio->expires = MesaOS::System::Clock::now_ms() + (bio->write ? WRITE_EXPIRE_MS : READ_EXPIRE_MS);
+
+    if (!dev || bio->count == 0 || bio->lba + bio->count > dev->sector_count) {
+        if (bio->done) bio->done(bio, false);
+        bio->status = BIO_ERROR;
+        return;
+    }
+
+    uint32_t flags = save_flags_cli();
+    bio->seq = next_seq++;
+    dev->bios++;
+    if (try_merge(dev, bio)) dev->merges++;
+    else insert_sorted(dev, bio);
+    restore_flags(flags);
+
+    run_queue(dev);
+}
+
+void BlockLayer::plug(BlockDevice* dev) {
+    uint32_t flags = save_flags_cli();
+    dev->plugged++;
+    restore_flags(flags);
+}
+
+void BlockLayer::unplug(BlockDevice* dev) {
+    uint32_t flags = save_flags_cli();
+    if (dev->plugged > 0) dev->plugged--;
+    restore_flags(flags);
+    run_queue(dev);
+}
+
+void BlockLayer::unplug_async(BlockDevice* dev) {
+    if (!worker_running) {
+        unplug(dev);
+        return;
+    }
+    uint32_t flags = save_flags_cli();
+    if (dev->plugged > 0) dev->plugged--;
+    MesaOS::System::Scheduler::wake_one(&worker_wait);
+    restore_flags(flags);
+}
+
+void BlockLayer::start_worker() {
+    if (worker_running) return;
+    worker_running = true;
+    MesaOS::System::Scheduler::add_process("kblockd", BlockLayer::worker);
+}
+
+// Called with interrupts disabled
+bool BlockLayer::has_work() {
+    for (int i = 0; i < device_count; i++) {
+        if (devices[i].queue && !devices[i].plugged && !devices[i].dispatching) return true;
+    }
+    return false;
+}
+
+// kblockd: drains queues that were unplugged without a dispatcher
+void BlockLayer::worker() {
+    for (;;) {
+        for (int i = 0; i < device_count; i++) run_queue(&devices[i]);
+
+        uint32_t flags = save_flags_cli();
+        if (!has_work()) MesaOS::System::Scheduler::block(&worker_wait);
+        restore_flags(flags);
+    }
+}
+
+// The submitting task dispatches: if nobody is running the queue it drains
+// it, driver calls and all, while bios submitted meanwhile by other tasks
+// queue up behind it and get sorted and merged.
+void BlockLayer::run_queue(BlockDevice* dev) {
+    uint32_t flags = save_flags_cli();
+    if (dev->dispatching || dev->plugged) {
+        restore_flags(flags);
+        return;
+    }
+    dev->dispatching = true;
+    for (;;) {
+        Bio* req = pick_next(dev);
+        if (!req) break;
+        restore_flags(flags);
+        execute(dev, req);
+        flags = save_flags_cli();
+    }
+    dev->dispatching = false;
+    restore_flags(flags);
+}
+
+// One driver call for the whole request. Merged bios whose buffers don't
+// follow each other in memory are gathered into (or scattered from) a heap
+// buffer; without one they go to the driver individually.
+void BlockLayer::execute(BlockDevice* dev, Bio* req) {
+    bool write = req->write;
+    uint32_t bios = 1;
+    bool contiguous = true;
+    uint8_t* expect = req->buffer + req->count * 512;
+    for (Bio* bio = req->merged; bio; bio = bio->merged) {
+        if (bio->buffer != expect) contiguous = false;
+        expect = bio->buffer + bio->count * 512;
+        bios++;
+    }
+    TRACE(block_dispatch, (uint32_t)req->lba, req->total, bios);
+
+    uint8_t* data = req->buffer;
+    uint8_t* bounce = 0;
+    if (!contiguous) {
+        bounce = (uint8_t*)kmalloc(req->total * 512);
+        if (!bounce) {
+            for (Bio* bio = req; bio; ) {
+                Bio* next = bio->merged;
+                bool ok = write ? dev->write(bio->lba, bio->count, bio->buffer)
+                                : dev->read(bio->lba, bio->count, bio->buffer);
+                dev->requests++;
+                complete(dev, bio, ok);
+                bio = next;
+            }
+            return;
+        }
+        if (write) {
+            uint8_t* p = bounce;
+            for (Bio* bio = req; bio; bio = bio->merged) {
+                memcpy(p, bio->buffer, bio->count * 512);
+                p += bio->count * 512;
+            }
+        }
+        data = bounce;
+    }
+
+    bool ok = write ? dev->write(req->lba, req->total, data) : dev->read(req->lba, req->total, data);
+    dev->requests++;
+
+    if (bounce) {
+        if (ok && !write) {
+            uint8_t* p = bounce;
+            for (Bio* bio = req; bio; bio = bio->merged) {
+                memcpy(bio->buffer, p, bio->count * 512);
+                p += bio->count * 512;
+            }
+        }
+        kfree(bounce);
+    }
+
+    // done() may free or resubmit the bio, so step past it first
+    for (Bio* bio = req; bio; ) {
+        Bio* next = bio->merged;
+        complete(dev, bio, ok);
+        bio = next;
+    }
+}
+
+void BlockLayer::complete(BlockDevice* dev, Bio* bio, bool ok) {
+    if (ok) {
+        if (bio->write) dev->sectors_written += bio->count;
+        else dev->sectors_read += bio->count;
+    } else {
+        dev->errors++;
+    }
+
+    if (bio->done) bio->done(bio, ok);
+    uint32_t flags = save_flags_cli();
+    bio->status = ok ? BIO_OK : BIO_ERROR;
+    MesaOS::System::Scheduler::wake_all(&dev->completion_wait);
+    restore_flags(flags);
+}
+
+bool BlockLayer::wait(BlockDevice* dev, Bio* bio) {
+    uint32_t flags = save_flags_cli();
+    MesaOS::System::Process* self = MesaOS::System::Scheduler::get_current();
+    while (bio->status == BIO_PENDING) {
+        // The kernel (idle) process must not block; it halts instead
+        if (!self || self->pid == 0) asm volatile("sti; hlt; cli");
+        else MesaOS::System::Scheduler::block(&dev->completion_wait);
+    }
+    restore_flags(flags);
+    return bio->status == BIO_OK;
+}
+
+bool BlockLayer::read(BlockDevice* dev, uint64_t lba, uint32_t count, uint8_t* buffer) {
+    Bio bio;
+    memset(&bio, 0, sizeof(Bio));
+    bio.lba = lba;
+    bio.count = count;
+    bio.buffer = buffer;
+    bio.write = false;
+    submit(dev, &bio);
+    return wait(dev, &bio);
+}
+
+bool BlockLayer::write(BlockDevice* dev, uint64_t lba, uint32_t count, const uint8_t* buffer) {
+    Bio bio;
+    memset(&bio, 0, sizeof(Bio));
+    bio.lba = lba;
+    bio.count = count;
+    bio.buffer = (uint8_t*)buffer;
+    bio.write = true;
+    submit(dev, &bio);
+    return wait(dev, &bio);
+}
+
+} // namespace MesaOS::Drivers
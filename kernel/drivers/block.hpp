@@ -0,0 +1,115 @@
+#ifndef BLOCK_HPP
+#define BLOCK_HPP
+
+#include <stdint.h>
+#include "scheduler.hpp"
+
+namespace MesaOS::Drivers {
+
+#define BIO_PENDING 0
+#define BIO_OK      1
+#define BIO_ERROR   2
+
+#define BLOCK_MAX_DEVICES 4
+#define BLOCK_MAX_MERGE   256 // Sectors in one merged request (128KB)
+
+// One transfer of whole sectors. Filesystems fill in the public part and
+// submit it; the block layer may merge it with LBA-adjacent bios of the same
+// direction into one driver request. done() runs once, in the context of
+// whichever task dispatched the request, before status leaves BIO_PENDING.
+struct Bio {
+    uint64_t lba;
+    uint32_t count;
+    uint8_t* buffer;
+    bool write;
+    void (*done)(struct Bio* bio, bool ok); // May be null
+    void* priv;                             // For done()
+    volatile int status;                    // BIO_PENDING until completed
+
+    // Owned by the block layer while queued
+    uint32_t expires;   // Clock::now_ms() deadline
+    uint32_t seq;       // Submission order
+    uint32_t total;     // Sectors in the request this bio heads
+    struct Bio* next;   // Dispatch queue, sorted by LBA
+    struct Bio* merged; // Bios merged behind this one, ascending LBA
+    struct Bio* merged_tail;
+};
+
+// A disk as drivers register it. read/write take a run of sectors into a
+// single buffer and return false on error; IDEDriver, AHCIDriver and
+// VirtioBlkDriver all have that shape.
+struct BlockDevice {
+    char name[8];
+    uint64_t sector_count;
+    bool (*read)(uint64_t lba, uint32_t count, uint8_t* buffer);
+    bool (*write)(uint64_t lba, uint32_t count, const uint8_t* buffer);
+
+    Bio* queue;          // Pending requests, sorted by LBA
+    uint64_t head_pos;   // LBA after the last dispatched request (elevator position)
+    bool dispatching;    // A task is running the queue
+    uint32_t plugged;    // Nesting count; queue only, no dispatch
+    MesaOS::System::WaitQueue completion_wait;
+
+    uint32_t bios;       // Submitted
+    uint32_t merges;     // Bios that joined an existing request
+    uint32_t requests;   // Driver calls
+    uint32_t expired;    // Requests dispatched because their deadline passed
+    uint32_t errors;
+    uint64_t sectors_read;
+    uint64_t sectors_written;
+};
+
+class BlockLayer {
+public:
+    static BlockDevice* register_device(const char* name, uint64_t sector_count,
+                                        bool (*read)(uint64_t, uint32_t, uint8_t*),
+                                        bool (*write)(uint64_t, uint32_t, const uint8_t*));
+    static BlockDevice* find(const char* name);
+    static BlockDevice* get_devices();
+    static int get_device_count();
+
+    // Device filesystems mount by default; the first registered until set
+    static BlockDevice* get_default();
+    static void set_default(BlockDevice* dev);
+
+    // Asynchronous interface. While a device is plugged, submitted bios only
+    // queue (and merge); unplug() dispatches them.
+    static void submit(BlockDevice* dev, Bio* bio);
+    static void plug(BlockDevice* dev);
+    static void unplug(BlockDevice* dev);
+    static bool wait(BlockDevice* dev, Bio* bio);
+
+    // Like unplug(), but leaves dispatch to kblockd so the caller doesn't
+    // run the driver itself (read-ahead). Dispatches inline until
+    // start_worker() has been called.
+    static void unplug_async(BlockDevice* dev);
+    static void start_worker();
+
+    // Synchronous helpers: one bio, submitted and waited for. Not for use
+    // while the caller holds a plug on the same device.
+    static bool read(BlockDevice* dev, uint64_t lba, uint32_t count, uint8_t* buffer);
+    static bool write(BlockDevice* dev, uint64_t lba, uint32_t count, const uint8_t* buffer);
+
+private:
+    static bool conflicts(BlockDevice* dev, Bio* bio);
+    static bool must_follow(Bio* req, Bio* other);
+    static bool try_merge(BlockDevice* dev, Bio* bio);
+    static void insert_sorted(BlockDevice* dev, Bio* req);
+    static Bio* pick_next(BlockDevice* dev);
+    static void run_queue(BlockDevice* dev);
+    static void execute(BlockDevice* dev, Bio* req);
+    static void complete(BlockDevice* dev, Bio* bio, bool ok);
+    static bool has_work();
+    static void worker();
+
+    static BlockDevice devices[BLOCK_MAX_DEVICES];
+    static int device_count;
+    static BlockDevice* default_device;
+    static bool worker_running;
+    static uint32_t next_seq;
+    static MesaOS::System::WaitQueue worker_wait;
+};
+
+} // namespace MesaOS::Drivers
+
+#endif
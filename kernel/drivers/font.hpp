@@ -0,0 +1,14 @@
+#ifndef FONT_HPP
+#define FONT_HPP
+
+#include <stdint.h>
+
+namespace MesaOS::Drivers {
+
+// Built-in 8x16 PSF1 console font (drivers/font.cpp, from scripts/gen_font.py)
+extern const uint8_t console_font_psf[];
+extern const uint32_t console_font_psf_size;
+
+} // namespace MesaOS::Drivers
+
+#endif
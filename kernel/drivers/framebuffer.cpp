@@ -0,0 +1,157 @@
+#include "framebuffer.hpp"
+#include "font.hpp"
+#include "memory/paging.hpp"
+#include <string.h>
+
+namespace MesaOS::Drivers {
+
+#define PSF1_MAGIC 0x0436
+#define PSF2_MAGIC 0x864AB572
+
+bool Framebuffer::enabled = false;
+uint8_t* Framebuffer::base = 0;
+uint32_t Framebuffer::pitch = 0;
+uint32_t Framebuffer::width = 0;
+uint32_t Framebuffer::height = 0;
+uint32_t Framebuffer::bpp = 0;
+uint32_t Framebuffer::origin_x = 0;
+uint32_t Framebuffer::origin_y = 0;
+uint32_t Framebuffer::palette[16];
+
+const uint8_t* Framebuffer::glyphs = 0;
+uint32_t Framebuffer::glyph_count = 0;
+uint32_t Framebuffer::glyph_height = 0;
+uint32_t Framebuffer::glyph_stride = 0;
+
+uint16_t Framebuffer::front[COLS * ROWS];
+uint16_t Framebuffer::cursor = 0xFFFF;
+
+// Standard VGA text palette, 0xRRGGBB
+static const uint32_t vga_rgb[16] = {
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF
+};
+
+bool Framebuffer::initialize(uint32_t magic, multiboot_info* mbt) {
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC || !mbt) return false;
+    if (!(mbt->flags & MULTIBOOT_INFO_FRAMEBUFFER_INFO)) return false;
+    if (mbt->framebuffer_type != MULTIBOOT_FRAMEBUFFER_TYPE_RGB || mbt->framebuffer_bpp != 32) return false;
+    if (mbt->framebuffer_addr >> 32) return false; // Not reachable without PAE
+
+    if (!load_font(console_font_psf, console_font_psf_size)) return false;
+    if (mbt->framebuffer_width < COLS * 8 || mbt->framebuffer_height < ROWS * glyph_height) return false;
+
+    base = (uint8_t*)(uint32_t)mbt->framebuffer_addr;
+    pitch = mbt->framebuffer_pitch;
+    width = mbt->framebuffer_width;
+    height = mbt->framebuffer_height;
+    bpp = mbt->framebuffer_bpp;
+    origin_x = (width - COLS * 8) / 2;
+    origin_y = (height - ROWS * glyph_height) / 2;
+
+    // Translate the VGA palette into the mode's channel layout once
+    for (int i = 0; i < 16; i++) {
+        uint32_t r = (vga_rgb[i] >> 16) & 0xFF, g = (vga_rgb[i] >> 8) & 0xFF, b = vga_rgb[i] & 0xFF;
+        palette[i] = (r >> (8 - mbt->framebuffer_red_size)) << mbt->framebuffer_red_position
+                   | (g >> (8 - mbt->framebuffer_green_size)) << mbt->framebuffer_green_position
+                   | (b >> (8 - mbt->framebuffer_blue_size)) << mbt->framebuffer_blue_position;
+    }
+
+    // Clear the whole screen, including the border around the grid
+    for (uint32_t y = 0; y < height; y++) {
+        uint32_t* line = (uint32_t*)(base + y * pitch);
+        for (uint32_t x = 0; x < width; x++) line[x] = palette[0];
+    }
+    for (size_t i = 0; i < COLS * ROWS; i++) front[i] = 0; // Black on black: nothing drawn
+    cursor = 0xFFFF;
+
+    enabled = true;
+    return true;
+}
+
+void Framebuffer::map() {
+    if (!enabled) return;
+    uint32_t start = (uint32_t)base & ~0xFFF;
+    uint32_t end = (uint32_t)base + pitch * height;
+    for (uint32_t page = start; page < end; page += 4096) {
+        MesaOS::Memory::Paging::map_page(page, page, false, true);
+    }
+}
+
+bool Framebuffer::is_enabled() { return enabled; }
+uint32_t Framebuffer::get_width() { return width; }
+uint32_t Framebuffer::get_height() { return height; }
+uint32_t Framebuffer::get_bpp() { return bpp; }
+
+bool Framebuffer::load_font(const uint8_t* psf, uint32_t size) {
+    if (size >= 4 && (psf[0] | psf[1] << 8) == PSF1_MAGIC) {
+        glyph_height = psf[3];
+        glyph_stride = glyph_height;
+        glyph_count = (psf[2] & 0x01) ? 512 : 256;
+        glyphs = psf + 4;
+    } else if (size >= 32 && *(const uint32_t*)psf == PSF2_MAGIC) {
+        const uint32_t* header = (const uint32_t*)psf;
+        if (header[7] != 8) return false; // Glyph blitting assumes one byte per row
+        glyphs = psf + header[2];
+        glyph_count = header[4];
+        glyph_stride = header[5];
+        glyph_height = header[6];
+    } else {
+        return false;
+    }
+    return glyph_height > 0 && glyph_count >= 128;
+}
+
+// One glyph row is eight 32-bit stores. Each pixel picks fg or bg through a
+// mask built from its font bit, so the loop has no per-pixel branches.
+void Framebuffer::blit(size_t col, size_t row, uint16_t cell, bool with_cursor) {
+    uint32_t fg = palette[(cell >> 8) & 0x0F];
+    uint32_t bg = palette[(cell >> 12) & 0x0F];
+    uint32_t diff = fg ^ bg;
+    uint32_t ch = cell & 0xFF;
+    const uint8_t* glyph = glyphs + (ch < glyph_count ? ch : '?') * glyph_stride;
+    uint8_t* dst = base + (origin_y + row * glyph_height) * pitch + (origin_x + col * 8) * 4;
+
+    for (uint32_t y = 0; y < glyph_height; y++) {
+        uint32_t bits = glyph[y];
+        if (with_cursor && y + 2 >= glyph_height) bits = 0xFF; // Underline cursor
+        uint32_t* px = (uint32_t*)dst;
+        px[0] = bg ^ (diff & -((bits >> 7) & 1));
+        px[1] = bg ^ (diff & -((bits >> 6) & 1));
+        px[2] = bg ^ (diff & -((bits >> 5) & 1));
+        px[3] = bg ^ (diff & -((bits >> 4) & 1));
+        px[4] = bg ^ (diff & -((bits >> 3) & 1));
+        px[5] = bg ^ (diff & -((bits >> 2) & 1));
+        px[6] = bg ^ (diff & -((bits >> 1) & 1));
+        px[7] = bg ^ (diff & -(bits & 1));
+        dst += pitch;
+    }
+}
+
+void Framebuffer::draw_cell(size_t col, size_t row, uint16_t cell) {
+    if (!enabled || col >= COLS || row >= ROWS) return;
+    size_t index = row * COLS + col;
+    if (front[index] == cell) return;
+    front[index] = cell;
+    blit(col, row, cell, index == cursor);
+}
+
+void Framebuffer::draw_row(size_t row, const uint16_t* cells) {
+    if (!enabled || row >= ROWS) return;
+    uint16_t* drawn = front + row * COLS;
+    for (size_t col = 0; col < COLS; col++) {
+        if (drawn[col] == cells[col]) continue;
+        drawn[col] = cells[col];
+        blit(col, row, cells[col], row * COLS + col == cursor);
+    }
+}
+
+void Framebuffer::set_cursor(uint16_t pos) {
+    if (!enabled || pos == cursor) return;
+    uint16_t old = cursor;
+    cursor = pos;
+    if (old < COLS * ROWS) blit(old % COLS, old / COLS, front[old], false);
+    if (pos < COLS * ROWS) blit(pos % COLS, pos / COLS, front[pos], true);
+}
+
+} // namespace MesaOS::Drivers
@@ -0,0 +1,57 @@
+#ifndef FRAMEBUFFER_HPP
+#define FRAMEBUFFER_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include "multiboot.h"
+
+namespace MesaOS::Drivers {
+
+// Linear framebuffer set up by the boot loader. Renders VGADriver's 80x25
+// cell grid (character + attribute) with a PSF font, centred on the screen,
+// so text-mode callers work unchanged. Only 32bpp RGB modes are supported.
+class Framebuffer {
+public:
+    static const size_t COLS = 80;
+    static const size_t ROWS = 25;
+
+    // Call before paging; the framebuffer is reached through its physical address
+    static bool initialize(uint32_t magic, multiboot_info* mbt);
+    static void map(); // Identity-map the framebuffer once paging is on
+    static bool is_enabled();
+    static bool load_font(const uint8_t* psf, uint32_t size); // PSF1 or PSF2, 8 pixels wide
+
+    // Draws cells that differ from what is already on screen
+    static void draw_row(size_t row, const uint16_t* cells);
+    static void draw_cell(size_t col, size_t row, uint16_t cell);
+    static void set_cursor(uint16_t pos);
+
+    static uint32_t get_width();
+    static uint32_t get_height();
+    static uint32_t get_bpp();
+
+private:
+    static void blit(size_t col, size_t row, uint16_t cell, bool cursor);
+
+    static bool enabled;
+    static uint8_t* base;
+    static uint32_t pitch;
+    static uint32_t width;
+    static uint32_t height;
+    static uint32_t bpp;
+    static uint32_t origin_x; // Top-left pixel of the cell grid
+    static uint32_t origin_y;
+    static uint32_t palette[16];
+
+    static const uint8_t* glyphs;
+    static uint32_t glyph_count;
+    static uint32_t glyph_height;
+    static uint32_t glyph_stride;
+
+    static uint16_t front[COLS * ROWS]; // Cells as currently drawn
+    static uint16_t cursor;
+};
+
+} // namespace MesaOS::Drivers
+
+#endif
@@ -1,58 +1,441 @@
 #include "ide.hpp"
 #include "arch/i386/io_port.hpp"
+#include "arch/i386/cpu.hpp"
+#include "drivers/pci.hpp"
+#include "drivers/block.hpp"
+#include "memory/pmm.hpp"
+#include "timer.hpp"
+#include "clock.hpp"
+#include "trace.hpp"
+#include <string.h>
 
 namespace MesaOS::Drivers {
 
-#define STATUS_BSY 0x80
+#define ATA_DATA       0x1F0
+#define ATA_ERROR      0x1F1
+#define ATA_COUNT      0x1F2
+#define ATA_LBA_LOW    0x1F3
+#define ATA_LBA_MID    0x1F4
+#define ATA_LBA_HIGH   0x1F5
+#define ATA_DRIVE      0x1F6
+#define ATA_COMMAND    0x1F7 // Status on read
+#define ATA_CONTROL    0x3F6 // Alternate status on read
+
+#define STATUS_ERR 0x01
 #define STATUS_DRQ 0x08
+#define STATUS_DF  0x20
+#define STATUS_BSY 0x80
+
+#define CONTROL_NIEN 0x02 // Mask INTRQ; kept set until DMA is available
+
+#define CMD_READ_SECTORS      0x20
+#define CMD_READ_SECTORS_EXT  0x24
+#define CMD_READ_MULTIPLE_EXT 0x29
+#define CMD_WRITE_SECTORS     0x30
+#define CMD_WRITE_SECTORS_EXT 0x34
+#define CMD_WRITE_MULTIPLE_EXT 0x39
+#define CMD_READ_DMA_EXT      0x25
+#define CMD_WRITE_DMA_EXT     0x35
+#define CMD_READ_MULTIPLE     0xC4
+#define CMD_WRITE_MULTIPLE    0xC5
+#define CMD_SET_MULTIPLE      0xC6
+#define CMD_READ_DMA          0xC8
+#define CMD_WRITE_DMA         0xCA
+#define CMD_IDENTIFY          0xEC
+
+#define LBA28_LIMIT   0x10000000ULL
+#define ATA_TIMEOUT   1000000 // Status polls before giving up
+
+// Bus-master IDE registers, primary channel, relative to BAR4
+#define BM_COMMAND 0x00
+#define BM_STATUS  0x02
+#define BM_PRDT    0x04
+
+#define BM_CMD_START 0x01
+#define BM_CMD_READ  0x08 // Direction: device to memory
+
+#define BM_STATUS_ACTIVE 0x01
+#define BM_STATUS_ERROR  0x02
+#define BM_STATUS_IRQ    0x04 // Write 1 to clear, like ERROR
+
+#define PRD_EOT 0x80000000 // Last descriptor in the table
+
+#define DMA_BUFFER_BLOCKS 16  // 64KB bounce buffer
+#define DMA_MAX_SECTORS   (DMA_BUFFER_BLOCKS * 4096 / 512)
+#define DMA_TIMEOUT_MS    2000
+
+using MesaOS::Arch::x86::save_flags_cli;
+using MesaOS::Arch::x86::restore_flags;
+
+DEFINE_TRACEPOINT(ide_read, "lba=%u count=%u drive=%u");
+DEFINE_TRACEPOINT(ide_write, "lba=%u count=%u drive=%u");
+
+bool IDEDriver::present = false;
+bool IDEDriver::lba48 = false;
+uint64_t IDEDriver::sector_count = 0;
+uint32_t IDEDriver::multiple_sectors = 1;
+char IDEDriver::model[41];
+uint16_t IDEDriver::bm_base = 0;
+uint32_t* IDEDriver::prd_table = 0;
+uint8_t* IDEDriver::dma_buffer = 0;
+volatile bool IDEDriver::dma_done = false;
+volatile uint8_t IDEDriver::dma_status = 0;
+MesaOS::System::WaitQueue IDEDriver::dma_wait = { 0 };
+MesaOS::System::WaitQueue IDEDriver::lock_wait = { 0 };
+bool IDEDriver::busy = false;
 
 void IDEDriver::initialize() {
-    // Basic ATA initialization: identify drive 0
-    MesaOS::Arch::x86::outb(0x1F6, 0xA0);
+    using namespace MesaOS::Arch::x86;
+
+    present = false;
+    lba48 = false;
+    multiple_sectors = 1;
+    model[0] = 0;
+
+    outb(ATA_CONTROL, CONTROL_NIEN);
+    outb(ATA_DRIVE, 0xA0);
+    outb(ATA_COUNT, 0);
+    outb(ATA_LBA_LOW, 0);
+    outb(ATA_LBA_MID, 0);
+    outb(ATA_LBA_HIGH, 0);
+    outb(ATA_COMMAND, CMD_IDENTIFY);
+
+    // Status 0 means no drive; a non-zero signature means ATAPI/SATA bridge
+    if (inb(ATA_COMMAND) == 0) return;
+    if (!wait_bsy()) return;
+    if (inb(ATA_LBA_MID) || inb(ATA_LBA_HIGH)) return;
+    if (!wait_drq()) return;
+
+    uint16_t id[256];
+    insw(ATA_DATA, id, 256);
+    present = true;
+
+    // Model string: words 27-46, bytes swapped within each word
+    for (int i = 0; i < 20; i++) {
+        model[i * 2] = (char)(id[27 + i] >> 8);
+        model[i * 2 + 1] = (char)(id[27 + i] & 0xFF);
+    }
+    model[40] = 0;
+    for (int i = 39; i >= 0 && model[i] == ' '; i--) model[i] = 0;
+
+    lba48 = id[83] & (1 << 10);
+    if (lba48) {
+        sector_count = (uint64_t)id[100] | (uint64_t)id[101] << 16 |
+                       (uint64_t)id[102] << 32 | (uint64_t)id[103] << 48;
+    } else {
+        sector_count = (uint32_t)id[60] | (uint32_t)id[61] << 16;
+    }
+
+    // Word 47: largest DRQ block the drive supports for READ/WRITE MULTIPLE
+    uint32_t max_multiple = id[47] & 0xFF;
+    if (max_multiple > 1) {
+        outb(ATA_DRIVE, 0xE0);
+        outb(ATA_COUNT, (uint8_t)max_multiple);
+        outb(ATA_COMMAND, CMD_SET_MULTIPLE);
+        if (wait_bsy() && !(inb(ATA_COMMAND) & STATUS_ERR)) multiple_sectors = max_multiple;
+    }
+
+    // Word 49 bit 8: DMA supported
+    setup_dma(id[49] & (1 << 8));
+
+    if (!BlockLayer::find("hda")) BlockLayer::register_device("hda", sector_count, read_sectors, write_sectors);
 }
 
-void IDEDriver::wait_bsy() {
-    while (MesaOS::Arch::x86::inb(0x1F7) & STATUS_BSY);
+// Looks for a PCI IDE controller in compatibility mode with bus-master
+// support (PIIX and friends). BAR4 holds the bus-master I/O block.
+void IDEDriver::setup_dma(bool drive_supports_dma) {
+    using namespace MesaOS::Arch::x86;
+    using MesaOS::Drivers::PCIDriver;
+
+    if (!drive_supports_dma || bm_base) return;
+
+    PCIDevice* controller = 0;
+    uint32_t bar4 = 0;
+    for (int i = 0; i < PCIDriver::get_device_count(); i++) {
+        PCIDevice* dev = &PCIDriver::get_devices()[i];
+        if (dev->class_id != 0x01 || dev->subclass_id != 0x01) continue;
+
+        // Prog IF bit 0: primary channel in native mode (not at 0x1F0);
+        // bit 7: bus master capable
+        uint8_t prog_if = PCIDriver::config_read_word(dev->bus, dev->device, dev->function, 0x08) >> 8;
+        if ((prog_if & 0x01) || !(prog_if & 0x80)) continue;
+
+        bar4 = PCIDriver::config_read_dword(dev->bus, dev->device, dev->function, 0x20);
+        if (!(bar4 & 0x1) || (bar4 & ~0x3) == 0) continue;
+        controller = dev;
+        break;
+    }
+    if (!controller) return;
+
+    // The PRD table must not cross a 64KB boundary; one page never does
+    prd_table = (uint32_t*)MesaOS::Memory::PMM::allocate_block();
+    dma_buffer = (uint8_t*)MesaOS::Memory::PMM::allocate_blocks(DMA_BUFFER_BLOCKS);
+    if (!prd_table || !dma_buffer) {
+        if (prd_table) MesaOS::Memory::PMM::free_block(prd_table);
+        for (int i = 0; dma_buffer && i < DMA_BUFFER_BLOCKS; i++) {
+            MesaOS::Memory::PMM::free_block(dma_buffer + i * 4096);
+        }
+        prd_table = 0;
+        dma_buffer = 0;
+        return;
+    }
+
+    uint16_t command = PCIDriver::config_read_word(controller->bus, controller->device, controller->function, 0x04);
+    command |= 0x0005; // I/O space and bus master
+    PCIDriver::config_write_word(controller->bus, controller->device, controller->function, 0x04, command);
+
+    bm_base = (uint16_t)(bar4 & ~0x3);
+    outb(bm_base + BM_COMMAND, 0);
+    outb(bm_base + BM_STATUS, BM_STATUS_ERROR | BM_STATUS_IRQ);
+
+    register_irq_handler(IRQ14, IDEDriver::callback, "ide");
+    outb(ATA_CONTROL, 0); // Unmask INTRQ
 }
 
-void IDEDriver::wait_drq() {
-    while (!(MesaOS::Arch::x86::inb(0x1F7) & STATUS_DRQ));
+void IDEDriver::callback(MesaOS::Arch::x86::Registers* regs) {
+    using namespace MesaOS::Arch::x86;
+    (void)regs;
+
+    // Reading the status register acknowledges INTRQ on the drive
+    inb(ATA_COMMAND);
+    if (!bm_base) return;
+
+    uint8_t status = inb(bm_base + BM_STATUS);
+    if (!(status & BM_STATUS_IRQ)) return;
+    outb(bm_base + BM_STATUS, BM_STATUS_ERROR | BM_STATUS_IRQ);
+
+    dma_status = status;
+    dma_done = true;
+    MesaOS::System::Scheduler::wake_all(&dma_wait);
 }
 
-void IDEDriver::read_sector(uint32_t lba, uint8_t* buffer) {
-    wait_bsy();
-    MesaOS::Arch::x86::outb(0x1F6, 0xE0 | ((lba >> 24) & 0x0F));
-    MesaOS::Arch::x86::outb(0x1F2, 1);
-    MesaOS::Arch::x86::outb(0x1F3, (uint8_t)lba);
-    MesaOS::Arch::x86::outb(0x1F4, (uint8_t)(lba >> 8));
-    MesaOS::Arch::x86::outb(0x1F5, (uint8_t)(lba >> 16));
-    MesaOS::Arch::x86::outb(0x1F7, 0x20); // READ SECTORS
+bool IDEDriver::wait_bsy() {
+    for (int i = 0; i < ATA_TIMEOUT; i++) {
+        if (!(MesaOS::Arch::x86::inb(ATA_COMMAND) & STATUS_BSY)) return true;
+    }
+    return false;
+}
+
+bool IDEDriver::wait_drq() {
+    for (int i = 0; i < ATA_TIMEOUT; i++) {
+        uint8_t status = MesaOS::Arch::x86::inb(ATA_COMMAND);
+        if (status & (STATUS_ERR | STATUS_DF)) return false;
+        if (!(status & STATUS_BSY) && (status & STATUS_DRQ)) return true;
+    }
+    return false;
+}
 
-    wait_bsy();
-    wait_drq();
+// Programs the task file and issues the read/write command for up to 256
+// sectors (LBA28) or 65536 (LBA48). count 0 in the register means the maximum.
+bool IDEDriver::issue(uint64_t lba, uint32_t count, bool write, bool dma) {
+    using namespace MesaOS::Arch::x86;
+    if (!wait_bsy()) return false;
 
-    uint16_t* ptr = (uint16_t*)buffer;
-    for (int i = 0; i < 256; i++) {
-        ptr[i] = MesaOS::Arch::x86::inw(0x1F0);
+    bool multiple = multiple_sectors > 1;
+    uint8_t command;
+    if (lba48 && lba + count > LBA28_LIMIT) {
+        outb(ATA_DRIVE, 0x40);
+        // High-order bytes first, then low-order, through the same registers
+        outb(ATA_COUNT, (uint8_t)(count >> 8));
+        outb(ATA_LBA_LOW, (uint8_t)(lba >> 24));
+        outb(ATA_LBA_MID, (uint8_t)(lba >> 32));
+        outb(ATA_LBA_HIGH, (uint8_t)(lba >> 40));
+        outb(ATA_COUNT, (uint8_t)count);
+        outb(ATA_LBA_LOW, (uint8_t)lba);
+        outb(ATA_LBA_MID, (uint8_t)(lba >> 8));
+        outb(ATA_LBA_HIGH, (uint8_t)(lba >> 16));
+        if (dma) command = write ? CMD_WRITE_DMA_EXT : CMD_READ_DMA_EXT;
+        else if (write) command = multiple ? CMD_WRITE_MULTIPLE_EXT : CMD_WRITE_SECTORS_EXT;
+        else command = multiple ? CMD_READ_MULTIPLE_EXT : CMD_READ_SECTORS_EXT;
+    } else {
+        if (lba + count > LBA28_LIMIT) return false;
+        outb(ATA_DRIVE, 0xE0 | ((lba >> 24) & 0x0F));
+        outb(ATA_COUNT, (uint8_t)count);
+        outb(ATA_LBA_LOW, (uint8_t)lba);
+        outb(ATA_LBA_MID, (uint8_t)(lba >> 8));
+        outb(ATA_LBA_HIGH, (uint8_t)(lba >> 16));
+        if (dma) command = write ? CMD_WRITE_DMA : CMD_READ_DMA;
+        else if (write) command = multiple ? CMD_WRITE_MULTIPLE : CMD_WRITE_SECTORS;
+        else command = multiple ? CMD_READ_MULTIPLE : CMD_READ_SECTORS;
     }
+    outb(ATA_COMMAND, command);
+    return true;
 }
 
-void IDEDriver::write_sector(uint32_t lba, uint8_t* buffer) {
-    wait_bsy();
-    MesaOS::Arch::x86::outb(0x1F6, 0xE0 | ((lba >> 24) & 0x0F));
-    MesaOS::Arch::x86::outb(0x1F2, 1);
-    MesaOS::Arch::x86::outb(0x1F3, (uint8_t)lba);
-    MesaOS::Arch::x86::outb(0x1F4, (uint8_t)(lba >> 8));
-    MesaOS::Arch::x86::outb(0x1F5, (uint8_t)(lba >> 16));
-    MesaOS::Arch::x86::outb(0x1F7, 0x30); // WRITE SECTORS
+// Sleeps until the IRQ handler reports completion. The kernel (idle) process
+// must not block, so it halts between interrupts instead.
+bool IDEDriver::wait_dma() {
+    uint32_t flags = save_flags_cli();
+    MesaOS::System::Process* self = MesaOS::System::Scheduler::get_current();
+    uint32_t start = MesaOS::System::Clock::now_ms();
+
+    while (!dma_done) {
+        if (!self || self->pid == 0) {
+            asm volatile("sti; hlt; cli");
+            if (MesaOS::System::Clock::now_ms() - start >= DMA_TIMEOUT_MS) break;
+        } else if (!MesaOS::System::Timer::sleep_on(&dma_wait, DMA_TIMEOUT_MS)) {
+            break;
+        }
+    }
+    bool done = dma_done;
+    restore_flags(flags);
+    return done;
+}
+
+// One DMA command of up to DMA_MAX_SECTORS through the bounce buffer. The
+// buffer is contiguous but not 64KB aligned, so the PRD list is split
+// wherever it would cross a 64KB boundary.
+bool IDEDriver::dma_transfer(uint64_t lba, uint32_t count, bool write) {
+    using namespace MesaOS::Arch::x86;
 
-    wait_bsy();
-    wait_drq();
+    uint32_t addr = (uint32_t)dma_buffer;
+    uint32_t remaining = count * 512;
+    int n = 0;
+    while (remaining > 0) {
+        uint32_t span = 0x10000 - (addr & 0xFFFF);
+        if (span > remaining) span = remaining;
+        prd_table[n * 2] = addr;
+        prd_table[n * 2 + 1] = span & 0xFFFF; // 0 encodes 64KB
+        addr += span;
+        remaining -= span;
+        n++;
+    }
+    prd_table[n * 2 - 1] |= PRD_EOT;
+
+    uint8_t direction = write ? 0 : BM_CMD_READ;
+    outb(bm_base + BM_COMMAND, direction);
+    outl(bm_base + BM_PRDT, (uint32_t)prd_table);
+    outb(bm_base + BM_STATUS, BM_STATUS_ERROR | BM_STATUS_IRQ);
+
+    dma_done = false;
+    if (!issue(lba, count, write, true)) return false;
+    outb(bm_base + BM_COMMAND, direction | BM_CMD_START);
+
+    bool completed = wait_dma();
+    outb(bm_base + BM_COMMAND, direction); // Stop the engine either way
+    if (!completed) return false;
+
+    uint8_t status = inb(ATA_COMMAND);
+    if (dma_status & BM_STATUS_ERROR) return false;
+    return !(status & (STATUS_ERR | STATUS_DF | STATUS_BSY));
+}
 
-    uint16_t* ptr = (uint16_t*)buffer;
-    for (int i = 0; i < 256; i++) {
-        MesaOS::Arch::x86::outw(0x1F0, ptr[i]);
+void IDEDriver::lock() {
+    uint32_t flags = save_flags_cli();
+    while (busy) {
+        MesaOS::System::Process* self = MesaOS::System::Scheduler::get_current();
+        if (!self || self->pid == 0) asm volatile("sti; hlt; cli");
+        else MesaOS::System::Scheduler::block(&lock_wait);
     }
+    busy = true;
+    restore_flags(flags);
+}
+
+void IDEDriver::unlock() {
+    uint32_t flags = save_flags_cli();
+    busy = false;
+    MesaOS::System::Scheduler::wake_one(&lock_wait);
+    restore_flags(flags);
 }
 
+// DMA in bounce-buffer sized commands when available; a command that fails
+// under DMA is retried once through PIO
+bool IDEDriver::read_sectors(uint64_t lba, uint32_t count, uint8_t* buffer) {
+    lock();
+    bool ok = true;
+    while (ok && count > 0) {
+        uint32_t max = bm_base ? DMA_MAX_SECTORS : 256;
+        uint32_t chunk = count > max ? max : count;
+        TRACE(ide_read, (uint32_t)lba, chunk, 0);
+        if (bm_base && dma_transfer(lba, chunk, false)) {
+            memcpy(buffer, dma_buffer, chunk * 512);
+        } else {
+            ok = pio_read(lba, chunk, buffer);
+        }
+        lba += chunk;
+        count -= chunk;
+        buffer += chunk * 512;
+    }
+    unlock();
+    return ok;
+}
+
+bool IDEDriver::write_sectors(uint64_t lba, uint32_t count, const uint8_t* buffer) {
+    lock();
+    bool ok = true;
+    while (ok && count > 0) {
+        uint32_t max = bm_base ? DMA_MAX_SECTORS : 256;
+        uint32_t chunk = count > max ? max : count;
+        TRACE(ide_write, (uint32_t)lba, chunk, 0);
+        bool sent = false;
+        if (bm_base) {
+            memcpy(dma_buffer, buffer, chunk * 512);
+            sent = dma_transfer(lba, chunk, true);
+        }
+        if (!sent) ok = pio_write(lba, chunk, buffer);
+        lba += chunk;
+        count -= chunk;
+        buffer += chunk * 512;
+    }
+    unlock();
+    return ok;
+}
+
+// One command per 256 sectors; within it, one DRQ wait per block of
+// multiple_sectors rather than per sector
+bool IDEDriver::pio_read(uint64_t lba, uint32_t count, uint8_t* buffer) {
+    while (count > 0) {
+        uint32_t chunk = count > 256 ? 256 : count;
+        if (!issue(lba, chunk, false, false)) return false;
+
+        for (uint32_t done = 0; done < chunk; ) {
+            uint32_t block = chunk - done;
+            if (block > multiple_sectors) block = multiple_sectors;
+            if (!wait_drq()) return false;
+            MesaOS::Arch::x86::insw(ATA_DATA, buffer, block * 256);
+            buffer += block * 512;
+            done += block;
+        }
+        lba += chunk;
+        count -= chunk;
+    }
+    return true;
+}
+
+bool IDEDriver::pio_write(uint64_t lba, uint32_t count, const uint8_t* buffer) {
+    while (count > 0) {
+        uint32_t chunk = count > 256 ? 256 : count;
+        if (!issue(lba, chunk, true, false)) return false;
+
+        for (uint32_t done = 0; done < chunk; ) {
+            uint32_t block = chunk - done;
+            if (block > multiple_sectors) block = multiple_sectors;
+            if (!wait_drq()) return false;
+            MesaOS::Arch::x86::outsw(ATA_DATA, buffer, block * 256);
+            buffer += block * 512;
+            done += block;
+        }
+        if (!wait_bsy() || (MesaOS::Arch::x86::inb(ATA_COMMAND) & (STATUS_ERR | STATUS_DF))) return false;
+        lba += chunk;
+        count -= chunk;
+    }
+    return true;
+}
+
+void IDEDriver::read_sector(uint32_t lba, uint8_t* buffer) {
+    read_sectors(lba, 1, buffer);
+}
+
+void IDEDriver::write_sector(uint32_t lba, uint8_t* buffer) {
+    write_sectors(lba, 1, buffer);
+}
+
+bool IDEDriver::is_present() { return present; }
+bool IDEDriver::has_lba48() { return lba48; }
+uint64_t IDEDriver::get_sector_count() { return sector_count; }
+uint32_t IDEDriver::get_multiple_sectors() { return multiple_sectors; }
+const char* IDEDriver::get_model() { return model; }
+bool IDEDriver::dma_enabled() { return bm_base != 0; }
+uint16_t IDEDriver::get_bus_master_base() { return bm_base; }
+
 } // namespace MesaOS::Drivers
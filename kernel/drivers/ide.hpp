@@ -2,18 +2,63 @@
 #define IDE_HPP
 
 #include <stdint.h>
+#include "arch/i386/isr.hpp"
+#include "scheduler.hpp"
 
 namespace MesaOS::Drivers {
 
+// Primary channel master. IDENTIFY at initialize() decides between LBA28 and
+// LBA48 and negotiates the READ/WRITE MULTIPLE block size. When a PCI IDE
+// controller with bus-master support is found, transfers use DMA and the
+// caller sleeps until IRQ14; otherwise they fall back to PIO.
 class IDEDriver {
 public:
     static void initialize();
     static void read_sector(uint32_t lba, uint8_t* buffer);
     static void write_sector(uint32_t lba, uint8_t* buffer);
 
+    // Multi-sector transfers; return false on a device error or timeout
+    static bool read_sectors(uint64_t lba, uint32_t count, uint8_t* buffer);
+    static bool write_sectors(uint64_t lba, uint32_t count, const uint8_t* buffer);
+
+    static bool is_present();
+    static bool has_lba48();
+    static uint64_t get_sector_count();
+    static uint32_t get_multiple_sectors(); // Sectors per DRQ block, 1 without MULTIPLE
+    static const char* get_model();
+    static bool dma_enabled();
+    static uint16_t get_bus_master_base();
+
 private:
-    static void wait_bsy();
-    static void wait_drq();
+    static bool wait_bsy();
+    static bool wait_drq();
+    static bool issue(uint64_t lba, uint32_t count, bool write, bool dma);
+    static bool pio_read(uint64_t lba, uint32_t count, uint8_t* buffer);
+    static bool pio_write(uint64_t lba, uint32_t count, const uint8_t* buffer);
+
+    static void setup_dma(bool drive_supports_dma);
+    static bool dma_transfer(uint64_t lba, uint32_t count, bool write);
+    static bool wait_dma();
+    static void callback(MesaOS::Arch::x86::Registers* regs);
+
+    // One request at a time; DMA waits put the owner to sleep
+    static void lock();
+    static void unlock();
+
+    static bool present;
+    static bool lba48;
+    static uint64_t sector_count;
+    static uint32_t multiple_sectors;
+    static char model[41];
+
+    static uint16_t bm_base;         // Bus-master register block (BAR4), 0 without DMA
+    static uint32_t* prd_table;      // Physical region descriptors, one page
+    static uint8_t* dma_buffer;      // Physically contiguous bounce buffer
+    static volatile bool dma_done;
+    static volatile uint8_t dma_status; // Bus-master status latched by the IRQ
+    static MesaOS::System::WaitQueue dma_wait;
+    static MesaOS::System::WaitQueue lock_wait;
+    static bool busy;
 };
 
 } // namespace MesaOS::Drivers
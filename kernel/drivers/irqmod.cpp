@@ -0,0 +1,83 @@
+#include "irqmod.hpp"
+#include "drivers/pit.hpp"
+#include <string.h>
+
+namespace MesaOS::Drivers {
+
+ModerationDevice IRQModeration::devices[4];
+int IRQModeration::device_count = 0;
+
+ModerationDevice* IRQModeration::register_device(const char* name, int (*poll)(), void (*set_rx_interrupt)(bool)) {
+    if (device_count >= 4) return 0;
+    // The timer drives the polls; chain onto IRQ0 with the first device
+    if (device_count == 0) {
+        MesaOS::Arch::x86::register_irq_handler(IRQ0, IRQModeration::tick, "irqmod");
+    }
+
+    ModerationDevice* dev = &devices[device_count++];
+    memset(dev, 0, sizeof(ModerationDevice));
+    dev->name = name;
+    dev->poll = poll;
+    dev->set_rx_interrupt = set_rx_interrupt;
+    return dev;
+}
+
+bool IRQModeration::configure(const char* name, uint32_t max_packets, uint32_t max_usecs) {
+    for (int i = 0; i < device_count; i++) {
+        ModerationDevice* dev = &devices[i];
+        if (strcmp(dev->name, name) != 0) continue;
+
+        dev->max_packets = max_packets;
+        dev->max_usecs = max_usecs;
+        // Turning moderation off must not leave the RX interrupt masked
+        if (max_usecs == 0 && dev->held) {
+            dev->held = false;
+            dev->set_rx_interrupt(true);
+        }
+        return true;
+    }
+    return false;
+}
+
+// Called from the driver's interrupt handler when the RX status bit is set
+void IRQModeration::rx_interrupt(ModerationDevice* dev) {
+    dev->interrupts++;
+    dev->frames += dev->poll();
+
+    if (dev->max_usecs == 0) return;
+    dev->set_rx_interrupt(false);
+    dev->held = true;
+    dev->hold_ticks = usecs_to_ticks(dev->max_usecs);
+}
+
+void IRQModeration::tick(MesaOS::Arch::x86::Registers* regs) {
+    (void)regs;
+    for (int i = 0; i < device_count; i++) {
+        ModerationDevice* dev = &devices[i];
+        if (!dev->held || --dev->hold_ticks > 0) continue;
+
+        int handled = dev->poll();
+        dev->polls++;
+        dev->frames += handled;
+
+        if (dev->max_packets && (uint32_t)handled >= dev->max_packets) {
+            // Still busy: keep interrupts off and poll again next period
+            dev->hold_ticks = usecs_to_ticks(dev->max_usecs);
+        } else {
+            // Anything that arrived since the poll raises an interrupt on unmask
+            dev->held = false;
+            dev->set_rx_interrupt(true);
+        }
+    }
+}
+
+// Rounded up to whole timer ticks, which bounds the resolution (10ms at 100Hz)
+uint32_t IRQModeration::usecs_to_ticks(uint32_t usecs) {
+    uint32_t ticks = (uint32_t)(((uint64_t)usecs * PIT::get_frequency() + 999999) / 1000000);
+    return ticks ? ticks : 1;
+}
+
+ModerationDevice* IRQModeration::get_devices() { return devices; }
+int IRQModeration::get_device_count() { return device_count; }
+
+} // namespace MesaOS::Drivers
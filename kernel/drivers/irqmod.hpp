@@ -0,0 +1,45 @@
+#ifndef IRQMOD_HPP
+#define IRQMOD_HPP
+
+#include <stdint.h>
+#include "arch/i386/isr.hpp"
+
+namespace MesaOS::Drivers {
+
+// Software RX interrupt moderation for NICs without hardware coalescing.
+// After an RX interrupt the device's RX interrupt is masked for max_usecs and
+// the ring is drained from the timer instead. While each poll still finds at
+// least max_packets frames the device stays in polled mode.
+struct ModerationDevice {
+    const char* name;
+    uint32_t max_packets;          // 0 = leave polled mode after one poll
+    uint32_t max_usecs;            // 0 = moderation off
+    int (*poll)();                 // Drains the RX ring, returns frames handled
+    void (*set_rx_interrupt)(bool enabled);
+
+    bool held;                     // RX interrupt currently masked
+    uint32_t hold_ticks;           // Timer ticks left until the next poll
+    uint32_t interrupts;           // RX interrupts taken
+    uint32_t polls;                // Timer-driven polls
+    uint32_t frames;               // Frames handled by either path
+};
+
+class IRQModeration {
+public:
+    static ModerationDevice* register_device(const char* name, int (*poll)(), void (*set_rx_interrupt)(bool));
+    static bool configure(const char* name, uint32_t max_packets, uint32_t max_usecs);
+    static void rx_interrupt(ModerationDevice* dev);
+    static ModerationDevice* get_devices();
+    static int get_device_count();
+
+private:
+    static void tick(MesaOS::Arch::x86::Registers* regs);
+    static uint32_t usecs_to_ticks(uint32_t usecs);
+
+    static ModerationDevice devices[4];
+    static int device_count;
+};
+
+} // namespace MesaOS::Drivers
+
+#endif
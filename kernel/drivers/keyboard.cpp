@@ -38,7 +38,7 @@ static const char kbd_us_shift[] = {
 };
 
 void Keyboard::initialize() {
-    MesaOS::Arch::x86::register_irq_handler(IRQ1, Keyboard::callback);
+    MesaOS::Arch::x86::register_irq_handler(IRQ1, Keyboard::callback, "keyboard");
 }
 
 void Keyboard::callback(MesaOS::Arch::x86::Registers* regs) {
@@ -101,7 +101,7 @@ void Keyboard::handle_scancode(uint8_t scancode) {
                 }
             } else {
                 // Normal Up = History
-                MesaOS::System::Shell::handle_input(0x11);
+                MesaOS::System::Shell::queue_input(0x11);
             }
         } else if (scancode == 0x50) { // Down
             if (ctrl_pressed) {
@@ -111,7 +111,7 @@ void Keyboard::handle_scancode(uint8_t scancode) {
                 }
             } else {
                 // Normal Down = History
-                MesaOS::System::Shell::handle_input(0x12);
+                MesaOS::System::Shell::queue_input(0x12);
             }
         }
         e0_escape = false;
@@ -150,7 +150,7 @@ void Keyboard::handle_scancode(uint8_t scancode) {
                     current_input_handler(c);
                 } else {
                     // Fallback to shell if no handler set
-                    MesaOS::System::Shell::handle_input(c);
+                    MesaOS::System::Shell::queue_input(c);
                 }
             }
         }
@@ -1,11 +1,14 @@
 #include "pci.hpp"
 #include "arch/i386/io_port.hpp"
 #include "drivers/vga.hpp"
+#include "arch/i386/apic.hpp"
+#include "memory/paging.hpp"
 
 namespace MesaOS::Drivers {
 
 PCIDevice PCIDriver::devices[32];
 int PCIDriver::device_count = 0;
+uint8_t PCIDriver::next_msi_vector = MSI_VECTOR_BASE;
 
 uint16_t PCIDriver::config_read_word(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
     uint32_t address;
@@ -83,6 +86,8 @@ void PCIDriver::scan() {
                     
                     uint16_t int_info = config_read_word(bus, slot, func, 0x3C);
                     devices[device_count].interrupt_line = int_info & 0xFF;
+                    devices[device_count].msi_cap = find_capability(&devices[device_count], PCI_CAP_ID_MSI);
+                    devices[device_count].msix_cap = find_capability(&devices[device_count], PCI_CAP_ID_MSIX);
 
                     device_count++;
                 }
@@ -97,6 +102,116 @@ void PCIDriver::scan() {
     }
 }
 
+// Walks the capability list (status bit 4, head pointer at 0x34)
+uint8_t PCIDriver::find_capability(PCIDevice* dev, uint8_t cap_id) {
+    uint16_t status = config_read_word(dev->bus, dev->device, dev->function, 0x06);
+    if (!(status & 0x10)) return 0;
+
+    uint8_t ptr = config_read_word(dev->bus, dev->device, dev->function, 0x34) & 0xFC;
+    for (int guard = 0; ptr && guard < 48; guard++) {
+        uint16_t header = config_read_word(dev->bus, dev->device, dev->function, ptr);
+        if ((header & 0xFF) == cap_id) return ptr;
+        ptr = (header >> 8) & 0xFC;
+    }
+    return 0;
+}
+
+uint8_t PCIDriver::allocate_msi_vector() {
+    if (next_msi_vector >= MSI_VECTOR_BASE + MSI_VECTOR_COUNT) return 0;
+    return next_msi_vector++;
+}
+
+// Fixed delivery, edge triggered, to this CPU's local APIC
+static uint32_t msi_address() {
+    return 0xFEE00000 | (MesaOS::Arch::x86::LocalAPIC::get_id() << 12);
+}
+
+// With MSI active the device must stop asserting its INTx pin
+static void disable_intx(PCIDevice* dev) {
+    uint16_t command = PCIDriver::config_read_word(dev->bus, dev->device, dev->function, 0x04);
+    PCIDriver::config_write_word(dev->bus, dev->device, dev->function, 0x04, command | (1 << 10));
+}
+
+bool PCIDriver::enable_msi(PCIDevice* dev, uint8_t vector) {
+    uint8_t cap = dev->msi_cap;
+    if (!cap || !MesaOS::Arch::x86::LocalAPIC::is_enabled()) return false;
+
+    uint16_t control = config_read_word(dev->bus, dev->device, dev->function, cap + 2);
+    bool is_64bit = control & (1 << 7);
+
+    config_write_dword(dev->bus, dev->device, dev->function, cap + 4, msi_address());
+    if (is_64bit) {
+        config_write_dword(dev->bus, dev->device, dev->function, cap + 8, 0);
+        config_write_word(dev->bus, dev->device, dev->function, cap + 12, vector);
+    } else {
+        config_write_word(dev->bus, dev->device, dev->function, cap + 8, vector);
+    }
+
+    // One message (MME = 0), then enable
+    control &= ~(0x7 << 4);
+    control |= 1;
+    config_write_word(dev->bus, dev->device, dev->function, cap + 2, control);
+    disable_intx(dev);
+    return true;
+}
+
+bool PCIDriver::enable_msix(PCIDevice* dev, uint8_t vector) {
+    uint8_t cap = dev->msix_cap;
+    if (!cap || !MesaOS::Arch::x86::LocalAPIC::is_enabled()) return false;
+
+    // The vector table lives in a memory BAR: low 3 bits select it, the rest is the offset
+    uint32_t table_info = config_read_dword(dev->bus, dev->device, dev->function, cap + 4);
+    uint8_t bir = table_info & 0x7;
+    if (bir > 5) return false;
+    uint32_t bar = config_read_dword(dev->bus, dev->device, dev->function, 0x10 + bir * 4);
+    if (bar & 0x1) return false; // I/O BAR, not usable for the table
+
+    uint32_t table = (bar & ~0xF) + (table_info & ~0x7);
+    MesaOS::Memory::Paging::map_page(table & ~0xFFF, table & ~0xFFF, false, true);
+
+    // Enable with the function masked while entry 0 is programmed
+    uint16_t control = config_read_word(dev->bus, dev->device, dev->function, cap + 2);
+    config_write_word(dev->bus, dev->device, dev->function, cap + 2, control | (1 << 15) | (1 << 14));
+
+    volatile uint32_t* entry = (volatile uint32_t*)table;
+    entry[0] = msi_address();
+    entry[1] = 0;
+    entry[2] = vector;
+    entry[3] = 0; // Unmask
+
+    control = (control | (1 << 15)) & ~(1 << 14);
+    config_write_word(dev->bus, dev->device, dev->function, cap + 2, control);
+    disable_intx(dev);
+    return true;
+}
+
+bool PCIDriver::msi_enabled(PCIDevice* dev) {
+    if (dev->msix_cap &&
+        (config_read_word(dev->bus, dev->device, dev->function, dev->msix_cap + 2) & (1 << 15))) return true;
+    if (dev->msi_cap &&
+        (config_read_word(dev->bus, dev->device, dev->function, dev->msi_cap + 2) & 1)) return true;
+    return false;
+}
+
+uint8_t PCIDriver::setup_interrupt(PCIDevice* dev, MesaOS::Arch::x86::ISRHandler handler, const char* name) {
+    if ((dev->msix_cap || dev->msi_cap) && MesaOS::Arch::x86::LocalAPIC::is_enabled()) {
+        uint8_t vector = allocate_msi_vector();
+        if (vector) {
+            // Register first: the device may fire as soon as the message is enabled
+            MesaOS::Arch::x86::register_irq_handler(vector, handler, name);
+            if (enable_msix(dev, vector) || enable_msi(dev, vector)) return vector;
+            MesaOS::Arch::x86::unregister_irq_handler(vector, handler);
+        }
+    }
+
+    uint8_t vector = 32 + dev->interrupt_line;
+    MesaOS::Arch::x86::register_irq_handler(vector, handler, name);
+    if (MesaOS::Arch::x86::IOAPIC::is_enabled()) {
+        MesaOS::Arch::x86::IOAPIC::route_irq(dev->interrupt_line, vector, true);
+    }
+    return vector;
+}
+
 PCIDevice* PCIDriver::get_devices() { return devices; }
 int PCIDriver::get_device_count() { return device_count; }
 
@@ -2,6 +2,7 @@
 #define PCI_HPP
 
 #include <stdint.h>
+#include "arch/i386/isr.hpp"
 
 namespace MesaOS::Drivers {
 
@@ -14,8 +15,13 @@ struct PCIDevice {
     uint16_t class_id;
     uint16_t subclass_id;
     uint8_t interrupt_line;
+    uint8_t msi_cap;  // Config offset of the MSI capability, 0 if absent
+    uint8_t msix_cap; // Config offset of the MSI-X capability, 0 if absent
 };
 
+#define PCI_CAP_ID_MSI  0x05
+#define PCI_CAP_ID_MSIX 0x11
+
 class PCIDriver {
 public:
     static void initialize();
@@ -25,12 +31,24 @@ public:
     static void config_write_word(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint16_t value);
     static void config_write_dword(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint32_t value);
     static void enable_bus_mastering(PCIDevice* dev);
+    static uint8_t find_capability(PCIDevice* dev, uint8_t cap_id);
+
+    // Message-signalled interrupts (require the local APIC)
+    static uint8_t allocate_msi_vector();
+    static bool enable_msi(PCIDevice* dev, uint8_t vector);
+    static bool enable_msix(PCIDevice* dev, uint8_t vector);
+    static bool msi_enabled(PCIDevice* dev);
+
+    // Wires up the device's interrupt: MSI-X, then MSI, then the legacy PIC line.
+    // Returns the IDT vector the handler was registered on.
+    static uint8_t setup_interrupt(PCIDevice* dev, MesaOS::Arch::x86::ISRHandler handler, const char* name);
     static PCIDevice* get_devices();
     static int get_device_count();
 
 private:
     static PCIDevice devices[32];
     static int device_count;
+    static uint8_t next_msi_vector;
 };
 
 } // namespace MesaOS::Drivers
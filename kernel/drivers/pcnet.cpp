@@ -3,6 +3,7 @@
 #include "drivers/vga.hpp"
 #include "memory/kheap.hpp"
 #include "net/ethernet.hpp"
+#include "drivers/irqmod.hpp"
 #include <string.h>
 
 namespace MesaOS::Drivers {
@@ -34,6 +35,7 @@ static uint8_t* rx_buffers;
 static uint8_t* tx_buffers;
 static int rx_index = 0;
 static int tx_index = 0;
+static ModerationDevice* moderation = 0;
 
 void PCNet::write_csr(uint32_t index, uint32_t data) {
     MesaOS::Arch::x86::outl(io_base + 0x14, index);
@@ -94,8 +96,10 @@ void PCNet::initialize(PCIDevice* dev) {
     }
     vga.write_string("\n");
 
-    // 4. Register IRQ
-    MesaOS::Arch::x86::register_irq_handler(32 + dev->interrupt_line, PCNet::callback);
+    moderation = IRQModeration::register_device("pcnet", PCNet::receive_packet, PCNet::set_rx_interrupt);
+
+    // 4. Register IRQ (MSI when the device offers it, else the PIC line)
+    PCIDriver::setup_interrupt(dev, PCNet::callback, "pcnet");
     
     // 4b. Enable Bus Mastering (Critical for DMA)
     PCIDriver::enable_bus_mastering(dev);
@@ -164,13 +168,14 @@ void PCNet::callback(MesaOS::Arch::x86::Registers* regs) {
     uint32_t csr0 = read_csr(0);
     
     if (csr0 & 0x0400) { // RINT (Receive Interrupt)
-        receive_packet();
+        if (moderation) IRQModeration::rx_interrupt(moderation);
+        else receive_packet();
     }
     
     write_csr(0, csr0 & ~0x0040); // Ack interrupts
 }
 
-void PCNet::receive_packet() {
+int PCNet::receive_packet() {
     // Loop until we find a buffer owned by the card (0x80000000 set means card owns it)
     // So we process while !(status & 0x80000000)
     int count = 0;
@@ -191,6 +196,13 @@ void PCNet::receive_packet() {
         count++;
         if (count > 32) break; // Safety break
     }
+    return count;
+}
+
+// RINTM (CSR3 bit 10) masks the receive interrupt
+void PCNet::set_rx_interrupt(bool enabled) {
+    uint32_t csr3 = read_csr(3);
+    write_csr(3, enabled ? (csr3 & ~0x0400) : (csr3 | 0x0400));
 }
 
 uint8_t* PCNet::get_mac_address() {
@@ -14,6 +14,7 @@ public:
     static void callback(MesaOS::Arch::x86::Registers* regs);
     static uint8_t* get_mac_address();
     static void poll(); // Manual polling for packets
+    static void set_rx_interrupt(bool enabled);
 
 private:
     static void write_csr(uint32_t index, uint32_t data);
@@ -21,7 +22,7 @@ private:
     static void write_bcr(uint32_t index, uint32_t data);
     static uint32_t read_bcr(uint32_t index);
     
-    static void receive_packet();
+    static int receive_packet();
 };
 
 } // namespace MesaOS::Drivers
@@ -1,14 +1,18 @@
 #include "pit.hpp"
 #include "arch/i386/io_port.hpp"
 #include "scheduler.hpp"
+#include "timer.hpp"
 
 namespace MesaOS::Drivers {
 
 uint32_t PIT::ticks = 0;
+uint32_t PIT::frequency = 0;
 
 void PIT::initialize(uint32_t frequency) {
+    PIT::frequency = frequency;
+
     // Register our timer callback
-    MesaOS::Arch::x86::register_irq_handler(IRQ0, PIT::callback);
+    MesaOS::Arch::x86::register_irq_handler(IRQ0, PIT::callback, "pit");
 
     // The value we send to the PIT is the value to divide its input clock
     // (1193180 Hz) by, to get our required frequency.
@@ -29,10 +33,20 @@ void PIT::initialize(uint32_t frequency) {
 void PIT::callback(MesaOS::Arch::x86::Registers* regs) {
     (void)regs;
     ticks++;
+    MesaOS::System::Timer::tick();
+    MesaOS::System::Scheduler::request_reschedule();
 }
 
 uint32_t PIT::get_ticks() {
     return ticks;
 }
 
+uint32_t PIT::get_frequency() {
+    return frequency;
+}
+
+void PIT::sleep(uint32_t ms) {
+    MesaOS::System::Timer::sleep_ms(ms);
+}
+
 } // namespace MesaOS::Drivers
@@ -10,9 +10,12 @@ public:
     static void initialize(uint32_t frequency);
     static void callback(MesaOS::Arch::x86::Registers* regs);
     static uint32_t get_ticks();
+    static uint32_t get_frequency();
+    static void sleep(uint32_t ms); // Blocks the caller, see Timer::sleep_ms
 
 private:
     static uint32_t ticks;
+    static uint32_t frequency;
 };
 
 } // namespace MesaOS::Drivers
@@ -10,6 +10,7 @@ namespace MesaOS::Drivers {
 uint32_t RTL8139::io_base = 0;
 uint8_t* RTL8139::rx_buffer = 0;
 uint8_t RTL8139::mac_address[6];
+ModerationDevice* RTL8139::moderation = 0;
 
 void RTL8139::initialize(PCIDevice* dev) {
     MesaOS::Drivers::VGADriver vga;
@@ -77,8 +78,13 @@ void RTL8139::initialize(PCIDevice* dev) {
     }
     vga.write_string("\n");
 
-    // Register IRQ handler
-    MesaOS::Arch::x86::register_irq_handler(32 + dev->interrupt_line, RTL8139::callback);
+    moderation = IRQModeration::register_device("rtl8139", RTL8139::receive_packet, RTL8139::set_rx_interrupt);
+
+    // Register IRQ handler (MSI when the device offers it, else the PIC line)
+    uint8_t vector = MesaOS::Drivers::PCIDriver::setup_interrupt(dev, RTL8139::callback, "rtl8139");
+    vga.write_string("RTL8139: IRQ vector ");
+    vga.write_string(itoa(vector, buf, 10));
+    vga.write_string(vector >= 64 ? " (MSI)\n" : "\n");
 }
 
 void RTL8139::callback(MesaOS::Arch::x86::Registers* regs) {
@@ -87,13 +93,20 @@ void RTL8139::callback(MesaOS::Arch::x86::Registers* regs) {
     MesaOS::Arch::x86::outw(io_base + 0x3E, status); 
 
     if (status & 0x01) { // Receive OK
-        receive_packet();
+        if (moderation) IRQModeration::rx_interrupt(moderation);
+        else receive_packet();
     }
 }
 
+// Toggles ROK in the interrupt mask; TOK stays enabled
+void RTL8139::set_rx_interrupt(bool enabled) {
+    MesaOS::Arch::x86::outw(io_base + 0x3C, enabled ? 0x0005 : 0x0004);
+}
+
 static uint32_t rx_offset = 0;
 
-void RTL8139::receive_packet() {
+int RTL8139::receive_packet() {
+    int count = 0;
     while ((MesaOS::Arch::x86::inb(io_base + 0x37) & 0x01) == 0) {
         uint16_t* header = (uint16_t*)(rx_buffer + rx_offset);
         uint16_t status = header[0];
@@ -105,7 +118,7 @@ void RTL8139::receive_packet() {
             MesaOS::Arch::x86::outb(io_base + 0x37, 0x04);
             MesaOS::Arch::x86::outb(io_base + 0x37, 0x0C);
             rx_offset = 0;
-            return;
+            return count;
         }
         
         uint8_t* packet = rx_buffer + rx_offset + 4;
@@ -114,7 +127,9 @@ void RTL8139::receive_packet() {
         rx_offset = (rx_offset + length + 4 + 3) & ~3;
         if (rx_offset >= 8192) rx_offset -= 8192;
         MesaOS::Arch::x86::outw(io_base + 0x38, (uint16_t)rx_offset - 16);
+        count++;
     }
+    return count;
 }
 
 void RTL8139::send_packet(uint8_t* data, uint32_t size) {
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include "drivers/pci.hpp"
 #include "arch/i386/isr.hpp"
+#include "drivers/irqmod.hpp"
 
 namespace MesaOS::Drivers {
 
@@ -11,7 +12,8 @@ class RTL8139 {
 public:
     static void initialize(PCIDevice* dev);
     static void send_packet(uint8_t* data, uint32_t size);
-    static void receive_packet();
+    static int receive_packet();
+    static void set_rx_interrupt(bool enabled);
     static uint8_t* get_mac_address() { return mac_address; }
     
     static void callback(MesaOS::Arch::x86::Registers* regs);
@@ -20,6 +22,7 @@ private:
     static uint32_t io_base;
     static uint8_t* rx_buffer;
     static uint8_t mac_address[6];
+    static ModerationDevice* moderation;
 };
 
 } // namespace MesaOS::Drivers
@@ -0,0 +1,155 @@
+#include "serial.hpp"
+#include "arch/i386/io_port.hpp"
+#include "arch/i386/cpu.hpp"
+#include "shell.hpp"
+
+namespace MesaOS::Drivers {
+
+// 16550 register offsets from the base port
+#define UART_DATA 0 // RBR/THR, divisor low with DLAB
+#define UART_IER  1 // Interrupt enable, divisor high with DLAB
+#define UART_IIR  2 // Interrupt identification (read), FIFO control (write)
+#define UART_LCR  3
+#define UART_MCR  4
+#define UART_LSR  5
+
+#define IER_RX_AVAILABLE 0x01
+#define IER_THR_EMPTY    0x02
+
+#define LSR_DATA_READY 0x01
+#define LSR_THR_EMPTY  0x20
+
+#define UART_FIFO_DEPTH 16
+
+bool Serial::present = false;
+char Serial::tx_buffer[SERIAL_TX_BUFFER_SIZE];
+volatile uint32_t Serial::tx_head = 0;
+volatile uint32_t Serial::tx_tail = 0;
+char Serial::rx_buffer[SERIAL_RX_BUFFER_SIZE];
+volatile uint32_t Serial::rx_head = 0;
+volatile uint32_t Serial::rx_tail = 0;
+bool Serial::thre_armed = false;
+uint32_t Serial::tx_dropped = 0;
+
+using MesaOS::Arch::x86::save_flags_cli;
+using MesaOS::Arch::x86::restore_flags;
+
+bool Serial::initialize(uint32_t baud) {
+    using namespace MesaOS::Arch::x86;
+    uint16_t divisor = (uint16_t)(115200 / (baud ? baud : 115200));
+
+    outb(SERIAL_COM1 + UART_IER, 0x00);
+    outb(SERIAL_COM1 + UART_LCR, 0x80);             // DLAB on
+    outb(SERIAL_COM1 + UART_DATA, divisor & 0xFF);
+    outb(SERIAL_COM1 + UART_IER, divisor >> 8);
+    outb(SERIAL_COM1 + UART_LCR, 0x03);             // 8N1, DLAB off
+    outb(SERIAL_COM1 + UART_IIR, 0xC7);             // FIFO on, cleared, 14-byte RX trigger
+
+    // Loopback self-test; no UART answers 0xFF on an empty bus
+    outb(SERIAL_COM1 + UART_MCR, 0x1E);
+    outb(SERIAL_COM1 + UART_DATA, 0xAE);
+    if (inb(SERIAL_COM1 + UART_DATA) != 0xAE) return false;
+
+    // Normal operation: DTR, RTS and OUT2 (gates the IRQ line on PCs)
+    outb(SERIAL_COM1 + UART_MCR, 0x0B);
+    present = true;
+
+    register_irq_handler(IRQ4, Serial::callback, "serial");
+    outb(SERIAL_COM1 + UART_IER, IER_RX_AVAILABLE);
+    return true;
+}
+
+bool Serial::is_present() { return present; }
+uint32_t Serial::get_tx_dropped() { return tx_dropped; }
+
+// Moves up to one FIFO's worth of queued bytes into the UART and arms the
+// THR-empty interrupt while more remain. Callers hold interrupts off.
+void Serial::kick() {
+    using namespace MesaOS::Arch::x86;
+
+    if (inb(SERIAL_COM1 + UART_LSR) & LSR_THR_EMPTY) {
+        for (int i = 0; i < UART_FIFO_DEPTH && tx_tail != tx_head; i++) {
+            outb(SERIAL_COM1 + UART_DATA, tx_buffer[tx_tail]);
+            tx_tail = (tx_tail + 1) % SERIAL_TX_BUFFER_SIZE;
+        }
+    }
+
+    bool want_thre = tx_tail != tx_head;
+    if (want_thre != thre_armed) {
+        thre_armed = want_thre;
+        outb(SERIAL_COM1 + UART_IER, IER_RX_AVAILABLE | (want_thre ? IER_THR_EMPTY : 0));
+    }
+}
+
+void Serial::tx_enqueue(char c) {
+    uint32_t next = (tx_head + 1) % SERIAL_TX_BUFFER_SIZE;
+    if (next == tx_tail) {
+        // Ring full. With interrupts on, the IRQ would drain it, but we may be
+        // in an interrupt handler or early boot, so poll the UART directly.
+        int spins = 100000;
+        while (next == tx_tail && spins-- > 0) kick();
+        if (next == tx_tail) {
+            tx_dropped++;
+            return;
+        }
+    }
+    tx_buffer[tx_head] = c;
+    tx_head = next;
+}
+
+void Serial::put_char(char c) {
+    if (!present) return;
+    uint32_t flags = save_flags_cli();
+    if (c == '\n') tx_enqueue('\r');
+    tx_enqueue(c);
+    kick();
+    restore_flags(flags);
+}
+
+void Serial::write(const char* str) {
+    if (!present || !str) return;
+    uint32_t flags = save_flags_cli();
+    while (*str) {
+        if (*str == '\n') tx_enqueue('\r');
+        tx_enqueue(*str++);
+    }
+    kick();
+    restore_flags(flags);
+}
+
+void Serial::flush() {
+    if (!present) return;
+    uint32_t flags = save_flags_cli();
+    while (tx_tail != tx_head) kick();
+    restore_flags(flags);
+}
+
+bool Serial::read_char(char* c) {
+    if (rx_tail == rx_head) return false;
+    *c = rx_buffer[rx_tail];
+    rx_tail = (rx_tail + 1) % SERIAL_RX_BUFFER_SIZE;
+    return true;
+}
+
+void Serial::callback(MesaOS::Arch::x86::Registers* regs) {
+    (void)regs;
+    using namespace MesaOS::Arch::x86;
+
+    // Drain the RX FIFO. A terminal sends CR for Enter and DEL for Backspace.
+    while (inb(SERIAL_COM1 + UART_LSR) & LSR_DATA_READY) {
+        char c = (char)inb(SERIAL_COM1 + UART_DATA);
+        if (c == '\r') c = '\n';
+        else if (c == 0x7F) c = '\b';
+
+        uint32_t next = (rx_head + 1) % SERIAL_RX_BUFFER_SIZE;
+        if (next != rx_tail) {
+            rx_buffer[rx_head] = c;
+            rx_head = next;
+        }
+        MesaOS::System::Shell::queue_input(c);
+    }
+
+    kick();
+}
+
+} // namespace MesaOS::Drivers
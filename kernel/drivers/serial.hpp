@@ -0,0 +1,46 @@
+#ifndef SERIAL_HPP
+#define SERIAL_HPP
+
+#include <stdint.h>
+#include "arch/i386/isr.hpp"
+
+namespace MesaOS::Drivers {
+
+#define SERIAL_COM1 0x3F8
+#define SERIAL_TX_BUFFER_SIZE 4096
+#define SERIAL_RX_BUFFER_SIZE 256
+
+// 16550 UART on COM1. Output is queued in a ring and drained by the THR-empty
+// interrupt, up to a FIFO's worth per interrupt; received bytes are fed to
+// the shell so a headless session can be driven from the host.
+class Serial {
+public:
+    static bool initialize(uint32_t baud = 115200);
+    static bool is_present();
+    static void callback(MesaOS::Arch::x86::Registers* regs);
+
+    static void put_char(char c); // Translates \n to \r\n
+    static void write(const char* str);
+    static void flush();          // Spin until everything queued is on the wire
+    static bool read_char(char* c);
+
+    static uint32_t get_tx_dropped();
+
+private:
+    static void kick();
+    static void tx_enqueue(char c);
+
+    static bool present;
+    static char tx_buffer[SERIAL_TX_BUFFER_SIZE];
+    static volatile uint32_t tx_head;
+    static volatile uint32_t tx_tail;
+    static char rx_buffer[SERIAL_RX_BUFFER_SIZE];
+    static volatile uint32_t rx_head;
+    static volatile uint32_t rx_tail;
+    static bool thre_armed;
+    static uint32_t tx_dropped;
+};
+
+} // namespace MesaOS::Drivers
+
+#endif
@@ -1,12 +1,14 @@
 #include "vga.hpp"
 #include "arch/i386/io_port.hpp"
+#include "serial.hpp"
+#include "framebuffer.hpp"
+#include "memory/kheap.hpp"
 #include <string.h>
 
 namespace MesaOS::Drivers {
 
 constexpr size_t VGA_BUFFER_SIZE = 80 * 25;
-constexpr size_t SCROLL_BUFFER_LINES = 200;
-constexpr size_t SCROLL_BUFFER_COLS = 80;
+constexpr uint32_t ALL_ROWS_DIRTY = (1u << 25) - 1;
 
 size_t VGADriver::terminal_row = 0;
 size_t VGADriver::terminal_column = 0;
@@ -18,10 +20,11 @@ uint16_t VGADriver::tty_buffers[4][2000];
 size_t VGADriver::tty_rows[NUM_TTYS] = {0};
 size_t VGADriver::tty_columns[NUM_TTYS] = {0};
 uint8_t VGADriver::tty_colors[NUM_TTYS] = {0x07, 0x07, 0x07, 0x07};
+uint32_t VGADriver::dirty_rows = 0;
+uint16_t VGADriver::cursor_pos = 0xFFFF;
 
-char VGADriver::scroll_buffer[SCROLL_BUFFER_LINES][SCROLL_BUFFER_COLS];
-int VGADriver::scroll_write_line = 0;
-int VGADriver::scroll_view_offset = 0;
+VGADriver::Scrollback VGADriver::scrollback[NUM_TTYS];
+size_t VGADriver::scroll_view_offset = 0;
 bool VGADriver::scroll_mode = false;
 
 void VGADriver::initialize() {
@@ -38,56 +41,86 @@ void VGADriver::initialize() {
                 if (index >= VGA_BUFFER_SIZE) continue; // Bounds check
                 uint16_t entry = vga_entry(' ', vga_entry_color(VGAColor::LIGHT_GREY, VGAColor::BLACK));
                 tty_buffers[t][index] = entry;
-                if (t == 0 && terminal_buffer) terminal_buffer[index] = entry; // Init screen
             }
         }
     }
     current_tty = 0;
     
-    // Initialize scroll buffer
-    memset(scroll_buffer, ' ', sizeof(scroll_buffer));
-    scroll_write_line = 0;
+    // Forget scrollback; the rings stay allocated
+    for (int t = 0; t < NUM_TTYS; ++t) {
+        scrollback[t].head = 0;
+        scrollback[t].count = 0;
+    }
     scroll_view_offset = 0;
     scroll_mode = false;
+
+    dirty_rows = ALL_ROWS_DIRTY;
+    flush();
 }
 
 void VGADriver::switch_tty(int tty_id) {
     if (tty_id < 0 || tty_id >= 4 || tty_id == current_tty) return;
 
-    // Save current state
+    // Leave scrollback view; the offset belongs to the old TTY's history
+    scroll_mode = false;
+    scroll_view_offset = 0;
+
+    // Save current state; the screen contents already live in the shadow
     tty_rows[current_tty] = terminal_row;
     tty_columns[current_tty] = terminal_column;
     tty_colors[current_tty] = terminal_color;
-    memcpy(tty_buffers[current_tty], terminal_buffer, 80 * 25 * 2);
 
     // Load new state
     current_tty = tty_id;
     terminal_row = tty_rows[current_tty];
     terminal_column = tty_columns[current_tty];
     terminal_color = tty_colors[current_tty];
-    memcpy(terminal_buffer, tty_buffers[current_tty], 80 * 25 * 2);
-
-    // Update cursor
-    uint16_t pos = static_cast<uint16_t>(terminal_row * 80 + terminal_column);
-    MesaOS::Arch::x86::outb(0x3D4, 0x0F);
-    MesaOS::Arch::x86::outb(0x3D5, static_cast<uint8_t>(pos & 0xFF));
-    MesaOS::Arch::x86::outb(0x3D4, 0x0E);
-    MesaOS::Arch::x86::outb(0x3D5, static_cast<uint8_t>((pos >> 8) & 0xFF));
+    dirty_rows = ALL_ROWS_DIRTY;
+    flush();
 }
 
 int VGADriver::get_current_tty() { return current_tty; }
 
-void VGADriver::add_line_to_buffer(const char* line) {
-    if (!line) return;
-    size_t line_len = strlen(line);
-    for(size_t i = 0; i < SCROLL_BUFFER_COLS; ++i) {
-        scroll_buffer[scroll_write_line][i] = (i < line_len) ? line[i] : ' ';
+bool VGADriver::set_scrollback_lines(size_t lines) {
+    uint16_t* rings[NUM_TTYS] = {0};
+    if (lines) {
+        for (int t = 0; t < NUM_TTYS; ++t) {
+            rings[t] = static_cast<uint16_t*>(kmalloc(lines * VGA_WIDTH * sizeof(uint16_t)));
+            if (!rings[t]) {
+                for (int i = 0; i < t; ++i) kfree(rings[i]);
+                return false;
+            }
+        }
     }
-    scroll_write_line = (scroll_write_line + 1) % SCROLL_BUFFER_LINES;
+
+    scroll_mode = false;
+    scroll_view_offset = 0;
+    for (int t = 0; t < NUM_TTYS; ++t) {
+        if (scrollback[t].cells) kfree(scrollback[t].cells);
+        scrollback[t].cells = rings[t];
+        scrollback[t].lines = lines;
+        scrollback[t].head = 0;
+        scrollback[t].count = 0;
+    }
+    return true;
+}
+
+size_t VGADriver::get_scrollback_lines() {
+    return scrollback[0].lines;
+}
+
+// O(1): one row copy into the ring, overwriting the oldest line when full
+void VGADriver::push_scrollback(const uint16_t* row) {
+    Scrollback& sb = scrollback[current_tty];
+    if (!sb.lines) return;
+
+    memcpy(sb.cells + sb.head * VGA_WIDTH, row, VGA_WIDTH * sizeof(uint16_t));
+    sb.head = (sb.head + 1) % sb.lines;
+    if (sb.count < sb.lines) sb.count++;
 }
 
 void VGADriver::scroll_up() {
-    if (scroll_view_offset >= static_cast<size_t>(SCROLL_BUFFER_LINES - 25 - 1)) return; // Prevent overflow
+    if (scroll_view_offset >= scrollback[current_tty].count) return; // Oldest line reached
     scroll_view_offset++;
     scroll_mode = true;
     render_view();
@@ -102,7 +135,9 @@ void VGADriver::scroll_up() {
 
         // Print at top-right
         for(size_t i = 0; msg[i] && (68 + i) < VGA_BUFFER_SIZE; ++i) {
-            terminal_buffer[68 + i] = vga_entry(msg[i], vga_entry_color(VGAColor::BLACK, VGAColor::LIGHT_GREY));
+            uint16_t entry = vga_entry(msg[i], vga_entry_color(VGAColor::BLACK, VGAColor::LIGHT_GREY));
+            if (Framebuffer::is_enabled()) Framebuffer::draw_cell(68 + i, 0, entry);
+            else terminal_buffer[68 + i] = entry;
         }
     }
 }
@@ -114,32 +149,32 @@ void VGADriver::scroll_down() {
         scroll_mode = false;
         // Restore live view from TTY buffer
         if (terminal_buffer && current_tty >= 0 && current_tty < 4) {
-            memcpy(terminal_buffer, tty_buffers[current_tty], VGA_BUFFER_SIZE * sizeof(uint16_t));
+            dirty_rows = ALL_ROWS_DIRTY;
+            flush();
         }
     } else {
         render_view();
     }
 }
 
+// The view is a window over history followed by the live shadow. Screen row
+// 'row' shows virtual line count - offset + row, where lines below count are
+// history and the rest are shadow rows.
 void VGADriver::render_view() {
     if (!scroll_mode || !terminal_buffer || current_tty < 0 || current_tty >= 4) return;
 
-    // Calculate starting line in circular buffer
-    int start_line = (scroll_write_line - scroll_view_offset - 25 + SCROLL_BUFFER_LINES) % SCROLL_BUFFER_LINES;
-
-    for(size_t row = 0; row < 25; ++row) {
-        size_t buffer_line = (static_cast<size_t>(start_line) + row) % SCROLL_BUFFER_LINES;
-        for(size_t col = 0; col < 80; ++col) {
-            if (col >= SCROLL_BUFFER_COLS) continue;
-            char c = scroll_buffer[buffer_line][col];
-            if (c == '\0') c = ' ';
-            uint16_t entry = vga_entry(c, terminal_color);
-            size_t index = row * 80 + col;
-            if (index < VGA_BUFFER_SIZE) {
-                terminal_buffer[index] = entry;
-                tty_buffers[current_tty][index] = entry;
-            }
+    Scrollback& sb = scrollback[current_tty];
+    for (size_t row = 0; row < VGA_HEIGHT; ++row) {
+        size_t line = sb.count - scroll_view_offset + row;
+        const uint16_t* src;
+        if (line < sb.count) {
+            size_t oldest = (sb.head + sb.lines - sb.count) % sb.lines;
+            src = sb.cells + ((oldest + line) % sb.lines) * VGA_WIDTH;
+        } else {
+            src = tty_buffers[current_tty] + (line - sb.count) * VGA_WIDTH;
         }
+        // Screen only: the shadow keeps the live view for scroll_down()
+        present_row(row, src);
     }
 }
 
@@ -151,39 +186,76 @@ void VGADriver::put_entry_at(char c, uint8_t color, size_t x, size_t y) {
     if (!terminal_buffer || x >= 80 || y >= 25 || current_tty < 0 || current_tty >= 4) return;
     const size_t index = y * 80 + x;
     if (index >= VGA_BUFFER_SIZE) return;
-    uint16_t entry = vga_entry(c, color);
-    terminal_buffer[index] = entry;
-    // Mirror to backing buffer
-    tty_buffers[current_tty][index] = entry;
+    // Shadow only; the cell reaches the screen on the next flush()
+    tty_buffers[current_tty][index] = vga_entry(c, color);
+    dirty_rows |= 1u << y;
 }
 
-void VGADriver::update_cursor() {
-    if (terminal_row >= 25 || terminal_column >= 80) return;
-    uint16_t pos = static_cast<uint16_t>(terminal_row * 80 + terminal_column);
+void VGADriver::set_cursor(uint16_t pos) {
+    if (pos == cursor_pos) return; // Four port writes saved
+    cursor_pos = pos;
+    if (Framebuffer::is_enabled()) {
+        Framebuffer::set_cursor(pos);
+        return;
+    }
     MesaOS::Arch::x86::outb(0x3D4, 0x0F);
     MesaOS::Arch::x86::outb(0x3D5, static_cast<uint8_t>(pos & 0xFF));
     MesaOS::Arch::x86::outb(0x3D4, 0x0E);
     MesaOS::Arch::x86::outb(0x3D5, static_cast<uint8_t>((pos >> 8) & 0xFF));
 }
 
+void VGADriver::update_cursor() {
+    if (terminal_row >= 25 || terminal_column >= 80) return;
+    set_cursor(static_cast<uint16_t>(terminal_row * 80 + terminal_column));
+}
+
+void VGADriver::present_row(size_t row, const uint16_t* cells) {
+    if (Framebuffer::is_enabled()) Framebuffer::draw_row(row, cells);
+    else memcpy(terminal_buffer + row * VGA_WIDTH, cells, VGA_WIDTH * sizeof(uint16_t));
+}
+
+void VGADriver::redraw() {
+    cursor_pos = 0xFFFF;
+    dirty_rows = ALL_ROWS_DIRTY;
+    flush();
+}
+
+void VGADriver::flush() {
+    // While scrolled back the screen shows history; scroll_down() repaints
+    if (!terminal_buffer || scroll_mode) return;
+
+    uint16_t* shadow = tty_buffers[current_tty];
+    for (size_t row = 0; dirty_rows && row < 25; ++row) {
+        if (!(dirty_rows & (1u << row))) continue;
+        present_row(row, shadow + row * 80);
+        dirty_rows &= ~(1u << row);
+    }
+
+    if (terminal_row < 25 && terminal_column < 80) {
+        set_cursor(static_cast<uint16_t>(terminal_row * 80 + terminal_column));
+    }
+}
+
 void VGADriver::scroll() {
-    if (!terminal_buffer || terminal_row < 25) return;
+    if (terminal_row < 25) return;
 
     uint8_t blank = vga_entry_color(VGAColor::LIGHT_GREY, VGAColor::BLACK);
     uint16_t blank_entry = vga_entry(' ', blank);
+    uint16_t* shadow = tty_buffers[current_tty];
 
-    // Scroll up by one line
-    size_t bytes_to_move = (25 - 1) * 80 * sizeof(uint16_t);
-    if (bytes_to_move > 0) {
-        memmove(terminal_buffer, terminal_buffer + 80, bytes_to_move);
-    }
+    // The top row leaves the screen for the scrollback ring
+    push_scrollback(shadow);
+
+    // Scroll up by one line in RAM; reading VGA memory back is very slow
+    memmove(shadow, shadow + 80, (25 - 1) * 80 * sizeof(uint16_t));
 
     // Clear the last line
     for (size_t i = (25 - 1) * 80; i < VGA_BUFFER_SIZE; ++i) {
-        terminal_buffer[i] = blank_entry;
+        shadow[i] = blank_entry;
     }
 
     terminal_row = 25 - 1;
+    dirty_rows = ALL_ROWS_DIRTY;
 }
 
 // ANSI escape sequence state
@@ -191,22 +263,14 @@ static bool in_escape = false;
 static char escape_buffer[16];
 static int escape_index = 0;
 
+// Everything written to the console is mirrored to COM1
 void VGADriver::put_char(char c) {
-    if (scroll_mode) {
-        // Still capture newlines to buffer for when they return
-        if (c == '\n') {
-            char line[SCROLL_BUFFER_COLS + 1] = {0};
-            for(size_t i = 0; i < 80 && i < SCROLL_BUFFER_COLS; ++i) {
-                size_t index = terminal_row * 80 + i;
-                if (index < VGA_BUFFER_SIZE && terminal_buffer) {
-                    line[i] = static_cast<char>(terminal_buffer[index] & 0xFF);
-                }
-            }
-            add_line_to_buffer(line);
-        }
-        return; // Don't render anything while scrolling
-    }
+    Serial::put_char(c);
+    render_char(c);
+    flush();
+}
 
+void VGADriver::render_char(char c) {
     // ANSI escape sequence handling
     if (c == '\x1B') { // ESC
         in_escape = true;
@@ -234,23 +298,14 @@ void VGADriver::put_char(char c) {
     }
 
     if (c == '\n') {
-        // Capture current line to scroll buffer
-        char line[SCROLL_BUFFER_COLS + 1] = {0};
-        for(size_t i = 0; i < 80 && i < SCROLL_BUFFER_COLS; ++i) {
-            size_t index = terminal_row * 80 + i;
-            if (index < VGA_BUFFER_SIZE && terminal_buffer) {
-                line[i] = static_cast<char>(terminal_buffer[index] & 0xFF);
-            }
-        }
-        add_line_to_buffer(line);
-
         terminal_column = 0;
         ++terminal_row;
 
-        // Exit scroll mode on new output
+        // Exit scroll mode on new output; flush() repaints the live view
         if (scroll_mode) {
             scroll_mode = false;
             scroll_view_offset = 0;
+            dirty_rows = ALL_ROWS_DIRTY;
         }
     } else if (c == '\b') {
         if (terminal_column > 0) {
@@ -266,7 +321,6 @@ void VGADriver::put_char(char c) {
     }
 
     scroll();
-    update_cursor();
 }
 
 // Process ANSI escape sequences for color support
@@ -348,15 +402,19 @@ void VGADriver::set_color_from_ansi(int code) {
 void VGADriver::write(const char* data, size_t size) {
     if (!data) return;
     for (size_t i = 0; i < size; ++i) {
-        put_char(data[i]);
+        Serial::put_char(data[i]);
+        render_char(data[i]);
     }
+    flush();
 }
 
 void VGADriver::write_string(const char* data) {
     if (!data) return;
+    Serial::write(data);
     while (*data) {
-        put_char(*data++);
+        render_char(*data++);
     }
+    flush();
 }
 
 } // namespace MesaOS::Drivers
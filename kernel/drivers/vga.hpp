@@ -48,33 +48,53 @@ public:
     void write(const char* data, size_t size);
     void write_string(const char* data);
     void update_cursor();
+    static void flush(); // Copy dirty rows of the shadow to the screen, then move the cursor
+    static void redraw(); // Repaint everything, e.g. after switching to the framebuffer
     void scroll();
     static void scroll_up();
     static void scroll_down();
-    static void add_line_to_buffer(const char* line);
     static void render_view();
 
+    // Resizes every TTY's scrollback ring (allocated from the kernel heap, so
+    // call after KHeap is up). Returns false and keeps the old rings on OOM.
+    static const size_t DEFAULT_SCROLLBACK_LINES = 256;
+    static bool set_scrollback_lines(size_t lines);
+    static size_t get_scrollback_lines();
+
     // ANSI escape sequence support
     static void process_ansi_sequence(const char* sequence, int length);
     static void set_color_from_ansi(int code);
 
 private:
+    void render_char(char c); // put_char() without the serial mirror or flush
+    static void set_cursor(uint16_t pos);
+    static void present_row(size_t row, const uint16_t* cells); // Text memory or framebuffer
+
     static size_t terminal_row;
     static size_t terminal_column;
     static uint8_t terminal_color;
-    static uint16_t* terminal_buffer; // Always points to 0xB8000
+    static uint16_t* terminal_buffer; // Always points to 0xB8000; unused on a framebuffer
     
-    // TTY State
+    // TTY State. tty_buffers[current_tty] is the shadow of the live screen:
+    // output lands there and flush() copies only the rows marked dirty.
     static int current_tty;
     static uint16_t tty_buffers[NUM_TTYS][VGA_WIDTH * VGA_HEIGHT];
+    static uint32_t dirty_rows; // Bit per screen row
+    static uint16_t cursor_pos; // Last position written to the CRTC
+    static void push_scrollback(const uint16_t* row);
     static size_t tty_rows[NUM_TTYS];
     static size_t tty_columns[NUM_TTYS];
     static uint8_t tty_colors[NUM_TTYS];
     
-    // Scroll Buffer
-    static char scroll_buffer[200][80];
-    static int scroll_write_line;
-    static int scroll_view_offset; // 0 = live view, >0 = scrolled back
+    // Scrollback: rows that scrolled off the top, with their attributes
+    struct Scrollback {
+        uint16_t* cells; // lines * VGA_WIDTH cells
+        size_t lines;    // Capacity
+        size_t head;     // Next line to overwrite
+        size_t count;    // Lines held
+    };
+    static Scrollback scrollback[NUM_TTYS];
+    static size_t scroll_view_offset; // 0 = live view, >0 = lines scrolled back
     static bool scroll_mode;
 };
 
@@ -0,0 +1,348 @@
+#include "virtio_blk.hpp"
+#include "arch/i386/io_port.hpp"
+#include "arch/i386/cpu.hpp"
+#include "drivers/block.hpp"
+#include "memory/pmm.hpp"
+#include "memory/kheap.hpp"
+#include "timer.hpp"
+#include "clock.hpp"
+#include "trace.hpp"
+#include <string.h>
+
+namespace MesaOS::Drivers {
+
+// Legacy virtio PCI registers, relative to BAR0
+#define VIRTIO_DEVICE_FEATURES 0x00
+#define VIRTIO_GUEST_FEATURES  0x04
+#define VIRTIO_QUEUE_PFN       0x08
+#define VIRTIO_QUEUE_SIZE      0x0C
+#define VIRTIO_QUEUE_SELECT    0x0E
+#define VIRTIO_QUEUE_NOTIFY    0x10
+#define VIRTIO_DEVICE_STATUS   0x12
+#define VIRTIO_ISR_STATUS      0x13
+#define VIRTIO_MSI_CONFIG      0x14 // Only while MSI-X is enabled
+#define VIRTIO_MSI_QUEUE       0x16
+#define VIRTIO_MSI_NO_VECTOR   0xFFFF
+
+#define STATUS_ACKNOWLEDGE 0x01
+#define STATUS_DRIVER      0x02
+#define STATUS_DRIVER_OK   0x04
+#define STATUS_FAILED      0x80
+
+#define VIRTIO_RING_F_INDIRECT_DESC (1u << 28)
+
+#define VIRTQ_DESC_F_NEXT     1
+#define VIRTQ_DESC_F_WRITE    2 // Device writes this buffer
+#define VIRTQ_DESC_F_INDIRECT 4
+#define VIRTQ_USED_F_NO_NOTIFY 1
+
+#define VIRTIO_BLK_T_IN  0
+#define VIRTIO_BLK_T_OUT 1
+
+#define IDENTITY_LIMIT    0x4000000 // Paging identity-maps the first 64MB
+#define VIRTIO_TIMEOUT_MS 2000
+
+DEFINE_TRACEPOINT(virtio_blk_submit, "lba=%u count=%u slot=%u");
+
+using MesaOS::Arch::x86::save_flags_cli;
+using MesaOS::Arch::x86::restore_flags;
+
+static inline uint32_t align_page(uint32_t size) {
+    return (size + 4095) & ~4095u;
+}
+
+uint16_t VirtioBlkDriver::io_base = 0;
+uint16_t VirtioBlkDriver::device_config = 0x14;
+bool VirtioBlkDriver::present = false;
+bool VirtioBlkDriver::indirect = false;
+uint64_t VirtioBlkDriver::sector_count = 0;
+uint32_t VirtioBlkDriver::notifications = 0;
+uint16_t VirtioBlkDriver::queue_size = 0;
+VirtqDesc* VirtioBlkDriver::desc = 0;
+VirtqAvail* VirtioBlkDriver::avail = 0;
+VirtqUsed* VirtioBlkDriver::used = 0;
+uint16_t VirtioBlkDriver::last_used = 0;
+VirtioBlkRequest* VirtioBlkDriver::requests = 0;
+uint32_t VirtioBlkDriver::max_requests = 0;
+uint32_t VirtioBlkDriver::slots_busy = 0;
+volatile uint32_t VirtioBlkDriver::slots_done = 0;
+volatile uint32_t VirtioBlkDriver::slots_failed = 0;
+volatile uint32_t VirtioBlkDriver::slots_orphaned = 0;
+MesaOS::System::WaitQueue VirtioBlkDriver::slot_wait = { 0 };
+MesaOS::System::WaitQueue VirtioBlkDriver::done_wait = { 0 };
+
+bool VirtioBlkDriver::initialize(PCIDevice* dev) {
+    using namespace MesaOS::Arch::x86;
+    present = false;
+
+    uint32_t bar0 = PCIDriver::config_read_dword(dev->bus, dev->device, dev->function, 0x10);
+    if (!(bar0 & 0x1)) return false; // Legacy interface is I/O only
+    io_base = (uint16_t)(bar0 & ~0x3);
+
+    uint16_t command = PCIDriver::config_read_word(dev->bus, dev->device, dev->function, 0x04);
+    command |= 0x0005; // I/O space and bus master
+    PCIDriver::config_write_word(dev->bus, dev->device, dev->function, 0x04, command);
+
+    outb(io_base + VIRTIO_DEVICE_STATUS, 0); // Reset
+    outb(io_base + VIRTIO_DEVICE_STATUS, STATUS_ACKNOWLEDGE);
+    outb(io_base + VIRTIO_DEVICE_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+
+    uint32_t features = inl(io_base + VIRTIO_DEVICE_FEATURES);
+    indirect = features & VIRTIO_RING_F_INDIRECT_DESC;
+    outl(io_base + VIRTIO_GUEST_FEATURES, features & VIRTIO_RING_F_INDIRECT_DESC);
+
+    // Legacy layout: descriptors and avail ring, then the used ring on the
+    // next page boundary, all physically contiguous
+    outw(io_base + VIRTIO_QUEUE_SELECT, 0);
+    queue_size = inw(io_base + VIRTIO_QUEUE_SIZE);
+    if (queue_size == 0) {
+        outb(io_base + VIRTIO_DEVICE_STATUS, STATUS_FAILED);
+        return false;
+    }
+    uint32_t used_offset = align_page(sizeof(VirtqDesc) * queue_size + 6 + 2 * queue_size);
+    uint32_t ring_bytes = used_offset + align_page(6 + sizeof(VirtqUsedElem) * queue_size);
+    uint8_t* ring = (uint8_t*)MesaOS::Memory::PMM::allocate_blocks(ring_bytes / 4096);
+
+    max_requests = indirect ? queue_size : queue_size / 3;
+    if (max_requests > VIRTIO_BLK_MAX_REQUESTS) max_requests = VIRTIO_BLK_MAX_REQUESTS;
+    uint32_t request_bytes = align_page(max_requests * sizeof(VirtioBlkRequest));
+    requests = (VirtioBlkRequest*)MesaOS::Memory::PMM::allocate_blocks(request_bytes / 4096);
+
+    if (!ring || !requests || max_requests == 0) {
+        outb(io_base + VIRTIO_DEVICE_STATUS, STATUS_FAILED);
+        return false;
+    }
+    memset(ring, 0, ring_bytes);
+    memset(requests, 0, request_bytes);
+    desc = (VirtqDesc*)ring;
+    avail = (VirtqAvail*)(ring + sizeof(VirtqDesc) * queue_size);
+    used = (VirtqUsed*)(ring + used_offset);
+    last_used = 0;
+    outl(io_base + VIRTIO_QUEUE_PFN, (uint32_t)ring >> 12);
+
+    // Capacity in 512-byte sectors; read before MSI-X moves the config space
+    sector_count = (uint64_t)inl(io_base + device_config) |
+                   (uint64_t)inl(io_base + device_config + 4) << 32;
+
+    PCIDriver::setup_interrupt(dev, VirtioBlkDriver::callback, "virtio-blk");
+    if (dev->msix_cap &&
+        (PCIDriver::config_read_word(dev->bus, dev->device, dev->function, dev->msix_cap + 2) & (1 << 15))) {
+        // With MSI-X the queue needs its table entry (0) assigned explicitly
+        device_config = 0x18;
+        outw(io_base + VIRTIO_MSI_CONFIG, VIRTIO_MSI_NO_VECTOR);
+        outw(io_base + VIRTIO_QUEUE_SELECT, 0);
+        outw(io_base + VIRTIO_MSI_QUEUE, 0);
+    }
+
+    outb(io_base + VIRTIO_DEVICE_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+    present = true;
+    BlockLayer::register_device("vda", sector_count, read_sectors, write_sectors);
+    return true;
+}
+
+void VirtioBlkDriver::callback(MesaOS::Arch::x86::Registers* regs) {
+    (void)regs;
+    if (!present) return;
+
+    // Reading ISR deasserts the legacy INTx line
+    MesaOS::Arch::x86::inb(io_base + VIRTIO_ISR_STATUS);
+
+    volatile uint16_t* used_idx = &used->idx;
+    while (last_used != *used_idx) {
+        asm volatile("" : : : "memory");
+        uint32_t id = used->ring[last_used % queue_size].id;
+        uint32_t slot = indirect ? id : id / 3;
+        uint32_t bit = 1u << slot;
+        last_used++;
+
+        if (slots_orphaned & bit) {
+            // Its submitter gave up; the slot is only now safe to reuse
+            slots_orphaned &= ~bit;
+            slots_busy &= ~bit;
+            MesaOS::System::Scheduler::wake_all(&slot_wait);
+            continue;
+        }
+        if (requests[slot].status != 0) slots_failed |= bit;
+        slots_done |= bit;
+    }
+    MesaOS::System::Scheduler::wake_all(&done_wait);
+}
+
+int VirtioBlkDriver::alloc_slot(bool wait) {
+    uint32_t flags = save_flags_cli();
+    uint32_t usable = max_requests == 32 ? 0xFFFFFFFF : (1u << max_requests) - 1;
+    uint32_t start = MesaOS::System::Clock::now_ms();
+    int slot = -1;
+
+    for (;;) {
+        uint32_t free = usable & ~slots_busy;
+        if (free) {
+            slot = __builtin_ctz(free);
+            slots_busy |= 1u << slot;
+            break;
+        }
+        if (!wait) break;
+
+        MesaOS::System::Process* self = MesaOS::System::Scheduler::get_current();
+        if (!self || self->pid == 0) {
+            asm volatile("sti; hlt; cli");
+            if (MesaOS::System::Clock::now_ms() - start >= VIRTIO_TIMEOUT_MS) break;
+        } else {
+            MesaOS::System::Scheduler::block(&slot_wait);
+        }
+    }
+    restore_flags(flags);
+    return slot;
+}
+
+// Header, data and status as an indirect table behind one ring descriptor,
+// or as a chain of three ring descriptors without INDIRECT_DESC. Published
+// in the avail ring; the device is not notified until kick().
+void VirtioBlkDriver::queue_request(int slot, uint64_t lba, uint32_t count, uint8_t* buffer, bool write) {
+    VirtioBlkRequest* req = &requests[slot];
+    req->type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    req->reserved = 0;
+    req->sector = lba;
+    req->status = 0xFF;
+
+    uint16_t head = indirect ? slot : slot * 3;
+    VirtqDesc* chain = indirect ? req->table : &desc[head];
+    uint16_t base = indirect ? 0 : head;
+
+    chain[0].addr = (uint32_t)&req->type;
+    chain[0].len = 16;
+    chain[0].flags = VIRTQ_DESC_F_NEXT;
+    chain[0].next = base + 1;
+    chain[1].addr = (uint32_t)buffer;
+    chain[1].len = count * 512;
+    chain[1].flags = VIRTQ_DESC_F_NEXT | (write ? 0 : VIRTQ_DESC_F_WRITE);
+    chain[1].next = base + 2;
+    chain[2].addr = (uint32_t)&req->status;
+    chain[2].len = 1;
+    chain[2].flags = VIRTQ_DESC_F_WRITE;
+    chain[2].next = 0;
+
+    if (indirect) {
+        desc[head].addr = (uint32_t)req->table;
+        desc[head].len = sizeof(req->table);
+        desc[head].flags = VIRTQ_DESC_F_INDIRECT;
+        desc[head].next = 0;
+    }
+
+    TRACE(virtio_blk_submit, (uint32_t)lba, count, slot);
+
+    uint32_t bit = 1u << slot;
+    uint32_t flags = save_flags_cli();
+    slots_done &= ~bit;
+    slots_failed &= ~bit;
+    avail->ring[avail->idx % queue_size] = head;
+    asm volatile("" : : : "memory"); // Entry before index
+    avail->idx++;
+    restore_flags(flags);
+}
+
+// One notify for everything queued since the last kick, skipped when the
+// device says it is already processing the ring
+void VirtioBlkDriver::kick() {
+    // avail->idx must be visible before used->flags is read, or both sides
+    // can see stale values and the notify is lost
+    MesaOS::Arch::x86::memory_barrier();
+    if (*(volatile uint16_t*)&used->flags & VIRTQ_USED_F_NO_NOTIFY) return;
+    MesaOS::Arch::x86::outw(io_base + VIRTIO_QUEUE_NOTIFY, 0);
+    notifications++;
+}
+
+// Sleeps until every slot in mask has completed. Slots the device has not
+// answered by the timeout stay allocated until it does.
+bool VirtioBlkDriver::wait_slots(uint32_t mask) {
+    uint32_t flags = save_flags_cli();
+    MesaOS::System::Process* self = MesaOS::System::Scheduler::get_current();
+    uint32_t start = MesaOS::System::Clock::now_ms();
+
+    while ((slots_done & mask) != mask) {
+        bool timed_out;
+        if (!self || self->pid == 0) {
+            asm volatile("sti; hlt; cli");
+            timed_out = MesaOS::System::Clock::now_ms() - start >= VIRTIO_TIMEOUT_MS;
+        } else {
+            timed_out = !MesaOS::System::Timer::sleep_on(&done_wait, VIRTIO_TIMEOUT_MS);
+        }
+        if (timed_out) break;
+    }
+
+    uint32_t finished = slots_done & mask;
+    bool ok = finished == mask && !(slots_failed & mask);
+    slots_orphaned |= mask & ~finished;
+    slots_busy &= ~finished;
+    MesaOS::System::Scheduler::wake_all(&slot_wait);
+    restore_flags(flags);
+    return ok;
+}
+
+// Identity-mapped buffers are queued directly, as many requests as there
+// are free slots, then kicked once. Others go through a heap bounce buffer
+// one request at a time.
+bool VirtioBlkDriver::transfer(uint64_t lba, uint32_t count, uint8_t* buffer, bool write) {
+    if (!present) return false;
+    if (lba + count > sector_count) return false;
+
+    uint32_t addr = (uint32_t)buffer;
+    if (addr + count * 512 <= IDENTITY_LIMIT) {
+        while (count > 0) {
+            uint32_t mask = 0;
+            while (count > 0) {
+                int slot = alloc_slot(mask == 0);
+                if (slot < 0) break;
+                uint32_t chunk = count > VIRTIO_BLK_MAX_SECTORS ? VIRTIO_BLK_MAX_SECTORS : count;
+                queue_request(slot, lba, chunk, buffer, write);
+                mask |= 1u << slot;
+                lba += chunk;
+                count -= chunk;
+                buffer += chunk * 512;
+            }
+            if (!mask) return false;
+            kick();
+            if (!wait_slots(mask)) return false;
+        }
+        return true;
+    }
+
+    uint8_t* bounce = (uint8_t*)kmalloc(VIRTIO_BLK_MAX_SECTORS * 512);
+    if (!bounce) return false;
+    bool ok = true;
+    while (ok && count > 0) {
+        uint32_t chunk = count > VIRTIO_BLK_MAX_SECTORS ? VIRTIO_BLK_MAX_SECTORS : count;
+        int slot = alloc_slot(true);
+        if (slot < 0) {
+            ok = false;
+            break;
+        }
+        if (write) memcpy(bounce, buffer, chunk * 512);
+        queue_request(slot, lba, chunk, bounce, write);
+        kick();
+        ok = wait_slots(1u << slot);
+        if (!ok && (slots_orphaned & (1u << slot))) return false; // Device may still write it
+        if (ok && !write) memcpy(buffer, bounce, chunk * 512);
+        lba += chunk;
+        count -= chunk;
+        buffer += chunk * 512;
+    }
+    kfree(bounce);
+    return ok;
+}
+
+bool VirtioBlkDriver::read_sectors(uint64_t lba, uint32_t count, uint8_t* buffer) {
+    return transfer(lba, count, buffer, false);
+}
+
+bool VirtioBlkDriver::write_sectors(uint64_t lba, uint32_t count, const uint8_t* buffer) {
+    return transfer(lba, count, (uint8_t*)buffer, true);
+}
+
+bool VirtioBlkDriver::is_present() { return present; }
+uint64_t VirtioBlkDriver::get_sector_count() { return sector_count; }
+uint16_t VirtioBlkDriver::get_queue_size() { return queue_size; }
+bool VirtioBlkDriver::has_indirect() { return indirect; }
+uint32_t VirtioBlkDriver::get_notifications() { return notifications; }
+
+} // namespace MesaOS::Drivers
@@ -0,0 +1,101 @@
+#ifndef VIRTIO_BLK_HPP
+#define VIRTIO_BLK_HPP
+
+#include <stdint.h>
+#include "drivers/pci.hpp"
+#include "arch/i386/isr.hpp"
+#include "scheduler.hpp"
+
+namespace MesaOS::Drivers {
+
+// Legacy (0.9.5) virtio-blk over the PCI I/O BAR with one split virtqueue.
+// Each request occupies a single ring descriptor pointing at an indirect
+// table of header/data/status when the device offers INDIRECT_DESC, else a
+// three-descriptor chain. A transfer queues all of its requests before one
+// notify. Same block interface as IDEDriver.
+#define VIRTIO_BLK_MAX_REQUESTS 32
+#define VIRTIO_BLK_MAX_SECTORS  256 // Per request: 128KB
+
+struct VirtqDesc {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed));
+
+struct VirtqAvail {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+};
+
+struct VirtqUsedElem {
+    uint32_t id;
+    uint32_t len;
+};
+
+struct VirtqUsed {
+    uint16_t flags;
+    uint16_t idx;
+    VirtqUsedElem ring[];
+};
+
+// Per-request memory the device reads and writes besides the data buffer
+struct VirtioBlkRequest {
+    VirtqDesc table[3];  // Indirect descriptor table
+    uint32_t type;       // virtio_blk_outhdr
+    uint32_t reserved;
+    uint64_t sector;
+    volatile uint8_t status;
+    uint8_t pad[63];     // One 128-byte block per request
+} __attribute__((packed));
+
+class VirtioBlkDriver {
+public:
+    static bool initialize(PCIDevice* dev);
+
+    // Return false on a device error or timeout
+    static bool read_sectors(uint64_t lba, uint32_t count, uint8_t* buffer);
+    static bool write_sectors(uint64_t lba, uint32_t count, const uint8_t* buffer);
+
+    static bool is_present();
+    static uint64_t get_sector_count();
+    static uint16_t get_queue_size();
+    static bool has_indirect();
+    static uint32_t get_notifications(); // Queue notifies sent, for batching stats
+
+    static void callback(MesaOS::Arch::x86::Registers* regs);
+
+private:
+    static int alloc_slot(bool wait);
+    static void queue_request(int slot, uint64_t lba, uint32_t count, uint8_t* buffer, bool write);
+    static void kick();
+    static bool wait_slots(uint32_t mask);
+    static bool transfer(uint64_t lba, uint32_t count, uint8_t* buffer, bool write);
+
+    static uint16_t io_base;
+    static uint16_t device_config; // 0x14, or 0x18 once MSI-X is on
+    static bool present;
+    static bool indirect;
+    static uint64_t sector_count;
+    static uint32_t notifications;
+
+    static uint16_t queue_size;
+    static VirtqDesc* desc;
+    static VirtqAvail* avail;
+    static VirtqUsed* used;
+    static uint16_t last_used;
+    static VirtioBlkRequest* requests;
+    static uint32_t max_requests;
+
+    static uint32_t slots_busy;
+    static volatile uint32_t slots_done;
+    static volatile uint32_t slots_failed;
+    static volatile uint32_t slots_orphaned; // Timed out; freed when the device answers
+    static MesaOS::System::WaitQueue slot_wait;
+    static MesaOS::System::WaitQueue done_wait;
+};
+
+} // namespace MesaOS::Drivers
+
+#endif
@@ -0,0 +1,355 @@
+#include "bcache.hpp"
+#include "arch/i386/cpu.hpp"
+#include "memory/pmm.hpp"
+#include "timer.hpp"
+#include "clock.hpp"
+#include <string.h>
+
+namespace MesaOS::FS {
+
+using MesaOS::Drivers::BlockDevice;
+using MesaOS::Drivers::BlockLayer;
+using MesaOS::Drivers::Bio;
+
+#define FLUSH_INTERVAL_MS 1000 // kflushd wakeup period
+#define DIRTY_EXPIRE_MS   3000 // Age at which a dirty block is written back
+
+using MesaOS::Arch::x86::save_flags_cli;
+using MesaOS::Arch::x86::restore_flags;
+
+static inline uint32_t hash_index(BlockDevice* dev, uint64_t block) {
+    return ((uint32_t)dev >> 4 ^ (uint32_t)block) % BCACHE_HASH_SIZE;
+}
+
+Buffer BufferCache::buffers[BCACHE_BUFFERS];
+Buffer* BufferCache::hash[BCACHE_HASH_SIZE];
+uint32_t BufferCache::buffer_count = 0;
+uint32_t BufferCache::clock_hand = 0;
+BufferCacheStats BufferCache::stats;
+bool BufferCache::flusher_running = false;
+MesaOS::System::WaitQueue BufferCache::io_wait = { 0 };
+MesaOS::System::WaitQueue BufferCache::flusher_wait = { 0 };
+
+bool BufferCache::initialize() {
+    memset(buffers, 0, sizeof(buffers));
+    memset(hash, 0, sizeof(hash));
+    memset(&stats, 0, sizeof(stats));
+    buffer_count = 0;
+    for (uint32_t i = 0; i < BCACHE_BUFFERS; i++) {
+        uint8_t* data = (uint8_t*)MesaOS::Memory::PMM::allocate_block();
+        if (!data) break;
+        buffers[i].data = data;
+        buffer_count++;
+    }
+    stats.buffers = buffer_count;
+    return buffer_count > 0;
+}
+
+void BufferCache::start_flusher() {
+    if (flusher_running || buffer_count == 0) return;
+    flusher_running = true;
+    MesaOS::System::Scheduler::add_process("kflushd", BufferCache::flusher);
+}
+
+// Called with interrupts disabled
+Buffer* BufferCache::lookup(BlockDevice* dev, uint64_t block) {
+    for (Buffer* buf = hash[hash_index(dev, block)]; buf; buf = buf->hash_next) {
+        if (buf->dev == dev && buf->block == block) return buf;
+    }
+    return 0;
+}
+
+// Returns the block's buffer pinned, recycling the first clean, unpinned
+// buffer the clock hand finds without B_REF on a miss. If everything is
+// dirty, may_flush allows a synchronous write-back and one more sweep.
+Buffer* BufferCache::get(BlockDevice* dev, uint64_t block, bool may_flush) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        uint32_t flags = save_flags_cli();
+        Buffer* buf = lookup(dev, block);
+        if (buf) {
+            buf->refcount++;
+            buf->flags |= B_REF;
+            if (buf->flags & B_VALID) stats.hits++;
+            else stats.misses++;
+            restore_flags(flags);
+            return buf;
+        }
+
+        Buffer* victim = 0;
+        for (uint32_t i = 0; i < 2 * buffer_count; i++) {
+            Buffer* b = &buffers[clock_hand];
+            clock_hand = (clock_hand + 1) % buffer_count;
+            if (b->refcount || (b->flags & (B_DIRTY | B_READING | B_WRITING))) continue;
+            if (b->flags & B_REF) {
+                b->flags &= ~B_REF;
+                continue;
+            }
+            victim = b;
+            break;
+        }
+
+        if (victim) {
+            if (victim->dev) {
+                Buffer** link = &hash[hash_index(victim->dev, victim->block)];
+                while (*link != victim) link = &(*link)->hash_next;
+                *link = victim->hash_next;
+                if (victim->flags & B_VALID) stats.evictions++;
+            }
+            uint32_t index = hash_index(dev, block);
+            victim->dev = dev;
+            victim->block = block;
+            victim->flags = B_REF;
+            victim->refcount = 1;
+            victim->hash_next = hash[index];
+            hash[index] = victim;
+            stats.misses++;
+            restore_flags(flags);
+            return victim;
+        }
+        restore_flags(flags);
+
+        if (!may_flush || attempt > 0) break;
+        sync();
+    }
+    return 0;
+}
+
+void BufferCache::release(Buffer* buf) {
+    uint32_t flags = save_flags_cli();
+    buf->refcount--;
+    restore_flags(flags);
+}
+
+// Queues a read of the whole block unless it is already valid or loading.
+// Blocks running past the end of the device are read short.
+bool BufferCache::start_read(Buffer* buf) {
+    uint32_t flags = save_flags_cli();
+    if (buf->flags & (B_VALID | B_READING)) {
+        restore_flags(flags);
+        return true;
+    }
+    buf->flags = (buf->flags & ~B_ERROR) | B_READING;
+    restore_flags(flags);
+
+    uint64_t lba = buf->block * BCACHE_BLOCK_SECTORS;
+    uint64_t left = lba < buf->dev->sector_count ? buf->dev->sector_count - lba : 0;
+    memset(&buf->bio, 0, sizeof(Bio));
+    buf->bio.lba = lba;
+    buf->bio.count = left < BCACHE_BLOCK_SECTORS ? (uint32_t)left : BCACHE_BLOCK_SECTORS;
+    buf->bio.buffer = buf->data;
+    buf->bio.write = false;
+    buf->bio.done = BufferCache::io_done;
+    buf->bio.priv = buf;
+    BlockLayer::submit(buf->dev, &buf->bio);
+    return true;
+}
+
+bool BufferCache::wait_ready(Buffer* buf) {
+    uint32_t flags = save_flags_cli();
+    MesaOS::System::Process* self = MesaOS::System::Scheduler::get_current();
+    while (buf->flags & B_READING) {
+        if (!self || self->pid == 0) asm volatile("sti; hlt; cli");
+        else MesaOS::System::Scheduler::block(&io_wait);
+    }
+    bool ok = buf->flags & B_VALID;
+    restore_flags(flags);
+    return ok;
+}
+
+// Completion callback for both directions; a failed write-back leaves the
+// block dirty so the next flush retries it
+void BufferCache::io_done(Bio* bio, bool ok) {
+    Buffer* buf = (Buffer*)bio->priv;
+    uint32_t flags = save_flags_cli();
+    if (bio->write) {
+        buf->flags &= ~B_WRITING;
+        if (ok) {
+            stats.writebacks++;
+        } else {
+            stats.write_errors++;
+            if (!(buf->flags & B_DIRTY)) {
+                buf->flags |= B_DIRTY;
+                buf->dirty_since = MesaOS::System::Clock::now_ms();
+                stats.dirty++;
+            }
+        }
+    } else {
+        buf->flags &= ~B_READING;
+        buf->flags |= ok ? B_VALID : B_ERROR;
+    }
+    MesaOS::System::Scheduler::wake_all(&io_wait);
+    restore_flags(flags);
+}
+
+// Pins up to BCACHE_BATCH blocks, queues every missing one under a plug so
+// neighbours merge into one request, then copies out once all are in
+bool BufferCache::read(BlockDevice* dev, uint64_t offset, uint32_t size, uint8_t* buffer) {
+    if (!dev || buffer_count == 0) return false;
+
+    while (size > 0) {
+        uint64_t first = offset / BCACHE_BLOCK_SIZE;
+        uint64_t last = (offset + size - 1) / BCACHE_BLOCK_SIZE;
+        uint32_t n = last - first + 1 > BCACHE_BATCH ? BCACHE_BATCH : (uint32_t)(last - first + 1);
+
+        Buffer* bufs[BCACHE_BATCH];
+        uint32_t got = 0;
+        while (got < n && (bufs[got] = get(dev, first + got, got == 0)) != 0) got++;
+        if (got == 0) return false;
+
+        BlockLayer::plug(dev);
+        for (uint32_t i = 0; i < got; i++) start_read(bufs[i]);
+        BlockLayer::unplug(dev);
+
+        bool ok = true;
+        for (uint32_t i = 0; i < got; i++) {
+            if (!wait_ready(bufs[i])) ok = false;
+        }
+        for (uint32_t i = 0; ok && i < got; i++) {
+            uint32_t in_block = offset % BCACHE_BLOCK_SIZE;
+            uint32_t chunk = BCACHE_BLOCK_SIZE - in_block;
+            if (chunk > size) chunk = size;
+            memcpy(buffer, bufs[i]->data + in_block, chunk);
+            buffer += chunk;
+            offset += chunk;
+            size -= chunk;
+        }
+        for (uint32_t i = 0; i < got; i++) release(bufs[i]);
+        if (!ok) return false;
+    }
+    return true;
+}
+
+void BufferCache::prefetch(BlockDevice* dev, uint64_t offset, uint32_t size) {
+    if (!dev || buffer_count == 0 || size == 0) return;
+
+    uint64_t first = offset / BCACHE_BLOCK_SIZE;
+    uint64_t last = (offset + size - 1) / BCACHE_BLOCK_SIZE;
+    BlockLayer::plug(dev);
+    for (uint64_t block = first; block <= last; block++) {
+        if (block * BCACHE_BLOCK_SECTORS >= dev->sector_count) break;
+
+        uint32_t flags = save_flags_cli();
+        bool cached = lookup(dev, block) != 0;
+        restore_flags(flags);
+        if (cached) continue;
+
+        // A miss only counts once somebody actually asks for the block
+        Buffer* buf = get(dev, block, false);
+        if (!buf) break;
+        flags = save_flags_cli();
+        stats.misses--;
+        stats.readahead++;
+        restore_flags(flags);
+        start_read(buf);
+        release(buf); // B_READING keeps it from being evicted meanwhile
+    }
+    BlockLayer::unplug_async(dev);
+}
+
+// Whole blocks are overwritten in place; partial ones are read first the
+// first time only. Either way the disk write is left to kflushd.
+bool BufferCache::write(BlockDevice* dev, uint64_t offset, uint32_t size, const uint8_t* buffer) {
+    if (!dev || buffer_count == 0) return false;
+
+    while (size > 0) {
+        uint64_t block = offset / BCACHE_BLOCK_SIZE;
+        uint32_t in_block = offset % BCACHE_BLOCK_SIZE;
+        uint32_t chunk = BCACHE_BLOCK_SIZE - in_block;
+        if (chunk > size) chunk = size;
+        if (block * BCACHE_BLOCK_SECTORS >= dev->sector_count) return false;
+
+        Buffer* buf = get(dev, block, true);
+        if (!buf) return false;
+        if (chunk < BCACHE_BLOCK_SIZE) start_read(buf);
+        // Even a full overwrite must not race a read still landing in the buffer
+        if (!wait_ready(buf) && chunk < BCACHE_BLOCK_SIZE) {
+            release(buf);
+            return false;
+        }
+
+        uint32_t flags = save_flags_cli();
+        memcpy(buf->data + in_block, buffer, chunk);
+        buf->flags = (buf->flags & ~B_ERROR) | B_VALID;
+        if (!(buf->flags & B_DIRTY)) {
+            buf->flags |= B_DIRTY;
+            buf->dirty_since = MesaOS::System::Clock::now_ms();
+            stats.dirty++;
+        }
+        restore_flags(flags);
+        release(buf);
+
+        buffer += chunk;
+        offset += chunk;
+        size -= chunk;
+    }
+
+    if (stats.dirty > buffer_count / 2) MesaOS::System::Scheduler::wake_one(&flusher_wait);
+    return true;
+}
+
+// Queues write-back of dirty blocks (those past DIRTY_EXPIRE_MS, or all),
+// one plug per device so runs of dirty blocks merge. Completion is async.
+void BufferCache::flush(bool only_expired) {
+    uint32_t now = MesaOS::System::Clock::now_ms();
+    for (int d = 0; d < BlockLayer::get_device_count(); d++) {
+        BlockDevice* dev = &BlockLayer::get_devices()[d];
+        bool plugged = false;
+
+        for (uint32_t i = 0; i < buffer_count; i++) {
+            Buffer* buf = &buffers[i];
+            uint32_t flags = save_flags_cli();
+            if (buf->dev != dev || !(buf->flags & B_DIRTY) || (buf->flags & B_WRITING) ||
+                (only_expired && now - buf->dirty_since < DIRTY_EXPIRE_MS)) {
+                restore_flags(flags);
+                continue;
+            }
+            buf->flags = (buf->flags & ~B_DIRTY) | B_WRITING;
+            stats.dirty--;
+            restore_flags(flags);
+
+            if (!plugged) {
+                BlockLayer::plug(dev);
+                plugged = true;
+            }
+            uint64_t lba = buf->block * BCACHE_BLOCK_SECTORS;
+            uint64_t left = dev->sector_count - lba;
+            memset(&buf->bio, 0, sizeof(Bio));
+            buf->bio.lba = lba;
+            buf->bio.count = left < BCACHE_BLOCK_SECTORS ? (uint32_t)left : BCACHE_BLOCK_SECTORS;
+            buf->bio.buffer = buf->data;
+            buf->bio.write = true;
+            buf->bio.done = BufferCache::io_done;
+            buf->bio.priv = buf;
+            BlockLayer::submit(dev, &buf->bio);
+        }
+        if (plugged) BlockLayer::unplug(dev);
+    }
+}
+
+void BufferCache::sync() {
+    if (buffer_count == 0) return;
+    flush(false);
+
+    uint32_t flags = save_flags_cli();
+    MesaOS::System::Process* self = MesaOS::System::Scheduler::get_current();
+    for (uint32_t i = 0; i < buffer_count; i++) {
+        while (buffers[i].flags & B_WRITING) {
+            if (!self || self->pid == 0) asm volatile("sti; hlt; cli");
+            else MesaOS::System::Scheduler::block(&io_wait);
+        }
+    }
+    restore_flags(flags);
+}
+
+// kflushd: ages out dirty blocks every FLUSH_INTERVAL_MS; woken early by
+// write() when more than half the cache is dirty, and then flushes it all
+void BufferCache::flusher() {
+    for (;;) {
+        MesaOS::System::Timer::sleep_on(&flusher_wait, FLUSH_INTERVAL_MS);
+        flush(stats.dirty <= buffer_count / 2);
+    }
+}
+
+const BufferCacheStats* BufferCache::get_stats() { return &stats; }
+
+} // namespace MesaOS::FS
@@ -0,0 +1,89 @@
+#ifndef BCACHE_HPP
+#define BCACHE_HPP
+
+#include <stdint.h>
+#include "drivers/block.hpp"
+#include "scheduler.hpp"
+
+namespace MesaOS::FS {
+
+#define BCACHE_BLOCK_SIZE 4096
+#define BCACHE_BLOCK_SECTORS (BCACHE_BLOCK_SIZE / 512)
+#define BCACHE_BUFFERS    256 // 1MB of PMM frames
+#define BCACHE_HASH_SIZE  128
+#define BCACHE_BATCH      16  // Blocks pinned by one read/write step
+
+#define B_VALID   0x01 // Data matches (or is newer than) the disk
+#define B_DIRTY   0x02 // Modified since the last write-back
+#define B_REF     0x04 // Touched since the clock hand last passed
+#define B_READING 0x08 // Read in flight; data not usable yet
+#define B_WRITING 0x10 // Write-back in flight
+#define B_ERROR   0x20 // Last read failed
+
+// One cached 4KB block of a block device. The embedded bio carries its I/O
+// through the block layer, so buffers that are adjacent on disk merge into
+// one driver request.
+struct Buffer {
+    MesaOS::Drivers::BlockDevice* dev;
+    uint64_t block;
+    uint8_t* data;
+    volatile uint32_t flags;
+    uint32_t refcount;     // Pinned by a reader/writer; not evictable
+    uint32_t dirty_since;  // Clock::now_ms() when it became dirty
+    Buffer* hash_next;
+    MesaOS::Drivers::Bio bio;
+};
+
+struct BufferCacheStats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t writebacks;   // Blocks written to disk
+    uint32_t write_errors;
+    uint32_t readahead;    // Blocks queued by prefetch()
+    uint32_t dirty;        // Currently dirty
+    uint32_t buffers;      // Allocated at initialize()
+};
+
+// Block cache keyed by (device, block) with CLOCK eviction. Writes only
+// dirty the cached block; kflushd writes dirty blocks back once they are
+// DIRTY_EXPIRE_MS old, or all of them when too many pile up.
+class BufferCache {
+public:
+    static bool initialize();
+    static void start_flusher();
+
+    // Byte-granular access; false on a device error
+    static bool read(MesaOS::Drivers::BlockDevice* dev, uint64_t offset, uint32_t size, uint8_t* buffer);
+    static bool write(MesaOS::Drivers::BlockDevice* dev, uint64_t offset, uint32_t size, const uint8_t* buffer);
+
+    // Queues reads of the uncached blocks in the range and returns without
+    // waiting; kblockd does the I/O. Never evicts dirty data to make room.
+    static void prefetch(MesaOS::Drivers::BlockDevice* dev, uint64_t offset, uint32_t size);
+
+    static void sync(); // Write back everything dirty and wait for it
+    static const BufferCacheStats* get_stats();
+
+private:
+    static Buffer* lookup(MesaOS::Drivers::BlockDevice* dev, uint64_t block);
+    static Buffer* get(MesaOS::Drivers::BlockDevice* dev, uint64_t block, bool may_flush);
+    static void release(Buffer* buf);
+    static bool start_read(Buffer* buf);
+    static bool wait_ready(Buffer* buf);
+    static void flush(bool only_expired);
+    static void io_done(MesaOS::Drivers::Bio* bio, bool ok);
+    static void flusher();
+
+    static Buffer buffers[BCACHE_BUFFERS];
+    static Buffer* hash[BCACHE_HASH_SIZE];
+    static uint32_t buffer_count;
+    static uint32_t clock_hand;
+    static BufferCacheStats stats;
+    static bool flusher_running;
+    static MesaOS::System::WaitQueue io_wait;
+    static MesaOS::System::WaitQueue flusher_wait;
+};
+
+} // namespace MesaOS::FS
+
+#endif
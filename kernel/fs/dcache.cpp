@@ -0,0 +1,142 @@
+#include "dcache.hpp"
+#include "arch/i386/cpu.hpp"
+#include <string.h>
+
+namespace MesaOS::FS {
+
+using MesaOS::Arch::x86::save_flags_cli;
+using MesaOS::Arch::x86::restore_flags;
+
+Dentry DentryCache::entries[DCACHE_ENTRIES];
+Dentry* DentryCache::hash[DCACHE_HASH_SIZE];
+Dentry* DentryCache::lru_head = 0;
+Dentry* DentryCache::lru_tail = 0;
+Dentry* DentryCache::free_list = 0;
+bool DentryCache::initialized = false;
+uint32_t DentryCache::generation = 0;
+DentryCacheStats DentryCache::stats;
+
+// Parent pointers are unique while the dentry's reference keeps them alive
+static inline uint32_t dentry_hash(fs_node* parent, uint32_t name_hash_value) {
+    return (name_hash_value ^ ((uint32_t)parent >> 4)) % DCACHE_HASH_SIZE;
+}
+
+// Called with interrupts disabled
+Dentry* DentryCache::find(fs_node* parent, const char* name, uint32_t h) {
+    for (Dentry* d = hash[dentry_hash(parent, h)]; d; d = d->hash_next) {
+        if (d->parent == parent && d->hash == h && strcmp(d->name, name) == 0) return d;
+    }
+    return 0;
+}
+
+void DentryCache::lru_unlink(Dentry* d) {
+    if (d->lru_prev) d->lru_prev->lru_next = d->lru_next;
+    else lru_head = d->lru_next;
+    if (d->lru_next) d->lru_next->lru_prev = d->lru_prev;
+    else lru_tail = d->lru_prev;
+    d->lru_prev = d->lru_next = 0;
+}
+
+void DentryCache::lru_push_front(Dentry* d) {
+    d->lru_prev = 0;
+    d->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = d;
+    lru_head = d;
+    if (!lru_tail) lru_tail = d;
+}
+
+void DentryCache::unhash(Dentry* d) {
+    Dentry** link = &hash[dentry_hash(d->parent, d->hash)];
+    while (*link && *link != d) link = &(*link)->hash_next;
+    if (*link) *link = d->hash_next;
+}
+
+// Releases the entry's references and returns it to the free list
+void DentryCache::drop(Dentry* d) {
+    unhash(d);
+    lru_unlink(d);
+    put_node(d->node);
+    put_node(d->parent);
+    d->parent = d->node = 0;
+    d->hash_next = free_list;
+    free_list = d;
+    stats.entries--;
+}
+
+// A free entry, evicting the least recently used one if there is none
+Dentry* DentryCache::alloc() {
+    if (!initialized) {
+        for (int i = 0; i < DCACHE_ENTRIES; i++) {
+            entries[i].hash_next = free_list;
+            free_list = &entries[i];
+        }
+        initialized = true;
+    }
+    if (!free_list) {
+        drop(lru_tail);
+        stats.evictions++;
+    }
+    Dentry* d = free_list;
+    free_list = d->hash_next;
+    return d;
+}
+
+fs_node* DentryCache::lookup(fs_node* parent, const char* name) {
+    uint32_t len = strlen(name);
+    if (len > DCACHE_NAME_MAX) return parent->finddir(parent, name);
+    uint32_t h = name_hash(name, len);
+
+    uint32_t flags = save_flags_cli();
+    Dentry* d = find(parent, name, h);
+    if (d) {
+        lru_unlink(d);
+        lru_push_front(d);
+        if (d->node) stats.hits++;
+        else stats.negative_hits++;
+        fs_node* node = get_node(d->node);
+        restore_flags(flags);
+        return node;
+    }
+    stats.misses++;
+    uint32_t gen = generation;
+    restore_flags(flags);
+
+    // The filesystem may sleep on disk I/O; don't hold interrupts off
+    fs_node* node = parent->finddir(parent, name);
+
+    flags = save_flags_cli();
+    if (generation != gen || find(parent, name, h)) {
+        // A create or delete may have raced with finddir, or another task
+        // cached it meanwhile; either way ours goes back uncached
+        restore_flags(flags);
+        return node;
+    }
+    d = alloc();
+    d->parent = get_node(parent);
+    d->node = node; // The cache keeps finddir's reference
+    d->hash = h;
+    memcpy(d->name, name, len + 1);
+    uint32_t bucket = dentry_hash(parent, h);
+    d->hash_next = hash[bucket];
+    hash[bucket] = d;
+    lru_push_front(d);
+    stats.entries++;
+    fs_node* result = get_node(node);
+    restore_flags(flags);
+    return result;
+}
+
+void DentryCache::invalidate(const char* name) {
+    uint32_t flags = save_flags_cli();
+    generation++;
+    for (Dentry* d = lru_head; d; ) {
+        Dentry* next = d->lru_next;
+        if (strcmp(d->name, name) == 0) drop(d);
+        d = next;
+    }
+    restore_flags(flags);
+}
+
+const DentryCacheStats* DentryCache::get_stats() { return &stats; }
+
+} // namespace MesaOS::FS
@@ -0,0 +1,62 @@
+#ifndef DCACHE_HPP
+#define DCACHE_HPP
+
+#include <stdint.h>
+#include "vfs.hpp"
+
+namespace MesaOS::FS {
+
+#define DCACHE_ENTRIES   256
+#define DCACHE_HASH_SIZE 128
+#define DCACHE_NAME_MAX  63 // Longer names bypass the cache
+
+// One resolved path component. Holds a reference on both nodes; node is 0
+// for a negative entry (the name was looked up and doesn't exist).
+struct Dentry {
+    fs_node* parent;
+    fs_node* node;
+    uint32_t hash;
+    char name[DCACHE_NAME_MAX + 1];
+    Dentry* hash_next;
+    Dentry* lru_prev; // Towards the most recently used
+    Dentry* lru_next;
+};
+
+struct DentryCacheStats {
+    uint32_t hits;
+    uint32_t negative_hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t entries;
+};
+
+// (parent node, name) -> node cache in front of every finddir, with LRU
+// eviction. Filesystems call invalidate() when a name appears or goes away.
+class DentryCache {
+public:
+    // A new reference to the child, or 0. Asks parent->finddir on a miss.
+    static fs_node* lookup(fs_node* parent, const char* name);
+    static void invalidate(const char* name); // Under every parent
+    static const DentryCacheStats* get_stats();
+
+private:
+    static Dentry* find(fs_node* parent, const char* name, uint32_t hash);
+    static void lru_unlink(Dentry* d);
+    static void lru_push_front(Dentry* d);
+    static void unhash(Dentry* d);
+    static void drop(Dentry* d);
+    static Dentry* alloc();
+
+    static Dentry entries[DCACHE_ENTRIES];
+    static Dentry* hash[DCACHE_HASH_SIZE];
+    static Dentry* lru_head;
+    static Dentry* lru_tail;
+    static Dentry* free_list; // Chained through hash_next
+    static bool initialized;
+    static uint32_t generation; // Bumped by every invalidate()
+    static DentryCacheStats stats;
+};
+
+} // namespace MesaOS::FS
+
+#endif
@@ -1,5 +1,6 @@
 #include "mbr.hpp"
 #include "drivers/ide.hpp"
+#include "drivers/block.hpp"
 #include "drivers/vga.hpp"
 #include <string.h>
 
@@ -12,21 +13,27 @@ void PartitionManager::initialize() {
 void PartitionManager::list_partitions() {
     MesaOS::Drivers::VGADriver vga;
     uint8_t sector[512];
-    MesaOS::Drivers::IDEDriver::read_sector(0, sector);
+    MesaOS::Drivers::BlockDevice* disk = MesaOS::Drivers::BlockLayer::get_default();
+    bool ok = MesaOS::Drivers::BlockLayer::read(disk, 0, 1, sector);
 
     MBR* mbr = (MBR*)sector;
-    if (mbr->signature != 0xAA55) {
+    if (!ok || mbr->signature != 0xAA55) {
         vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_RED, MesaOS::Drivers::VGAColor::BLACK));
         vga.write_string("Error: Disk not partitioned or invalid MBR signature.\n");
         return;
     }
 
-    // Disk total estimation (simplified: based on partition sum or fixed 64MB for this demo)
-    // In a real OS we'd use ATA IDENTIFY 
     vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_CYAN, MesaOS::Drivers::VGAColor::BLACK));
     vga.write_string("\n--- MesaOS Disk Manager ---\n");
     vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::WHITE, MesaOS::Drivers::VGAColor::BLACK));
-    vga.write_string("Disk /dev/hda: 64 MiB (67108864 bytes)\n\n");
+    char size_buf[24];
+    vga.write_string("Disk /dev/");
+    vga.write_string(disk->name);
+    vga.write_string(": ");
+    vga.write_string(ulltoa(disk->sector_count / 2048, size_buf, 10));
+    vga.write_string(" MiB (");
+    vga.write_string(ulltoa(disk->sector_count * 512, size_buf, 10));
+    vga.write_string(" bytes)\n\n");
 
     vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_GREY, MesaOS::Drivers::VGAColor::BLACK));
     vga.write_string("Num  Boot  Type         Format      Size (MB)   Sectors\n");
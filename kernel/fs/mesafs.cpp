@@ -1,34 +1,71 @@
 #include "mesafs.hpp"
-#include "drivers/ide.hpp"
+#include "bcache.hpp"
+#include "mbr.hpp"
+#include "dcache.hpp"
 #include "memory/kheap.hpp"
+#include "memory/pmm.hpp"
 #include "crypto.hpp"
+#include "logging.hpp"
+#include "trace.hpp"
 #include <string.h>
 
 namespace MesaOS::FS {
 
 uint32_t MesaFS::base_lba = 0;
+MesaOS::Drivers::BlockDevice* MesaFS::device = 0;
 fs_node* MesaFS::root_node = 0;
-bool MesaFS::metadata_valid = false;
+MesaFSSuperblock MesaFS::sb;
+uint8_t* MesaFS::bitmap = 0;
+uint32_t MesaFS::alloc_hint = 0;
+uint32_t MesaFS::inode_hint = 0;
 
-static MesaFSEntry entries[8]; // Flat registry for 8 files/dirs (fits in 512-byte sector with header)
+DEFINE_TRACEPOINT(mesafs_read, "inode=%u offset=%u size=%u");
+DEFINE_TRACEPOINT(mesafs_write, "inode=%u offset=%u size=%u");
+
+// Read-ahead window bounds, in bytes of file
+#define RA_MIN_WINDOW (16 * 1024)
+#define RA_MAX_WINDOW (128 * 1024)
+
+#define DIRENTS_PER_BLOCK (MESAFS_BLOCK_SIZE / MESAFS_DIRENT_SIZE)
+
+// Scratch blocks; MesaFS calls are not reentrant
+static uint8_t zero_block[MESAFS_BLOCK_SIZE];
+static MesaFSInode inode_buf[MESAFS_INODES_PER_BLOCK];
+static MesaFSDirent dir_buf[DIRENTS_PER_BLOCK];
+static MesaFSDirent dx_leaf[DIRENTS_PER_BLOCK];
+static MesaFSDxRoot dx_buf;
 
 fs_node* MesaFS::initialize(uint32_t partition_lba) {
     base_lba = partition_lba;
+    device = MesaOS::Drivers::BlockLayer::get_default();
 
     // Initialize encryption keys
     Crypto::KeyManager::initialize();
 
-    // Try to load and verify metadata
-    if (!load_metadata()) {
-        // If metadata is invalid or doesn't exist, initialize with empty registry
-        memset(entries, 0, sizeof(entries));
-        metadata_valid = true; // Start with valid empty state
-        // Don't save metadata immediately to avoid potential issues on first boot
+    // Mount a v2 volume; otherwise bring a v1 one across or start empty.
+    // Anything else stays unmounted: formatting after a failed read would
+    // wipe a good volume.
+    if (device) {
+        switch (mount()) {
+            case MESAFS_MOUNTED:
+                break;
+            case MESAFS_FOUND_V1:
+                if (!migrate_v1()) MesaOS::System::Logging::error("MesaFS: v1 migration failed; not mounted");
+                break;
+            case MESAFS_BLANK:
+                if (format(volume_blocks())) MesaOS::System::Logging::info("MesaFS: formatted new v2 volume");
+                else MesaOS::System::Logging::error("MesaFS: volume too small to format");
+                break;
+            case MESAFS_BAD_VOLUME:
+                MesaOS::System::Logging::error("MesaFS: volume unreadable or damaged; not mounted");
+                break;
+        }
     }
 
     root_node = (fs_node*)kmalloc(sizeof(fs_node));
     memset(root_node, 0, sizeof(fs_node));
     strcpy(root_node->name, "disk");
+    root_node->inode = MESAFS_ROOT_INODE;
     root_node->flags = FS_DIRECTORY;
     root_node->uid = 0; // root
     root_node->gid = 0; // root
@@ -39,246 +76,818 @@ fs_node* MesaFS::initialize(uint32_t partition_lba) {
     return root_node;
 }
 
-bool MesaFS::load_metadata() {
-    // For now, always start fresh to avoid corrupted metadata issues
-    // TODO: Re-enable metadata loading once filesystem is stable
-    return false;
+const MesaFSSuperblock* MesaFS::get_superblock() {
+    return bitmap ? &sb : 0;
 }
 
-bool MesaFS::save_metadata() {
-    if (!metadata_valid) return false;
+uint64_t MesaFS::disk_offset(uint32_t block) {
+    return (uint64_t)base_lba * 512 + (uint64_t)block * MESAFS_BLOCK_SIZE;
+}
 
-    uint8_t buffer[512];
-    memset(buffer, 0, 512);
+// Metadata and data alike go through the buffer cache; offset may run past
+// the end of the block into the ones after it
+bool MesaFS::read_block_bytes(uint32_t block, uint32_t offset, uint32_t size, void* buffer) {
+    return BufferCache::read(device, disk_offset(block) + offset, size, (uint8_t*)buffer);
+}
 
-    MesaFSHeader header;
-    header.magic = 0x5341534D; // "MSAF"
-    header.version = 1;
-    header.root_dir_lba = 0; // Not used in flat model
-    header.total_blocks = 1000; // Placeholder
+bool MesaFS::write_block_bytes(uint32_t block, uint32_t offset, uint32_t size, const void* buffer) {
+    return BufferCache::write(device, disk_offset(block) + offset, size, (const uint8_t*)buffer);
+}
 
-    // Encrypt the metadata entries (simple encryption for now)
-    uint8_t* encrypted_entries = buffer + sizeof(MesaFSHeader);
-    size_t entries_size = sizeof(entries);
+MesaFSMountResult MesaFS::mount() {
+    MesaFSSuperblock disk;
+    if (!read_block_bytes(0, 512, sizeof(disk), &disk)) return MESAFS_BAD_VOLUME;
+    if (disk.magic != MESAFS_MAGIC) return MESAFS_BLANK;
+    if (disk.version == 1) return MESAFS_FOUND_V1; // Same place, same magic
+    if (disk.version != MESAFS_VERSION ||
+        disk.block_size != MESAFS_BLOCK_SIZE || disk.total_blocks > MESAFS_MAX_BLOCKS ||
+        disk.data_start >= disk.total_blocks) {
+        return MESAFS_BAD_VOLUME;
+    }
 
-    memcpy(encrypted_entries, entries, entries_size);
-    // Disable metadata encryption for now so user can see file names
-    // Crypto::AES128::encrypt_buffer(encrypted_entries, entries_size, Crypto::KeyManager::get_master_key());
+    uint8_t* map = (uint8_t*)MesaOS::Memory::PMM::allocate_blocks(disk.bitmap_blocks);
+    if (!map) return MESAFS_BAD_VOLUME;
+    for (uint32_t i = 0; i < disk.bitmap_blocks; i++) {
+        if (!BufferCache::read(device, disk_offset(disk.bitmap_start + i), MESAFS_BLOCK_SIZE,
+                               map + i * MESAFS_BLOCK_SIZE)) {
+            for (uint32_t j = 0; j < disk.bitmap_blocks; j++) {
+                MesaOS::Memory::PMM::free_block(map + j * MESAFS_BLOCK_SIZE);
+            }
+            return MESAFS_BAD_VOLUME;
+        }
+    }
 
-    // Copy header to buffer
-    memcpy(buffer, &header, sizeof(MesaFSHeader));
+    sb = disk;
+    bitmap = map;
+    alloc_hint = sb.data_start;
+    inode_hint = sb.root_inode + 1;
+    return MESAFS_MOUNTED;
+}
 
-    // Write the encrypted metadata sector
-    MesaOS::Drivers::IDEDriver::write_sector(base_lba + 1, buffer);
-    return true;
+// Partition size from its MBR entry, else the rest of the disk
+uint32_t MesaFS::volume_blocks() {
+    uint64_t sectors = device->sector_count > base_lba ? device->sector_count - base_lba : 0;
+    MBR mbr;
+    if (BufferCache::read(device, 0, sizeof(MBR), (uint8_t*)&mbr) && mbr.signature == 0xAA55) {
+        for (int i = 0; i < 4; i++) {
+            PartitionEntry& part = mbr.partitions[i];
+            if (part.type != 0 && part.lba_start == base_lba && part.sector_count > 0 &&
+                part.sector_count < sectors) {
+                sectors = part.sector_count;
+            }
+        }
+    }
+    uint64_t blocks = sectors / (MESAFS_BLOCK_SIZE / 512);
+    return blocks > MESAFS_MAX_BLOCKS ? MESAFS_MAX_BLOCKS : (uint32_t)blocks;
 }
 
-static dirent static_de;
-dirent* MesaFS::readdir(fs_node* node, uint32_t index) {
-    (void)node;
-    if (index >= 8) return 0;
-    if (!entries[index].present) return 0;
+bool MesaFS::format(uint32_t total_blocks) {
+    if (total_blocks < 64) return false;
+
+    MesaFSSuperblock fresh;
+    memset(&fresh, 0, sizeof(fresh));
+    fresh.magic = MESAFS_MAGIC;
+    fresh.version = MESAFS_VERSION;
+    fresh.block_size = MESAFS_BLOCK_SIZE;
+    fresh.total_blocks = total_blocks;
+    fresh.bitmap_start = 1;
+    fresh.bitmap_blocks = (total_blocks + MESAFS_BLOCK_SIZE * 8 - 1) / (MESAFS_BLOCK_SIZE * 8);
+
+    // One inode per 16KB of volume, in whole table blocks
+    uint32_t inodes = total_blocks / 4;
+    if (inodes < 256) inodes = 256;
+    if (inodes > 65536) inodes = 65536;
+    fresh.inode_blocks = (inodes + MESAFS_INODES_PER_BLOCK - 1) / MESAFS_INODES_PER_BLOCK;
+    fresh.inode_count = fresh.inode_blocks * MESAFS_INODES_PER_BLOCK;
+    fresh.inode_start = fresh.bitmap_start + fresh.bitmap_blocks;
+    fresh.data_start = fresh.inode_start + fresh.inode_blocks;
+    if (fresh.data_start + 16 > total_blocks) return false;
+    fresh.free_blocks = total_blocks - fresh.data_start;
+    fresh.free_inodes = fresh.inode_count - 2; // Inode 0 and the root
+    fresh.root_inode = MESAFS_ROOT_INODE;
+
+    if (!bitmap) {
+        bitmap = (uint8_t*)MesaOS::Memory::PMM::allocate_blocks(fresh.bitmap_blocks);
+        if (!bitmap) return false;
+    }
+    sb = fresh;
+    memset(bitmap, 0, sb.bitmap_blocks * MESAFS_BLOCK_SIZE);
+    for (uint32_t b = 0; b < sb.data_start; b++) bitmap[b / 8] |= 1 << (b % 8);
+    alloc_hint = sb.data_start;
+    inode_hint = sb.root_inode + 1;
+
+    // Whole-block writes: the cache doesn't read them first
+    for (uint32_t i = 0; i < sb.bitmap_blocks; i++) {
+        if (!write_block_bytes(sb.bitmap_start + i, 0, MESAFS_BLOCK_SIZE, bitmap + i * MESAFS_BLOCK_SIZE)) return false;
+    }
+    for (uint32_t i = 0; i < sb.inode_blocks; i++) {
+        if (!write_block_bytes(sb.inode_start + i, 0, MESAFS_BLOCK_SIZE, zero_block)) return false;
+    }
 
-    strcpy(static_de.name, entries[index].name);
-    static_de.ino = index;
-    return &static_de;
+    MesaFSInode root;
+    memset(&root, 0, sizeof(root));
+    root.type = MESAFS_TYPE_DIR;
+    root.mode = 0755;
+    root.links = 2;
+    if (!write_inode(sb.root_inode, &root)) return false;
+    return save_superblock();
 }
 
-fs_node* MesaFS::finddir(fs_node* node, const char* name) {
-    (void)node;
-    for (int i = 0; i < 8; i++) {
-        if (entries[i].present && strcmp(entries[i].name, name) == 0) {
-            fs_node* res = (fs_node*)kmalloc(sizeof(fs_node));
-            memset(res, 0, sizeof(fs_node));
-            strcpy(res->name, entries[i].name);
-            res->inode = i;
-            res->flags = (entries[i].flags == 2) ? FS_DIRECTORY : FS_FILE;
-            res->uid = entries[i].uid;
-            res->gid = entries[i].gid;
-            res->mask = entries[i].mode;
-            res->length = entries[i].length;
-            res->read = &MesaFS::read;
-            res->write = &MesaFS::write;
-            res->readdir = &MesaFS::readdir;
-            res->finddir = &MesaFS::finddir;
-            return res;
+// v1 wrote its 8-entry table through a 512-byte buffer, so only the entries
+// that fit in sector 1 beside the header ever reached the disk. Those files
+// are copied out, the volume is formatted as v2 and they are created again.
+bool MesaFS::migrate_v1() {
+    uint8_t sector[512];
+    if (!BufferCache::read(device, (uint64_t)(base_lba + 1) * 512, 512, sector)) return false;
+    MesaFSHeader* header = (MesaFSHeader*)sector;
+    if (header->magic != MESAFS_MAGIC || header->version != 1) return false;
+
+    const uint32_t count = (512 - sizeof(MesaFSHeader)) / sizeof(MesaFSEntry);
+    MesaFSEntry old[count];
+    uint8_t* data[count];
+    uint32_t frames[count];
+    memcpy(old, sector + sizeof(MesaFSHeader), sizeof(old));
+
+    for (uint32_t i = 0; i < count; i++) {
+        data[i] = 0;
+        frames[i] = 0;
+        if (!old[i].present || old[i].flags != MESAFS_TYPE_FILE || old[i].length == 0) continue;
+        // A v1 file longer than its 10-sector slot ran into the next one
+        if (old[i].length > 64 * 1024) old[i].length = 64 * 1024;
+        frames[i] = (old[i].length + MESAFS_BLOCK_SIZE - 1) / MESAFS_BLOCK_SIZE;
+        data[i] = (uint8_t*)MesaOS::Memory::PMM::allocate_blocks(frames[i]);
+        if (!data[i] || !BufferCache::read(device, (uint64_t)(base_lba + old[i].lba_start) * 512,
+                                           old[i].length, data[i])) {
+            old[i].present = 0;
         }
     }
-    return 0;
+
+    bool ok = format(volume_blocks());
+    for (uint32_t pass = 0; ok && pass < 2; pass++) {
+        // Directories first, so files can land in them
+        for (uint32_t i = 0; i < count; i++) {
+            if (!old[i].present) continue;
+            old[i].name[sizeof(old[i].name) - 1] = '\0';
+            if (pass == 0 && old[i].flags == MESAFS_TYPE_DIR) {
+                fs_node* dir = create_dir(old[i].name, old[i].uid, old[i].gid, old[i].mode);
+                if (!dir) MesaOS::System::Logging::warn("MesaFS: v1 directory not migrated");
+                put_node(dir);
+            } else if (pass == 1 && old[i].flags == MESAFS_TYPE_FILE) {
+                fs_node* node = create_file(old[i].name, old[i].uid, old[i].gid, old[i].mode);
+                if (!node || (old[i].length && write(node, 0, old[i].length, data[i]) != old[i].length)) {
+                    MesaOS::System::Logging::warn("MesaFS: v1 file not migrated");
+                }
+                if (node) close_fs(node);
+                put_node(node);
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        for (uint32_t f = 0; data[i] && f < frames[i]; f++) {
+            MesaOS::Memory::PMM::free_block(data[i] + f * MESAFS_BLOCK_SIZE);
+        }
+    }
+    if (ok) MesaOS::System::Logging::info("MesaFS: migrated v1 volume to v2");
+    return ok;
 }
 
-uint32_t MesaFS::read(fs_node* node, uint32_t offset, uint32_t size, uint8_t* buffer) {
-    uint32_t entry_idx = node->inode;
-    MesaFSEntry& entry = entries[entry_idx];
+bool MesaFS::save_superblock() {
+    return write_block_bytes(0, 512, sizeof(sb), &sb);
+}
 
-    if (offset >= entry.length) return 0;
-    if (offset + size > entry.length) size = entry.length - offset;
+bool MesaFS::read_inode(uint32_t ino, MesaFSInode* inode) {
+    if (!bitmap || ino == 0 || ino >= sb.inode_count) return false;
+    return read_block_bytes(sb.inode_start + ino / MESAFS_INODES_PER_BLOCK,
+                            (ino % MESAFS_INODES_PER_BLOCK) * MESAFS_INODE_SIZE,
+                            sizeof(MesaFSInode), inode);
+}
 
-    // Read sectors from disk
-    uint32_t start_sector = base_lba + entry.lba_start;
-    uint32_t file_offset = offset; // Track remaining offset within file
-    uint32_t bytes_read = 0;
+bool MesaFS::write_inode(uint32_t ino, const MesaFSInode* inode) {
+    if (!bitmap || ino == 0 || ino >= sb.inode_count) return false;
+    return write_block_bytes(sb.inode_start + ino / MESAFS_INODES_PER_BLOCK,
+                             (ino % MESAFS_INODES_PER_BLOCK) * MESAFS_INODE_SIZE,
+                             sizeof(MesaFSInode), inode);
+}
 
-    while (bytes_read < size) {
-        uint32_t sector_index = file_offset / 512;
-        uint32_t sector_offset = file_offset % 512;
+// Scans the table a block at a time from where the last allocation stopped
+uint32_t MesaFS::alloc_inode(uint16_t type, uint32_t uid, uint32_t gid, uint32_t mode) {
+    if (!bitmap || sb.free_inodes == 0) return 0;
+
+    uint32_t ino = inode_hint;
+    for (uint32_t scanned = 0; scanned < sb.inode_count; ) {
+        if (ino >= sb.inode_count) ino = 1;
+        uint32_t table_block = ino / MESAFS_INODES_PER_BLOCK;
+        if (!read_block_bytes(sb.inode_start + table_block, 0, MESAFS_BLOCK_SIZE, inode_buf)) return 0;
+
+        for (uint32_t i = ino % MESAFS_INODES_PER_BLOCK; i < MESAFS_INODES_PER_BLOCK; i++, ino++, scanned++) {
+            if (ino == 0 || inode_buf[i].type != MESAFS_TYPE_FREE) continue;
+
+            MesaFSInode inode;
+            memset(&inode, 0, sizeof(inode));
+            inode.type = type;
+            inode.mode = mode;
+            inode.uid = uid;
+            inode.gid = gid;
+            inode.links = type == MESAFS_TYPE_DIR ? 2 : 1;
+            if (!write_inode(ino, &inode)) return 0;
+            sb.free_inodes--;
+            save_superblock();
+            inode_hint = ino + 1;
+            return ino;
+        }
+    }
+    return 0;
+}
 
-        uint8_t sector_buf[512];
-        MesaOS::Drivers::IDEDriver::read_sector(start_sector + sector_index, sector_buf);
+bool MesaFS::block_used(uint32_t block) {
+    return bitmap[block / 8] & (1 << (block % 8));
+}
 
-        uint32_t remaining_in_sector = 512 - sector_offset;
-        uint32_t to_copy = size - bytes_read;
-        if (to_copy > remaining_in_sector) to_copy = remaining_in_sector;
+// Updates the in-memory bitmap and writes the changed bytes through
+void MesaFS::mark_blocks(uint32_t start, uint32_t count, bool used) {
+    if (count == 0) return;
+    for (uint32_t b = start; b < start + count; b++) {
+        if (used) bitmap[b / 8] |= 1 << (b % 8);
+        else bitmap[b / 8] &= ~(1 << (b % 8));
+    }
+    uint32_t first = start / 8;
+    uint32_t last = (start + count - 1) / 8;
+    write_block_bytes(sb.bitmap_start, first, last - first + 1, bitmap + first);
+}
 
-        memcpy(buffer + bytes_read, sector_buf + sector_offset, to_copy);
-        bytes_read += to_copy;
-        file_offset += to_copy;
+// First free run of want blocks at or after goal, wrapping once; failing
+// that, the longest shorter run seen. Asking for the whole remaining size
+// of a write at the end of the previous extent keeps files contiguous.
+uint32_t MesaFS::alloc_blocks(uint32_t goal, uint32_t want, uint32_t* got) {
+    *got = 0;
+    if (!bitmap || sb.free_blocks == 0 || want == 0) return 0;
+    if (goal < sb.data_start || goal >= sb.total_blocks) goal = alloc_hint;
+    if (goal < sb.data_start || goal >= sb.total_blocks) goal = sb.data_start;
+
+    uint32_t best = 0;
+    uint32_t best_len = 0;
+    uint32_t span = sb.total_blocks - sb.data_start;
+    uint32_t b = goal;
+    for (uint32_t scanned = 0; scanned < span; ) {
+        if (b % 8 == 0 && b + 8 <= sb.total_blocks && bitmap[b / 8] == 0xFF) {
+            b += 8;
+            scanned += 8;
+        } else if (block_used(b)) {
+            b++;
+            scanned++;
+        } else {
+            uint32_t len = 0;
+            while (len < want && b + len < sb.total_blocks && !block_used(b + len)) len++;
+            if (len > best_len) {
+                best = b;
+                best_len = len;
+                if (len == want) break;
+            }
+            b += len;
+            scanned += len;
+        }
+        if (b >= sb.total_blocks) b = sb.data_start;
     }
+    if (best_len == 0) return 0;
+
+    mark_blocks(best, best_len, true);
+    sb.free_blocks -= best_len;
+    save_superblock();
+    alloc_hint = best + best_len;
+    *got = best_len;
+    return best;
+}
 
-    return bytes_read;
+bool MesaFS::get_extent(const MesaFSInode* inode, uint32_t index, MesaFSExtent* ext) {
+    if (index < MESAFS_DIRECT_EXTENTS) {
+        *ext = inode->extents[index];
+        return true;
+    }
+    if (!inode->indirect) return false;
+    return read_block_bytes(inode->indirect, (index - MESAFS_DIRECT_EXTENTS) * sizeof(MesaFSExtent),
+                            sizeof(MesaFSExtent), ext);
 }
 
-uint32_t MesaFS::write(fs_node* node, uint32_t offset, uint32_t size, uint8_t* buffer) {
-    uint32_t entry_idx = node->inode;
-    MesaFSEntry& entry = entries[entry_idx];
+bool MesaFS::set_extent(MesaFSInode* inode, uint32_t index, const MesaFSExtent* ext) {
+    if (index < MESAFS_DIRECT_EXTENTS) {
+        inode->extents[index] = *ext;
+        return true;
+    }
+    if (index >= MESAFS_MAX_EXTENTS) return false;
+    if (!inode->indirect) {
+        uint32_t got;
+        uint32_t block = alloc_blocks(inode->extents[MESAFS_DIRECT_EXTENTS - 1].start, 1, &got);
+        if (!block) return false;
+        if (!write_block_bytes(block, 0, MESAFS_BLOCK_SIZE, zero_block)) return false;
+        inode->indirect = block;
+    }
+    return write_block_bytes(inode->indirect, (index - MESAFS_DIRECT_EXTENTS) * sizeof(MesaFSExtent),
+                             sizeof(MesaFSExtent), ext);
+}
+
+// Disk block holding file_block, and how many blocks follow it contiguously
+// in the same extent; 0 if unmapped (block 0 is never data)
+uint32_t MesaFS::map_block(const MesaFSInode* inode, uint32_t file_block, uint32_t* run) {
+    uint32_t pos = 0;
+    for (uint32_t i = 0; i < inode->extent_count; i++) {
+        MesaFSExtent ext;
+        if (!get_extent(inode, i, &ext)) return 0;
+        if (file_block < pos + ext.length) {
+            *run = ext.length - (file_block - pos);
+            return ext.start + (file_block - pos);
+        }
+        pos += ext.length;
+    }
+    return 0;
+}
 
-    uint32_t start_sector = base_lba + entry.lba_start;
-    uint32_t file_offset = offset; // Track offset within file
-    uint32_t bytes_written = 0;
+// Maps blocks until the inode covers `blocks`, extending the last extent in
+// place whenever the blocks after it are free. Files past 16KB also get up
+// to their current size again (at most 1MB) beyond what was asked, so files
+// growing side by side in small writes still end up in few, long extents.
+// The caller saves the inode.
+bool MesaFS::grow(MesaFSInode* inode, uint32_t blocks) {
+    uint32_t target = blocks;
+    if (blocks > inode->blocks && inode->blocks >= 4) {
+        target += inode->blocks < 256 ? inode->blocks : 256;
+    }
+    while (inode->blocks < blocks) {
+        MesaFSExtent last = {0, 0};
+        if (inode->extent_count > 0 && !get_extent(inode, inode->extent_count - 1, &last)) return false;
 
-    while (bytes_written < size) {
-        uint32_t sector_index = file_offset / 512;
-        uint32_t sector_offset = file_offset % 512;
+        uint32_t got;
+        uint32_t start = alloc_blocks(last.length ? last.start + last.length : 0, target - inode->blocks, &got);
+        if (!start) return false;
 
-        uint8_t sector_buf[512];
-        // Read existing sector first (if we're not writing from offset 0)
-        if (sector_offset > 0 || (size - bytes_written) < 512) {
-            MesaOS::Drivers::IDEDriver::read_sector(start_sector + sector_index, sector_buf);
+        if (last.length && start == last.start + last.length) {
+            last.length += got;
+            if (!set_extent(inode, inode->extent_count - 1, &last)) return false;
         } else {
-            memset(sector_buf, 0, 512);
+            MesaFSExtent ext = {start, got};
+            if (!set_extent(inode, inode->extent_count, &ext)) {
+                mark_blocks(start, got, false);
+                sb.free_blocks += got;
+                save_superblock();
+                return false;
+            }
+            inode->extent_count++;
         }
+        inode->blocks += got;
+    }
+    return true;
+}
 
-        uint32_t to_copy = 512 - sector_offset;
-        if (size - bytes_written < to_copy) to_copy = size - bytes_written;
+// Unmaps the blocks past the last one holding data, which grow() mapped
+// ahead of the writer, and the indirect block once the direct extents
+// suffice. True if anything was freed; the caller saves the inode.
+bool MesaFS::trim(MesaFSInode* inode) {
+    uint32_t keep = (uint32_t)(((uint64_t)inode->size + MESAFS_BLOCK_SIZE - 1) / MESAFS_BLOCK_SIZE);
+    bool freed = false;
+    while (inode->blocks > keep && inode->extent_count > 0) {
+        MesaFSExtent last;
+        if (!get_extent(inode, inode->extent_count - 1, &last)) break;
+        uint32_t cut = inode->blocks - keep < last.length ? inode->blocks - keep : last.length;
+        last.length -= cut;
+        if (last.length == 0) inode->extent_count--;
+        else if (!set_extent(inode, inode->extent_count - 1, &last)) break;
+        mark_blocks(last.start + last.length, cut, false);
+        sb.free_blocks += cut;
+        inode->blocks -= cut;
+        freed = true;
+    }
+    if (inode->indirect && inode->extent_count <= MESAFS_DIRECT_EXTENTS) {
+        mark_blocks(inode->indirect, 1, false);
+        sb.free_blocks++;
+        inode->indirect = 0;
+        freed = true;
+    }
+    if (freed) save_superblock();
+    return freed;
+}
+
+// Moves bytes between buffer and mapped file blocks, one cache call per
+// contiguous run
+bool MesaFS::file_io(const MesaFSInode* inode, uint32_t offset, uint32_t size, uint8_t* buffer, bool write) {
+    while (size > 0) {
+        uint32_t run;
+        uint32_t block = map_block(inode, offset / MESAFS_BLOCK_SIZE, &run);
+        if (!block) return false;
+
+        uint32_t in_block = offset % MESAFS_BLOCK_SIZE;
+        uint64_t avail = (uint64_t)run * MESAFS_BLOCK_SIZE - in_block;
+        uint32_t chunk = avail < size ? (uint32_t)avail : size;
+        bool ok = write ? write_block_bytes(block, in_block, chunk, buffer)
+                        : read_block_bytes(block, in_block, chunk, buffer);
+        if (!ok) return false;
+
+        buffer += chunk;
+        offset += chunk;
+        size -= chunk;
+    }
+    return true;
+}
 
-        memcpy(sector_buf + sector_offset, buffer + bytes_written, to_copy);
+uint32_t MesaFS::read(fs_node* node, uint32_t offset, uint32_t size, uint8_t* buffer) {
+    TRACE(mesafs_read, node->inode, offset, size);
+    MesaFSInode inode;
+    if (!read_inode(node->inode, &inode) || inode.type != MESAFS_TYPE_FILE) return 0;
+    node->length = inode.size; // Another node for the same inode may have written
 
-        // Disable encryption for now so user can see files
-        // Crypto::AES128::encrypt_buffer(sector_buf, 512, Crypto::KeyManager::get_master_key());
+    if (offset >= inode.size) return 0;
+    if (size > inode.size - offset) size = inode.size - offset;
 
-        MesaOS::Drivers::IDEDriver::write_sector(start_sector + sector_index, sector_buf);
-        bytes_written += to_copy;
-        file_offset += to_copy;
+    readahead(node, &inode, offset, size);
+
+    // Through the buffer cache: hot files are served by memcpy
+    if (!file_io(&inode, offset, size, buffer, false)) return 0;
+    node->ra.prev_end = offset + size;
+    return size;
+}
+
+// A read that starts where the last one on this node stopped is
+// sequential. The first opens a window a few times the read size; once a
+// read enters the async tail of a window the next one, twice as large, is
+// queued, so the disk stays a window ahead of the reader. Anything else
+// drops the window.
+void MesaFS::readahead(fs_node* node, const MesaFSInode* inode, uint32_t offset, uint32_t size) {
+    file_ra_state& ra = node->ra;
+    if (offset != ra.prev_end) {
+        ra.size = 0;
+        return;
     }
 
-    entry.length = (offset + size > entry.length) ? offset + size : entry.length;
+    uint32_t end = offset + size;
+    if (ra.size == 0 || offset >= ra.start + ra.size) {
+        ra.start = offset;
+        ra.size = size * 4;
+        if (ra.size < RA_MIN_WINDOW) ra.size = RA_MIN_WINDOW;
+        if (ra.size > RA_MAX_WINDOW) ra.size = RA_MAX_WINDOW;
+        ra.async_size = ra.size > size ? ra.size - size : 0;
+    } else if (end > ra.start + ra.size - ra.async_size) {
+        ra.start += ra.size;
+        ra.size = ra.size * 2 > RA_MAX_WINDOW ? RA_MAX_WINDOW : ra.size * 2;
+        ra.async_size = ra.size;
+    } else {
+        return;
+    }
 
-    // Save updated metadata
-    save_metadata();
+    if (ra.start >= inode->size) return;
+    uint32_t pos = ra.start;
+    uint32_t window_end = inode->size - ra.start < ra.size ? inode->size : ra.start + ra.size;
+    // The window may span several extents
+    while (pos < window_end) {
+        uint32_t run;
+        uint32_t block = map_block(inode, pos / MESAFS_BLOCK_SIZE, &run);
+        if (!block) break;
+        uint64_t avail = (uint64_t)run * MESAFS_BLOCK_SIZE - pos % MESAFS_BLOCK_SIZE;
+        uint32_t chunk = avail < window_end - pos ? (uint32_t)avail : window_end - pos;
+        BufferCache::prefetch(device, disk_offset(block) + pos % MESAFS_BLOCK_SIZE, chunk);
+        pos += chunk;
+    }
+}
+
+uint32_t MesaFS::write(fs_node* node, uint32_t offset, uint32_t size, uint8_t* buffer) {
+    TRACE(mesafs_write, node->inode, offset, size);
+    MesaFSInode inode;
+    if (size == 0 || !read_inode(node->inode, &inode) || inode.type != MESAFS_TYPE_FILE) return 0;
+
+    uint64_t end = (uint64_t)offset + size;
+    if (end > 0xFFFFFFFF) return 0;
+    if (!grow(&inode, (uint32_t)((end + MESAFS_BLOCK_SIZE - 1) / MESAFS_BLOCK_SIZE))) {
+        write_inode(node->inode, &inode); // Keep whatever did get mapped
+        return 0;
+    }
 
-    return bytes_written;
+    // A gap between the old end and offset reads back as zeros
+    for (uint32_t pos = inode.size; pos < offset; ) {
+        uint32_t chunk = offset - pos < MESAFS_BLOCK_SIZE ? offset - pos : MESAFS_BLOCK_SIZE;
+        if (!file_io(&inode, pos, chunk, zero_block, true)) return 0;
+        pos += chunk;
+    }
+
+    // Partial blocks are patched in the cache; kflushd writes them back
+    if (!file_io(&inode, offset, size, buffer, true)) {
+        write_inode(node->inode, &inode);
+        return 0;
+    }
+    if (end > inode.size) inode.size = (uint32_t)end;
+    write_inode(node->inode, &inode);
+    node->length = inode.size;
+    return size;
 }
 
-fs_node* MesaFS::create_file(const char* name, uint32_t uid, uint32_t gid, uint32_t mode) {
-    for (int i = 0; i < 8; i++) {
-        if (!entries[i].present) {
-            entries[i].present = 1;
-            strcpy(entries[i].name, name);
-            entries[i].lba_start = 100 + (i * 10); // Simple fixed allocation
-            entries[i].length = 0;
-            entries[i].flags = 1; // File
-            entries[i].uid = uid;
-            entries[i].gid = gid;
-            entries[i].mode = mode;
-            memset(entries[i].hmac, 0, 32); // Initialize HMAC
-
-            // Force save updated metadata immediately
-            metadata_valid = true;
-            if (!save_metadata()) {
-                // If save fails, mark as invalid and return null
-                entries[i].present = 0;
-                return 0;
-            }
+void MesaFS::close(fs_node* node) {
+    MesaFSInode inode;
+    if (!read_inode(node->inode, &inode) || inode.type != MESAFS_TYPE_FILE) return;
+    if (trim(&inode)) write_inode(node->inode, &inode);
+}
+
+// True if dir is hash-indexed, with its root block loaded into dx_buf
+bool MesaFS::dx_load_root(const MesaFSInode* dir) {
+    if (dir->size < 2 * MESAFS_BLOCK_SIZE) return false;
+    if (!file_io(dir, 0, MESAFS_BLOCK_SIZE, (uint8_t*)&dx_buf, false)) return false;
+    return dx_buf.magic == MESAFS_DX_MAGIC && dx_buf.count > 0 && dx_buf.count <= MESAFS_DX_LIMIT;
+}
 
-            fs_node* node = (fs_node*)kmalloc(sizeof(fs_node));
-            memset(node, 0, sizeof(fs_node));
-            strcpy(node->name, name);
-            node->inode = i;
-            node->flags = FS_FILE;
-            node->uid = uid;
-            node->gid = gid;
-            node->mask = mode;
-            node->read = &MesaFS::read;
-            node->write = &MesaFS::write;
-            return node;
+// Index slot of the leaf that holds hash: the last one starting at or below it
+uint32_t MesaFS::dx_find(uint32_t hash) {
+    uint32_t lo = 0;
+    uint32_t hi = dx_buf.count - 1;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi + 1) / 2;
+        if (dx_buf.entries[mid].hash <= hash) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+// Turns an empty directory into an index block plus one empty leaf
+bool MesaFS::dx_init(uint32_t dir, MesaFSInode* inode) {
+    if (!grow(inode, 2)) return false;
+    memset(&dx_buf, 0, sizeof(dx_buf));
+    dx_buf.magic = MESAFS_DX_MAGIC;
+    dx_buf.count = 1;
+    dx_buf.entries[0].hash = 0;
+    dx_buf.entries[0].block = 1;
+    if (!file_io(inode, 0, MESAFS_BLOCK_SIZE, (uint8_t*)&dx_buf, true)) return false;
+    if (!file_io(inode, MESAFS_BLOCK_SIZE, MESAFS_BLOCK_SIZE, zero_block, true)) return false;
+    inode->size = 2 * MESAFS_BLOCK_SIZE;
+    return write_inode(dir, inode);
+}
+
+// Splits the full leaf at index slot pos (loaded in dir_buf) at its median
+// hash. The upper half moves to a new block that is entered in the index
+// after pos; equal hashes never straddle leaves. On return dir_buf holds
+// whichever half hash now belongs in, and *leaf is its block.
+bool MesaFS::dx_split(uint32_t dir, MesaFSInode* inode, uint32_t pos, uint32_t hash, uint32_t* leaf) {
+    if (dx_buf.count >= MESAFS_DX_LIMIT) return false;
+
+    uint32_t hashes[DIRENTS_PER_BLOCK];
+    uint32_t sorted[DIRENTS_PER_BLOCK];
+    for (uint32_t i = 0; i < DIRENTS_PER_BLOCK; i++) {
+        hashes[i] = name_hash(dir_buf[i].name, dir_buf[i].name_len);
+        uint32_t j = i;
+        for (; j > 0 && sorted[j - 1] > hashes[i]; j--) sorted[j] = sorted[j - 1];
+        sorted[j] = hashes[i];
+    }
+    uint32_t split = sorted[DIRENTS_PER_BLOCK / 2];
+    for (uint32_t i = DIRENTS_PER_BLOCK / 2; split == sorted[0]; i++) {
+        if (i == DIRENTS_PER_BLOCK) return false; // One hash fills the leaf
+        split = sorted[i];
+    }
+
+    uint32_t new_block = inode->size / MESAFS_BLOCK_SIZE;
+    if (!grow(inode, new_block + 1)) return false;
+    memset(dx_leaf, 0, sizeof(dx_leaf));
+    uint32_t moved = 0;
+    for (uint32_t i = 0; i < DIRENTS_PER_BLOCK; i++) {
+        if (hashes[i] < split) continue;
+        dx_leaf[moved++] = dir_buf[i];
+        memset(&dir_buf[i], 0, sizeof(MesaFSDirent));
+    }
+    uint32_t old_block = dx_buf.entries[pos].block;
+    if (!file_io(inode, old_block * MESAFS_BLOCK_SIZE, MESAFS_BLOCK_SIZE, (uint8_t*)dir_buf, true)) return false;
+    if (!file_io(inode, new_block * MESAFS_BLOCK_SIZE, MESAFS_BLOCK_SIZE, (uint8_t*)dx_leaf, true)) return false;
+    inode->size += MESAFS_BLOCK_SIZE;
+    if (!write_inode(dir, inode)) return false;
+
+    memmove(&dx_buf.entries[pos + 2], &dx_buf.entries[pos + 1], (dx_buf.count - pos - 1) * sizeof(MesaFSDxEntry));
+    dx_buf.entries[pos + 1].hash = split;
+    dx_buf.entries[pos + 1].block = new_block;
+    dx_buf.count++;
+    if (!file_io(inode, 0, MESAFS_BLOCK_SIZE, (uint8_t*)&dx_buf, true)) return false;
+
+    *leaf = old_block;
+    if (hash >= split) {
+        memcpy(dir_buf, dx_leaf, sizeof(dir_buf));
+        *leaf = new_block;
+    }
+    return true;
+}
+
+uint32_t MesaFS::dir_lookup(uint32_t dir, const char* name, uint32_t len) {
+    MesaFSInode inode;
+    if (!read_inode(dir, &inode) || inode.type != MESAFS_TYPE_DIR) return 0;
+
+    // Indexed directories need one leaf; linear ones are scanned whole
+    uint32_t first = 0;
+    uint32_t last = inode.size / MESAFS_BLOCK_SIZE;
+    if (dx_load_root(&inode)) {
+        first = dx_buf.entries[dx_find(name_hash(name, len))].block;
+        last = first + 1;
+    }
+
+    for (uint32_t b = first; b < last; b++) {
+        if (!file_io(&inode, b * MESAFS_BLOCK_SIZE, MESAFS_BLOCK_SIZE, (uint8_t*)dir_buf, false)) return 0;
+        for (uint32_t i = 0; i < DIRENTS_PER_BLOCK; i++) {
+            if (dir_buf[i].inode && dir_buf[i].name_len == len && memcmp(dir_buf[i].name, name, len) == 0) {
+                return dir_buf[i].inode;
+            }
         }
     }
     return 0;
 }
 
+// New directories become indexed on their first entry. Directories written
+// linearly before the index existed keep taking the first free slot and
+// grow a block at a time.
+bool MesaFS::dir_add(uint32_t dir, const char* name, uint32_t ino, uint8_t type) {
+    MesaFSInode inode;
+    if (!read_inode(dir, &inode) || inode.type != MESAFS_TYPE_DIR) return false;
+    if (inode.size == 0 && !dx_init(dir, &inode)) return false;
+
+    uint32_t len = strlen(name);
+    uint32_t slot = 0xFFFFFFFF;
+    if (dx_load_root(&inode)) {
+        uint32_t hash = name_hash(name, len);
+        uint32_t pos = dx_find(hash);
+        uint32_t leaf = dx_buf.entries[pos].block;
+        if (!file_io(&inode, leaf * MESAFS_BLOCK_SIZE, MESAFS_BLOCK_SIZE, (uint8_t*)dir_buf, false)) return false;
+        for (int attempt = 0; attempt < 2 && slot == 0xFFFFFFFF; attempt++) {
+            for (uint32_t i = 0; i < DIRENTS_PER_BLOCK; i++) {
+                if (!dir_buf[i].inode) {
+                    slot = leaf * DIRENTS_PER_BLOCK + i;
+                    break;
+                }
+            }
+            if (slot == 0xFFFFFFFF && (attempt > 0 || !dx_split(dir, &inode, pos, hash, &leaf))) return false;
+        }
+    } else {
+        for (uint32_t b = 0; b < inode.size / MESAFS_BLOCK_SIZE && slot == 0xFFFFFFFF; b++) {
+            if (!file_io(&inode, b * MESAFS_BLOCK_SIZE, MESAFS_BLOCK_SIZE, (uint8_t*)dir_buf, false)) return false;
+            for (uint32_t i = 0; i < DIRENTS_PER_BLOCK; i++) {
+                if (!dir_buf[i].inode) {
+                    slot = b * DIRENTS_PER_BLOCK + i;
+                    break;
+                }
+            }
+        }
+        if (slot == 0xFFFFFFFF) {
+            // Preallocation may already have mapped the block
+            slot = inode.size / MESAFS_BLOCK_SIZE * DIRENTS_PER_BLOCK;
+            if (!grow(&inode, inode.size / MESAFS_BLOCK_SIZE + 1)) return false;
+            if (!file_io(&inode, inode.size, MESAFS_BLOCK_SIZE, zero_block, true)) return false;
+            inode.size += MESAFS_BLOCK_SIZE;
+            if (!write_inode(dir, &inode)) return false;
+        }
+    }
+
+    MesaFSDirent de;
+    memset(&de, 0, sizeof(de));
+    de.inode = ino;
+    de.type = type;
+    de.name_len = len;
+    memcpy(de.name, name, len);
+    return file_io(&inode, slot * MESAFS_DIRENT_SIZE, sizeof(de), (uint8_t*)&de, true);
+}
+
+// Walks every component but the last; returns the directory it names and
+// points leaf at the last component. 0 if a component is missing.
+uint32_t MesaFS::resolve_parent(const char* path, const char** leaf, uint32_t* leaf_len) {
+    uint32_t dir = sb.root_inode;
+    while (*path == '/') path++;
+    for (;;) {
+        const char* end = path;
+        while (*end && *end != '/') end++;
+        const char* next = end;
+        while (*next == '/') next++;
+        if (*next == '\0') {
+            *leaf = path;
+            *leaf_len = end - path;
+            return dir;
+        }
+
+        dir = dir_lookup(dir, path, end - path);
+        if (!dir) return 0;
+        path = next;
+    }
+}
+
+fs_node* MesaFS::create(const char* path, uint16_t type, uint32_t uid, uint32_t gid, uint32_t mode) {
+    if (!bitmap) return 0;
+
+    const char* leaf;
+    uint32_t len;
+    uint32_t parent = resolve_parent(path, &leaf, &len);
+    if (!parent || len == 0 || len > MESAFS_NAME_MAX) return 0;
+    char name[MESAFS_NAME_MAX + 1];
+    memcpy(name, leaf, len);
+    name[len] = '\0';
+
+    MesaFSInode inode;
+    uint32_t ino = dir_lookup(parent, name, len);
+    if (ino) {
+        if (!read_inode(ino, &inode) || inode.type != type) return 0;
+        return make_node(ino, name, &inode);
+    }
+
+    ino = alloc_inode(type, uid, gid, mode);
+    if (!ino) return 0;
+    if (!dir_add(parent, name, ino, type) || !read_inode(ino, &inode)) {
+        memset(&inode, 0, sizeof(inode));
+        write_inode(ino, &inode);
+        sb.free_inodes++;
+        save_superblock();
+        return 0;
+    }
+    // Only once the entry is on disk: a lookup that misses before then
+    // would cache "doesn't exist" again
+    DentryCache::invalidate(name);
+    return make_node(ino, name, &inode);
+}
+
+fs_node* MesaFS::create_file(const char* name, uint32_t uid, uint32_t gid, uint32_t mode) {
+    return create(name, MESAFS_TYPE_FILE, uid, gid, mode);
+}
+
 fs_node* MesaFS::create_dir(const char* name, uint32_t uid, uint32_t gid, uint32_t mode) {
-    for (int i = 0; i < 8; i++) {
-        if (!entries[i].present) {
-            entries[i].present = 1;
-            strcpy(entries[i].name, name);
-            entries[i].lba_start = 0; // Directories don't need blocks in this flat model
-            entries[i].length = 0;
-            entries[i].flags = 2; // Directory
-            entries[i].uid = uid;
-            entries[i].gid = gid;
-            entries[i].mode = mode;
-            memset(entries[i].hmac, 0, 32); // Initialize HMAC
-
-            // Save updated metadata
-            save_metadata();
-
-            fs_node* node = (fs_node*)kmalloc(sizeof(fs_node));
-            memset(node, 0, sizeof(fs_node));
-            strcpy(node->name, name);
-            node->inode = i;
-            node->flags = FS_DIRECTORY;
-            node->uid = uid;
-            node->gid = gid;
-            node->mask = mode;
-            node->readdir = &MesaFS::readdir;
-            node->finddir = &MesaFS::finddir;
-            return node;
+    return create(name, MESAFS_TYPE_DIR, uid, gid, mode);
+}
+
+fs_node* MesaFS::make_node(uint32_t ino, const char* name, const MesaFSInode* inode) {
+    fs_node* node = (fs_node*)kmalloc(sizeof(fs_node));
+    if (!node) return 0;
+    memset(node, 0, sizeof(fs_node));
+    strncpy(node->name, name, sizeof(node->name) - 1);
+    node->refcount = 1; // The caller's; the dentry cache takes its own
+    node->inode = ino;
+    node->uid = inode->uid;
+    node->gid = inode->gid;
+    node->mask = inode->mode;
+    node->length = inode->size;
+    if (inode->type == MESAFS_TYPE_DIR) {
+        node->flags = FS_DIRECTORY;
+        node->readdir = &MesaFS::readdir;
+        node->finddir = &MesaFS::finddir;
+    } else {
+        node->flags = FS_FILE;
+        node->read = &MesaFS::read;
+        node->write = &MesaFS::write;
+        node->close = &MesaFS::close;
+    }
+    return node;
+}
+
+static dirent static_de;
+dirent* MesaFS::readdir(fs_node* node, uint32_t index) {
+    MesaFSInode inode;
+    if (!read_inode(node->inode, &inode) || inode.type != MESAFS_TYPE_DIR) return 0;
+
+    // index counts used slots only; an index block holds none
+    for (uint32_t b = dx_load_root(&inode) ? 1 : 0; b < inode.size / MESAFS_BLOCK_SIZE; b++) {
+        if (!file_io(&inode, b * MESAFS_BLOCK_SIZE, MESAFS_BLOCK_SIZE, (uint8_t*)dir_buf, false)) return 0;
+        for (uint32_t i = 0; i < DIRENTS_PER_BLOCK; i++) {
+            if (!dir_buf[i].inode) continue;
+            if (index-- > 0) continue;
+            memcpy(static_de.name, dir_buf[i].name, dir_buf[i].name_len);
+            static_de.name[dir_buf[i].name_len] = '\0';
+            static_de.ino = dir_buf[i].inode;
+            return &static_de;
         }
     }
     return 0;
 }
 
-bool MesaFS::verify_entry_integrity(MesaFSEntry* entry) {
-    if (!entry->present) return true; // Empty entries are valid
+fs_node* MesaFS::finddir(fs_node* node, const char* name) {
+    uint32_t len = strlen(name);
+    if (len == 0 || len > MESAFS_NAME_MAX) return 0;
+    uint32_t ino = dir_lookup(node->inode, name, len);
+    MesaFSInode inode;
+    if (!ino || !read_inode(ino, &inode)) return 0;
+    return make_node(ino, name, &inode);
+}
+
+bool MesaFS::verify_inode_integrity(uint32_t ino) {
+    MesaFSInode inode;
+    if (!read_inode(ino, &inode)) return false;
 
     // For files with data, verify HMAC
-    if (entry->length > 0 && entry->flags == 1) {
-        // Read the file data and verify HMAC
-        uint32_t start_sector = base_lba + entry->lba_start;
-        uint32_t num_sectors = (entry->length + 511) / 512;
+    if (inode.size > 0 && inode.type == MESAFS_TYPE_FILE) {
         uint8_t file_data[4096]; // Max file size for verification
         uint32_t data_read = 0;
 
-        for (uint32_t i = 0; i < num_sectors && data_read < sizeof(file_data); i++) {
+        while (data_read < inode.size && data_read < sizeof(file_data)) {
             uint8_t sector_buf[512];
-            MesaOS::Drivers::IDEDriver::read_sector(start_sector + i, sector_buf);
+            memset(sector_buf, 0, sizeof(sector_buf));
+            uint32_t to_copy = 512;
+            if (data_read + to_copy > inode.size) to_copy = inode.size - data_read;
+            if (!file_io(&inode, data_read, to_copy, sector_buf, false)) return false;
 
             // Decrypt sector
             if (!Crypto::AuthenticatedAES::decrypt_buffer(sector_buf, 512,
                                                           Crypto::KeyManager::get_master_key(),
-                                                          entry->hmac)) {
+                                                          inode.hmac)) {
                 return false;
             }
 
-            uint32_t to_copy = 512;
-            if (data_read + to_copy > entry->length) to_copy = entry->length - data_read;
             memcpy(file_data + data_read, sector_buf, to_copy);
             data_read += to_copy;
         }
 
         // Verify HMAC over the decrypted data
         return Crypto::HMAC_SHA256::verify(Crypto::KeyManager::get_hmac_key(), 32,
-                                          file_data, entry->length, entry->hmac);
+                                          file_data, data_read, inode.hmac);
     }
 
     return true; // Directories or empty files are considered valid
@@ -4,9 +4,39 @@
 #include <stdint.h>
 #include "vfs.hpp"
 #include "crypto.hpp"
+#include "drivers/block.hpp"
 
 namespace MesaOS::FS {
 
+#define MESAFS_MAGIC            0x5341534D // "MSAF", both versions
+#define MESAFS_VERSION          2
+#define MESAFS_BLOCK_SIZE       4096 // Same as a buffer cache block
+#define MESAFS_INODE_SIZE       128
+#define MESAFS_INODES_PER_BLOCK (MESAFS_BLOCK_SIZE / MESAFS_INODE_SIZE)
+#define MESAFS_DIRECT_EXTENTS   8
+#define MESAFS_INDIRECT_EXTENTS (MESAFS_BLOCK_SIZE / 8)
+#define MESAFS_MAX_EXTENTS      (MESAFS_DIRECT_EXTENTS + MESAFS_INDIRECT_EXTENTS)
+#define MESAFS_DIRENT_SIZE      64
+#define MESAFS_NAME_MAX         57
+#define MESAFS_ROOT_INODE       1
+#define MESAFS_MAX_BLOCKS       0x100000 // 4GB volume; bitmap fits in 32 frames
+#define MESAFS_DX_MAGIC         0x58444D48 // "HMDX"; no inode number is this large
+#define MESAFS_DX_LIMIT         ((MESAFS_BLOCK_SIZE - 8) / 8) // Leaves per directory
+
+#define MESAFS_TYPE_FREE 0
+#define MESAFS_TYPE_FILE 1 // Values match v1 MesaFSEntry::flags
+#define MESAFS_TYPE_DIR  2
+
+// What mount() found at byte 512 of the partition
+enum MesaFSMountResult {
+    MESAFS_MOUNTED,
+    MESAFS_FOUND_V1,  // A v1 header; migrate it
+    MESAFS_BLANK,     // No MesaFS magic at all; safe to format
+    MESAFS_BAD_VOLUME // I/O error, out of memory, or a superblock we can't use
+};
+
+// v1 layout, only read to migrate: this header at sector 1, a flat table of
+// 8 entries after it, file i at sector 100 + i * 10.
 struct MesaFSHeader {
     uint32_t magic;
     uint32_t version;
@@ -27,25 +57,129 @@ struct MesaFSEntry {
     uint8_t hmac[32];  // HMAC for this entry's data
 };
 
+// v2 layout, in 4KB blocks from the start of the partition:
+//   0                 superblock (at byte 512, where the v1 header was)
+//   bitmap_start      free-block bitmap, one bit per block, 1 = used
+//   inode_start       inode table, 32 inodes per block; inode 0 is unused
+//   data_start        file and directory data
+struct MesaFSSuperblock {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_size;
+    uint32_t total_blocks;
+    uint32_t free_blocks;
+    uint32_t inode_count;
+    uint32_t free_inodes;
+    uint32_t bitmap_start;
+    uint32_t bitmap_blocks;
+    uint32_t inode_start;
+    uint32_t inode_blocks;
+    uint32_t data_start;
+    uint32_t root_inode;
+};
+
+// A run of blocks. A file's extents map its blocks in order: the first
+// covers file blocks 0..length-1, the next continues from there.
+struct MesaFSExtent {
+    uint32_t start;
+    uint32_t length;
+};
+
+struct MesaFSInode {
+    uint32_t mode;         // Permission bits
+    uint16_t type;         // MESAFS_TYPE_*
+    uint16_t links;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t size;         // Bytes; whole blocks for directories
+    uint32_t blocks;       // Blocks mapped by the extents
+    uint32_t extent_count;
+    uint32_t indirect;     // Block of further extents once the direct ones run out
+    uint8_t hmac[32];      // HMAC for this file's data
+    MesaFSExtent extents[MESAFS_DIRECT_EXTENTS];
+};
+
+// Directories are arrays of these; inode 0 marks a free slot
+struct MesaFSDirent {
+    uint32_t inode;
+    uint8_t type;
+    uint8_t name_len;
+    char name[MESAFS_NAME_MAX + 1];
+};
+
+// Block 0 of an indexed directory (htree-like, one level). Leaves are listed
+// by the lowest name hash they hold; a name lives in the last leaf whose
+// hash is at or below its own, so lookup reads one leaf of 64 entries.
+struct MesaFSDxEntry {
+    uint32_t hash;
+    uint32_t block; // Directory block number of the leaf
+};
+
+struct MesaFSDxRoot {
+    uint32_t magic; // Where a linear directory's first dirent.inode is
+    uint32_t count;
+    MesaFSDxEntry entries[MESAFS_DX_LIMIT];
+};
+
 class MesaFS {
 public:
     static fs_node* initialize(uint32_t partition_lba);
+    // Paths are relative to the volume root; parent directories must exist.
+    // Creating an existing file returns it. Returns a reference (put_node).
     static fs_node* create_file(const char* name, uint32_t uid = 0, uint32_t gid = 0, uint32_t mode = 0644);
     static fs_node* create_dir(const char* name, uint32_t uid = 0, uint32_t gid = 0, uint32_t mode = 0755);
     static uint32_t read(fs_node* node, uint32_t offset, uint32_t size, uint8_t* buffer);
     static uint32_t write(fs_node* node, uint32_t offset, uint32_t size, uint8_t* buffer);
+    static void close(fs_node* node); // Writer done: give back preallocated blocks
     static dirent* readdir(fs_node* node, uint32_t index);
     static fs_node* finddir(fs_node* node, const char* name);
     static bool check_permission(fs_node* node, uint32_t uid, uint32_t required_perm);
+    static const MesaFSSuperblock* get_superblock();
 
 private:
     static uint32_t base_lba;
+    static MesaOS::Drivers::BlockDevice* device; // Default block device at initialize()
     static fs_node* root_node;
-    static bool metadata_valid; // Track if metadata integrity is verified
+    static MesaFSSuperblock sb;
+    static uint8_t* bitmap;      // Whole free-block bitmap, in PMM frames
+    static uint32_t alloc_hint;  // Where the next unguided block search starts
+    static uint32_t inode_hint;
+
+    static MesaFSMountResult mount();
+    static bool format(uint32_t total_blocks);
+    static bool migrate_v1();
+    static uint32_t volume_blocks();
+
+    static uint64_t disk_offset(uint32_t block);
+    static bool read_block_bytes(uint32_t block, uint32_t offset, uint32_t size, void* buffer);
+    static bool write_block_bytes(uint32_t block, uint32_t offset, uint32_t size, const void* buffer);
+    static bool save_superblock();
+    static bool read_inode(uint32_t ino, MesaFSInode* inode);
+    static bool write_inode(uint32_t ino, const MesaFSInode* inode);
+    static uint32_t alloc_inode(uint16_t type, uint32_t uid, uint32_t gid, uint32_t mode);
+
+    static bool block_used(uint32_t block);
+    static void mark_blocks(uint32_t start, uint32_t count, bool used);
+    static uint32_t alloc_blocks(uint32_t goal, uint32_t want, uint32_t* got);
+    static bool get_extent(const MesaFSInode* inode, uint32_t index, MesaFSExtent* ext);
+    static bool set_extent(MesaFSInode* inode, uint32_t index, const MesaFSExtent* ext);
+    static uint32_t map_block(const MesaFSInode* inode, uint32_t file_block, uint32_t* run);
+    static bool grow(MesaFSInode* inode, uint32_t blocks);
+    static bool trim(MesaFSInode* inode);
+    static bool file_io(const MesaFSInode* inode, uint32_t offset, uint32_t size, uint8_t* buffer, bool write);
+
+    static bool dx_load_root(const MesaFSInode* dir);
+    static uint32_t dx_find(uint32_t hash);
+    static bool dx_init(uint32_t dir, MesaFSInode* inode);
+    static bool dx_split(uint32_t dir, MesaFSInode* inode, uint32_t pos, uint32_t hash, uint32_t* leaf);
+    static uint32_t dir_lookup(uint32_t dir, const char* name, uint32_t len);
+    static bool dir_add(uint32_t dir, const char* name, uint32_t ino, uint8_t type);
+    static uint32_t resolve_parent(const char* path, const char** leaf, uint32_t* leaf_len);
+    static fs_node* create(const char* path, uint16_t type, uint32_t uid, uint32_t gid, uint32_t mode);
+    static fs_node* make_node(uint32_t ino, const char* name, const MesaFSInode* inode);
 
-    static bool load_metadata();
-    static bool save_metadata();
-    static bool verify_entry_integrity(MesaFSEntry* entry);
+    static void readahead(fs_node* node, const MesaFSInode* inode, uint32_t offset, uint32_t size);
+    static bool verify_inode_integrity(uint32_t ino);
 };
 
 } // namespace MesaOS::FS
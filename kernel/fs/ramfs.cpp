@@ -1,4 +1,5 @@
 #include "ramfs.hpp"
+#include "dcache.hpp"
 #include <string.h>
 #include "memory/pmm.hpp"
 #include "memory/kheap.hpp"
@@ -6,9 +7,15 @@
 namespace MesaOS::FS {
 
 fs_node* RAMFS::root = 0;
-fs_node* RAMFS::files[64];
-uint8_t* RAMFS::file_contents[64];
+fs_node* RAMFS::files[RAMFS_MAX_FILES];
+uint8_t* RAMFS::file_contents[RAMFS_MAX_FILES];
 uint32_t RAMFS::file_count = 0;
+fs_node* RAMFS::name_table[RAMFS_HASH_SIZE];
+uint32_t RAMFS::tombstones = 0;
+
+// Marks a removed name_table slot; probing continues past it
+#define RAMFS_TOMBSTONE ((fs_node*)1)
+#define RAMFS_MAX_TOMBSTONES (RAMFS_HASH_SIZE / 4) // Then the table is rebuilt
 
 static struct dirent static_dirent;
 
@@ -39,12 +46,61 @@ dirent* RAMFS::readdir(fs_node* node, uint32_t index) {
 
 fs_node* RAMFS::finddir(fs_node* node, const char* name) {
     (void)node;
-    for (uint32_t i = 0; i < file_count; i++) {
-        if (strcmp(name, files[i]->name) == 0) return files[i];
+    uint32_t slot = name_hash(name, strlen(name)) % RAMFS_HASH_SIZE;
+    for (uint32_t probe = 0; probe < RAMFS_HASH_SIZE; probe++) {
+        fs_node* entry = name_table[slot];
+        if (!entry) return 0;
+        if (entry != RAMFS_TOMBSTONE && strcmp(name, entry->name) == 0) return entry;
+        slot = (slot + 1) % RAMFS_HASH_SIZE;
     }
     return 0;
 }
 
+// Linear probing from the name's hash. The probe runs to an empty slot to
+// make sure the name isn't there yet, then takes the first tombstone it
+// passed. Live names and tombstones together stay below the table size,
+// so an empty slot always ends the probe.
+bool RAMFS::hash_insert(fs_node* node) {
+    uint32_t slot = name_hash(node->name, strlen(node->name)) % RAMFS_HASH_SIZE;
+    fs_node** reuse = 0;
+    for (uint32_t probe = 0; probe < RAMFS_HASH_SIZE && name_table[slot]; probe++) {
+        fs_node* entry = name_table[slot];
+        if (entry == RAMFS_TOMBSTONE) {
+            if (!reuse) reuse = &name_table[slot];
+        } else if (strcmp(node->name, entry->name) == 0) {
+            return false;
+        }
+        slot = (slot + 1) % RAMFS_HASH_SIZE;
+    }
+    if (reuse) {
+        *reuse = node;
+        tombstones--;
+    } else {
+        name_table[slot] = node;
+    }
+    return true;
+}
+
+void RAMFS::hash_remove(fs_node* node) {
+    uint32_t slot = name_hash(node->name, strlen(node->name)) % RAMFS_HASH_SIZE;
+    for (uint32_t probe = 0; probe < RAMFS_HASH_SIZE && name_table[slot]; probe++) {
+        if (name_table[slot] == node) {
+            name_table[slot] = RAMFS_TOMBSTONE;
+            tombstones++;
+            return;
+        }
+        slot = (slot + 1) % RAMFS_HASH_SIZE;
+    }
+}
+
+// Reinserts every live file, clearing the tombstones that make misses
+// probe further
+void RAMFS::hash_rebuild() {
+    memset(name_table, 0, sizeof(name_table));
+    tombstones = 0;
+    for (uint32_t i = 0; i < file_count; i++) hash_insert(files[i]);
+}
+
 fs_node* RAMFS::initialize() {
     root = (fs_node*)kmalloc(sizeof(fs_node));
     memset(root, 0, sizeof(fs_node));
@@ -54,11 +110,13 @@ fs_node* RAMFS::initialize() {
     root->finddir = &RAMFS::finddir;
     
     file_count = 0;
+    memset(name_table, 0, sizeof(name_table));
+    tombstones = 0;
     return root;
 }
 
 fs_node* RAMFS::create_file(const char* name, const char* content) {
-    if (file_count >= 64) return 0;
+    if (file_count >= RAMFS_MAX_FILES || finddir(root, name)) return 0;
     
     fs_node* node = (fs_node*)kmalloc(sizeof(fs_node));
     memset(node, 0, sizeof(fs_node));
@@ -80,12 +138,14 @@ fs_node* RAMFS::create_file(const char* name, const char* content) {
     file_contents[file_count] = buffer;
     files[file_count] = node;
     file_count++;
+    hash_insert(node);
+    DentryCache::invalidate(name);
     
     return node;
 }
 
 fs_node* RAMFS::create_dir(const char* name) {
-    if (file_count >= 64) return 0;
+    if (file_count >= RAMFS_MAX_FILES || finddir(root, name)) return 0;
     fs_node* node = (fs_node*)kmalloc(sizeof(fs_node));
     memset(node, 0, sizeof(fs_node));
     strcpy(node->name, name);
@@ -93,18 +153,25 @@ fs_node* RAMFS::create_dir(const char* name) {
     node->readdir = &RAMFS::readdir;
     node->finddir = &RAMFS::finddir;
     files[file_count++] = node;
+    hash_insert(node);
+    DentryCache::invalidate(name);
     return node;
 }
 
 void RAMFS::mount(fs_node* node) {
-    if (file_count < 64) {
+    if (file_count < RAMFS_MAX_FILES && hash_insert(node)) {
         files[file_count++] = node;
+        DentryCache::invalidate(node->name);
     }
 }
 
 bool RAMFS::delete_file(const char* name) {
+    fs_node* node = finddir(root, name);
+    if (!node) return false;
+    hash_remove(node);
+    DentryCache::invalidate(name);
     for (uint32_t i = 0; i < file_count; i++) {
-        if (strcmp(name, files[i]->name) == 0) {
+        if (files[i] == node) {
             // Memory is not actually freed in this simple PMM-based RAMFS
             // We'd just shift the array for now
             for (uint32_t j = i; j < file_count - 1; j++) {
@@ -112,6 +179,7 @@ bool RAMFS::delete_file(const char* name) {
                 file_contents[j] = file_contents[j+1];
             }
             file_count--;
+            if (tombstones > RAMFS_MAX_TOMBSTONES) hash_rebuild();
             return true;
         }
     }
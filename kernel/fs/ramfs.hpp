@@ -5,6 +5,9 @@
 
 namespace MesaOS::FS {
 
+#define RAMFS_MAX_FILES 64
+#define RAMFS_HASH_SIZE 128 // Open addressing; twice the file limit keeps probes short
+
 class RAMFS {
 public:
     static fs_node* initialize();
@@ -15,14 +18,19 @@ public:
 
 private:
     static fs_node* root;
-    static fs_node* files[64];
-    static uint8_t* file_contents[64];
+    static fs_node* files[RAMFS_MAX_FILES];
+    static uint8_t* file_contents[RAMFS_MAX_FILES];
     static uint32_t file_count;
+    static fs_node* name_table[RAMFS_HASH_SIZE];
+    static uint32_t tombstones;
 
     static uint32_t read(fs_node* node, uint32_t offset, uint32_t size, uint8_t* buffer);
     static uint32_t write(fs_node* node, uint32_t offset, uint32_t size, uint8_t* buffer);
     static dirent* readdir(fs_node* node, uint32_t index);
     static fs_node* finddir(fs_node* node, const char* name);
+    static bool hash_insert(fs_node* node);
+    static void hash_remove(fs_node* node);
+    static void hash_rebuild();
 };
 
 } // namespace MesaOS::FS
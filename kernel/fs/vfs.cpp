@@ -1,10 +1,16 @@
 #include "vfs.hpp"
+#include "arch/i386/cpu.hpp"
+#include "dcache.hpp"
+#include "memory/kheap.hpp"
 #include <string.h>
 
 namespace MesaOS::FS {
 
 fs_node *fs_root = 0;
 
+using MesaOS::Arch::x86::save_flags_cli;
+using MesaOS::Arch::x86::restore_flags;
+
 uint32_t read_fs(fs_node *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
     if (node->read != 0)
         return node->read(node, offset, size, buffer);
@@ -39,36 +45,67 @@ struct dirent *readdir_fs(fs_node *node, uint32_t index) {
 
 fs_node *finddir_fs(fs_node *node, const char *name) {
     if ((node->flags & 0x07) == FS_DIRECTORY && node->finddir != 0)
-        return node->finddir(node, name);
+        return DentryCache::lookup(node, name);
     else
         return 0;
 }
 
-fs_node *find_path_fs(fs_node *root, const char *path) {
-    if (!path || path[0] == '\0') return root;
-    if (strcmp(path, "/") == 0) return root;
+fs_node *get_node(fs_node *node) {
+    if (node && node->refcount) {
+        uint32_t flags = save_flags_cli();
+        node->refcount++;
+        restore_flags(flags);
+    }
+    return node;
+}
 
-    // Skip leading slash
-    const char* p = path;
-    if (p[0] == '/') p++;
+void put_node(fs_node *node) {
+    if (!node || !node->refcount) return;
+    uint32_t flags = save_flags_cli();
+    bool last = --node->refcount == 0;
+    restore_flags(flags);
+    if (!last) return;
+    close_fs(node); // In case its last user wrote without closing
+    kfree(node);
+}
 
-    char name[32];
-    uint32_t i = 0;
-    while (p[i] != '/' && p[i] != '\0' && i < 31) {
-        name[i] = p[i];
-        i++;
+uint32_t name_hash(const char *name, uint32_t len) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
     }
-    name[i] = '\0';
+    return hash;
+}
+
+fs_node *find_path_fs(fs_node *root, const char *path) {
+    fs_node* node = get_node(root);
+    if (!path) return node;
+
+    // One dentry cache lookup per component
+    const char* p = path;
+    while (node) {
+        while (*p == '/') p++;
+        if (*p == '\0') break;
 
-    fs_node* next = finddir_fs(root, name);
-    if (!next) return 0;
+        char name[128];
+        uint32_t i = 0;
+        while (p[i] != '/' && p[i] != '\0') {
+            if (i == sizeof(name) - 1) {
+                put_node(node);
+                return 0;
+            }
+            name[i] = p[i];
+            i++;
+        }
+        name[i] = '\0';
+        p += i;
 
-    if (p[i] == '/') {
-        // Recurse for remaining path
-        return find_path_fs(next, p + i + 1);
+        fs_node* next = finddir_fs(node, name);
+        put_node(node);
+        node = next;
     }
-    
-    return next;
+    return node;
 }
 
 } // namespace MesaOS::FS
@@ -25,6 +25,14 @@ typedef void (*close_type_t)(struct fs_node*);
 typedef struct dirent * (*readdir_type_t)(struct fs_node*, uint32_t);
 typedef struct fs_node * (*finddir_type_t)(struct fs_node*, const char *name);
 
+// Sequential read-ahead state of one open node (see MesaFS::read)
+struct file_ra_state {
+    uint32_t start;      // File offset of the current window
+    uint32_t size;       // Window length; 0 while access looks random
+    uint32_t async_size; // Tail of the window whose first read queues the next
+    uint32_t prev_end;   // Where the previous read stopped
+};
+
 struct fs_node {
     char name[128];
     uint32_t mask;
@@ -41,6 +49,8 @@ struct fs_node {
     readdir_type_t readdir;
     finddir_type_t finddir;
     struct fs_node *ptr; // Used by mountpoints and symlinks
+    struct file_ra_state ra;
+    uint32_t refcount; // 0: owned by its filesystem for good; else kfree'd at the last put_node
 };
 
 struct dirent {
@@ -56,7 +66,12 @@ void open_fs(fs_node *node, uint8_t read, uint8_t write);
 void close_fs(fs_node *node);
 struct dirent *readdir_fs(fs_node *node, uint32_t index);
 fs_node *finddir_fs(fs_node *node, const char *name);
+// finddir_fs and find_path_fs return a reference; drop it with put_node,
+// after close_fs if it was written. The last put_node closes it as well.
 fs_node *find_path_fs(fs_node *root, const char *path);
+fs_node *get_node(fs_node *node);
+void put_node(fs_node *node);
+uint32_t name_hash(const char *name, uint32_t len); // FNV-1a, for directory indexes
 
 } // namespace MesaOS::FS
 
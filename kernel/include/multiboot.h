@@ -5,6 +5,9 @@
 
 #define MULTIBOOT_BOOTLOADER_MAGIC 0x2BADB002
 
+#define MULTIBOOT_INFO_FRAMEBUFFER_INFO 0x00001000
+#define MULTIBOOT_FRAMEBUFFER_TYPE_RGB  1
+
 struct multiboot_info {
     uint32_t flags;
     uint32_t mem_lower;
@@ -30,6 +33,20 @@ struct multiboot_info {
     uint16_t vbe_interface_seg;
     uint16_t vbe_interface_off;
     uint16_t vbe_interface_len;
+
+    // Valid when flags has MULTIBOOT_INFO_FRAMEBUFFER_INFO
+    uint64_t framebuffer_addr;
+    uint32_t framebuffer_pitch;
+    uint32_t framebuffer_width;
+    uint32_t framebuffer_height;
+    uint8_t framebuffer_bpp;
+    uint8_t framebuffer_type;
+    uint8_t framebuffer_red_position;
+    uint8_t framebuffer_red_size;
+    uint8_t framebuffer_green_position;
+    uint8_t framebuffer_green_size;
+    uint8_t framebuffer_blue_position;
+    uint8_t framebuffer_blue_size;
 } __attribute__((packed));
 
 #endif
@@ -1,8 +1,12 @@
 #include "drivers/vga.hpp"
 #include "arch/i386/gdt.hpp"
 #include "arch/i386/idt.hpp"
+#include "arch/i386/apic.hpp"
+#include "arch/i386/acpi.hpp"
 #include "drivers/keyboard.hpp"
 #include "drivers/pit.hpp"
+#include "drivers/serial.hpp"
+#include "drivers/framebuffer.hpp"
 #include "shell.hpp"
 #include "multiboot.h"
 #include "memory/pmm.hpp"
@@ -12,28 +16,62 @@
 #include "fs/ramfs.hpp"
 #include "fs/mbr.hpp"
 #include "fs/mesafs.hpp"
+#include "fs/bcache.hpp"
+#include "drivers/ide.hpp"
+#include "drivers/ahci.hpp"
+#include "drivers/virtio_blk.hpp"
+#include "drivers/block.hpp"
 #include "memory/paging.hpp"
 #include "drivers/pci.hpp"
 #include "drivers/rtl8139.hpp"
 #include "drivers/pcnet.hpp"
 #include "scheduler.hpp"
+#include "syscall.hpp"
+#include "timer.hpp"
+#include "clock.hpp"
+#include "logging.hpp"
 
 extern uint32_t kernel_end;
 
 void shell_entry() {
-    MesaOS::System::Shell::initialize();
-    for(;;);
+    MesaOS::System::Shell::run();
 }
 
 extern "C" void kernel_main(uint32_t magic, multiboot_info* mbt) {
-    (void)magic;
-    (void)mbt;
     MesaOS::Drivers::VGADriver vga;
     vga.initialize();
 
     vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_CYAN, MesaOS::Drivers::VGAColor::BLACK));
     vga.write_string("Welcome to MesaOS v0.3 'Persist'\n\n");
     
+    vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::WHITE, MesaOS::Drivers::VGAColor::BLACK));
+    vga.write_string("Initializing Framebuffer... ");
+    if (MesaOS::Drivers::Framebuffer::initialize(magic, mbt)) {
+        char num[16];
+        MesaOS::Drivers::VGADriver::redraw();
+        vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_GREEN, MesaOS::Drivers::VGAColor::BLACK));
+        vga.write_string("OK (");
+        vga.write_string(itoa(MesaOS::Drivers::Framebuffer::get_width(), num, 10));
+        vga.write_string("x");
+        vga.write_string(itoa(MesaOS::Drivers::Framebuffer::get_height(), num, 10));
+        vga.write_string("x");
+        vga.write_string(itoa(MesaOS::Drivers::Framebuffer::get_bpp(), num, 10));
+        vga.write_string(")\n");
+    } else {
+        vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_BROWN, MesaOS::Drivers::VGAColor::BLACK));
+        vga.write_string("Not available (VGA text mode)\n");
+    }
+
+    vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::WHITE, MesaOS::Drivers::VGAColor::BLACK));
+    vga.write_string("Initializing Serial... ");
+    if (MesaOS::Drivers::Serial::initialize()) {
+        vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_GREEN, MesaOS::Drivers::VGAColor::BLACK));
+        vga.write_string("OK (COM1 115200)\n");
+    } else {
+        vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_BROWN, MesaOS::Drivers::VGAColor::BLACK));
+        vga.write_string("Not present\n");
+    }
+
     vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::WHITE, MesaOS::Drivers::VGAColor::BLACK));
     vga.write_string("Initializing GDT... ");
     MesaOS::Arch::x86::GDT::initialize();
@@ -46,6 +84,12 @@ extern "C" void kernel_main(uint32_t magic, multiboot_info* mbt) {
     vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_GREEN, MesaOS::Drivers::VGAColor::BLACK));
     vga.write_string("OK\n");
 
+    vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::WHITE, MesaOS::Drivers::VGAColor::BLACK));
+    vga.write_string("Initializing Syscalls... ");
+    MesaOS::System::Syscall::initialize();
+    vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_GREEN, MesaOS::Drivers::VGAColor::BLACK));
+    vga.write_string(MesaOS::System::Syscall::has_fast_path() ? "OK (SYSENTER)\n" : "OK (INT 0x80 only)\n");
+
     vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::WHITE, MesaOS::Drivers::VGAColor::BLACK));
     vga.write_string("Initializing PMM... ");
     // Reserve roughly 128MB or total memory
@@ -67,15 +111,29 @@ extern "C" void kernel_main(uint32_t magic, multiboot_info* mbt) {
     // PMM bitmap size is mem_size / 32768 bytes. For 128MB it's ~4KB.
     uint32_t heap_start = (uint32_t)&kernel_end + (mem_size / 32 / 8) + 4096;
     MesaOS::Memory::KHeap::initialize(heap_start, 4 * 1024 * 1024);
+    MesaOS::Drivers::VGADriver::set_scrollback_lines(MesaOS::Drivers::VGADriver::DEFAULT_SCROLLBACK_LINES);
     vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_GREEN, MesaOS::Drivers::VGAColor::BLACK));
     vga.write_string("OK\n");
 
     vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::WHITE, MesaOS::Drivers::VGAColor::BLACK));
     vga.write_string("Initializing Paging... ");
     MesaOS::Memory::Paging::initialize();
+    MesaOS::Drivers::Framebuffer::map();
     vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_GREEN, MesaOS::Drivers::VGAColor::BLACK));
     vga.write_string("OK\n");
 
+    vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::WHITE, MesaOS::Drivers::VGAColor::BLACK));
+    vga.write_string("Initializing APIC... ");
+    MesaOS::Arch::x86::ACPI::initialize();
+    if (MesaOS::Arch::x86::LocalAPIC::initialize()) {
+        vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_GREEN, MesaOS::Drivers::VGAColor::BLACK));
+        if (MesaOS::Arch::x86::IOAPIC::initialize()) vga.write_string("OK (IOAPIC)\n");
+        else vga.write_string("OK (Local APIC + 8259 PIC)\n");
+    } else {
+        vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_BROWN, MesaOS::Drivers::VGAColor::BLACK));
+        vga.write_string("Not present (8259 PIC, no MSI)\n");
+    }
+
     vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::WHITE, MesaOS::Drivers::VGAColor::BLACK));
     vga.write_string("Initializing Scheduler... ");
     MesaOS::System::Scheduler::initialize();
@@ -90,10 +148,25 @@ extern "C" void kernel_main(uint32_t magic, multiboot_info* mbt) {
 
     vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::WHITE, MesaOS::Drivers::VGAColor::BLACK));
     vga.write_string("Initializing Timer... ");
+    MesaOS::System::Timer::initialize();
     MesaOS::Drivers::PIT::initialize(100); // 100Hz
     vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_GREEN, MesaOS::Drivers::VGAColor::BLACK));
     vga.write_string("OK\n");
 
+    vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::WHITE, MesaOS::Drivers::VGAColor::BLACK));
+    vga.write_string("Calibrating TSC... ");
+    MesaOS::System::Clock::initialize();
+    if (MesaOS::System::Clock::is_calibrated()) {
+        char mhz[16];
+        vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_GREEN, MesaOS::Drivers::VGAColor::BLACK));
+        vga.write_string("OK (");
+        vga.write_string(itoa((uint32_t)(MesaOS::System::Clock::get_tsc_hz() / 1000000), mhz, 10));
+        vga.write_string(MesaOS::System::Clock::is_invariant() ? " MHz, invariant)\n" : " MHz)\n");
+    } else {
+        vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_BROWN, MesaOS::Drivers::VGAColor::BLACK));
+        vga.write_string("Failed (using PIT ticks)\n");
+    }
+
     vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::WHITE, MesaOS::Drivers::VGAColor::BLACK));
     vga.write_string("Enabling Interrupts... ");
     asm volatile("sti");
@@ -109,21 +182,91 @@ extern "C" void kernel_main(uint32_t magic, multiboot_info* mbt) {
 
     vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::WHITE, MesaOS::Drivers::VGAColor::BLACK));
     vga.write_string("Initializing Disk Drive... ");
+    // The IDE driver looks up its bus-master controller on the PCI bus
+    MesaOS::Drivers::PCIDriver::scan();
     MesaOS::FS::PartitionManager::initialize();
     vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_GREEN, MesaOS::Drivers::VGAColor::BLACK));
-    vga.write_string("OK\n");
+    vga.write_string(MesaOS::Drivers::IDEDriver::dma_enabled() ? "OK (DMA)\n" : "OK\n");
+
+    vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::WHITE, MesaOS::Drivers::VGAColor::BLACK));
+    vga.write_string("Initializing AHCI... ");
+    bool ahci_found = false;
+    for (int i = 0; i < MesaOS::Drivers::PCIDriver::get_device_count() && !ahci_found; i++) {
+        MesaOS::Drivers::PCIDevice& dev = MesaOS::Drivers::PCIDriver::get_devices()[i];
+        if (dev.class_id == 0x01 && dev.subclass_id == 0x06) {
+            ahci_found = MesaOS::Drivers::AHCIDriver::initialize(&dev);
+        }
+    }
+    if (ahci_found) {
+        char num[16];
+        vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_GREEN, MesaOS::Drivers::VGAColor::BLACK));
+        vga.write_string("OK (port ");
+        vga.write_string(itoa(MesaOS::Drivers::AHCIDriver::get_port(), num, 10));
+        if (MesaOS::Drivers::AHCIDriver::ncq_enabled()) {
+            vga.write_string(", NCQ depth ");
+            vga.write_string(itoa(MesaOS::Drivers::AHCIDriver::get_queue_depth(), num, 10));
+        }
+        vga.write_string(")\n");
+    } else {
+        vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_BROWN, MesaOS::Drivers::VGAColor::BLACK));
+        vga.write_string("Not present\n");
+    }
+
+    vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::WHITE, MesaOS::Drivers::VGAColor::BLACK));
+    vga.write_string("Initializing virtio-blk... ");
+    bool virtio_found = false;
+    for (int i = 0; i < MesaOS::Drivers::PCIDriver::get_device_count() && !virtio_found; i++) {
+        MesaOS::Drivers::PCIDevice& dev = MesaOS::Drivers::PCIDriver::get_devices()[i];
+        if (dev.vendor_id == 0x1AF4 && dev.device_id == 0x1001) {
+            virtio_found = MesaOS::Drivers::VirtioBlkDriver::initialize(&dev);
+        }
+    }
+    if (virtio_found) {
+        char num[24];
+        vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_GREEN, MesaOS::Drivers::VGAColor::BLACK));
+        vga.write_string("OK (");
+        vga.write_string(ulltoa(MesaOS::Drivers::VirtioBlkDriver::get_sector_count() / 2048, num, 10));
+        vga.write_string(" MB, queue ");
+        vga.write_string(itoa(MesaOS::Drivers::VirtioBlkDriver::get_queue_size(), num, 10));
+        vga.write_string(MesaOS::Drivers::VirtioBlkDriver::has_indirect() ? ", indirect)\n" : ")\n");
+    } else {
+        vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_BROWN, MesaOS::Drivers::VGAColor::BLACK));
+        vga.write_string("Not present\n");
+    }
+
+    vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::WHITE, MesaOS::Drivers::VGAColor::BLACK));
+    vga.write_string("Initializing Buffer Cache... ");
+    if (MesaOS::FS::BufferCache::initialize()) {
+        char num[16];
+        vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_GREEN, MesaOS::Drivers::VGAColor::BLACK));
+        vga.write_string("OK (");
+        vga.write_string(itoa(MesaOS::FS::BufferCache::get_stats()->buffers * 4, num, 10));
+        vga.write_string(" KB)\n");
+    } else {
+        vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_BROWN, MesaOS::Drivers::VGAColor::BLACK));
+        vga.write_string("Failed\n");
+    }
 
     vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::WHITE, MesaOS::Drivers::VGAColor::BLACK));
     vga.write_string("Mounting MesaFS on /disk... ");
-    // Mounting on partition 1 (LBA 2048)
+    // Fastest disk found wins; mounting on partition 1 (LBA 2048)
+    MesaOS::Drivers::BlockDevice* root_disk = MesaOS::Drivers::BlockLayer::find("vda");
+    if (!root_disk) root_disk = MesaOS::Drivers::BlockLayer::find("sda");
+    if (!root_disk) root_disk = MesaOS::Drivers::BlockLayer::find("hda");
+    MesaOS::Drivers::BlockLayer::set_default(root_disk);
     MesaOS::FS::fs_node* disk_node = MesaOS::FS::MesaFS::initialize(2048);
     MesaOS::FS::RAMFS::mount(disk_node);
     vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::LIGHT_GREEN, MesaOS::Drivers::VGAColor::BLACK));
-    vga.write_string("OK\n\n");
+    if (root_disk) {
+        vga.write_string("OK (");
+        vga.write_string(root_disk->name);
+        vga.write_string(")\n\n");
+    } else {
+        vga.write_string("OK\n\n");
+    }
 
     vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::WHITE, MesaOS::Drivers::VGAColor::BLACK));
     vga.write_string("Initializing Networking... ");
-    MesaOS::Drivers::PCIDriver::scan();
     int net_found = 0;
     char b[16];
     for(int i = 0; i < MesaOS::Drivers::PCIDriver::get_device_count(); i++) {
@@ -160,6 +303,9 @@ extern "C" void kernel_main(uint32_t magic, multiboot_info* mbt) {
     vga.write_string("  MesaOS v0.3 - Hybrid RAM/Disk Kernel\n");
     vga.write_string("------------------------------------------\n");
 
+    MesaOS::System::Logging::start_writer();
+    MesaOS::Drivers::BlockLayer::start_worker();
+    MesaOS::FS::BufferCache::start_flusher();
     MesaOS::System::Scheduler::add_process("shell", shell_entry);
 
     for(;;) {
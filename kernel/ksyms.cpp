@@ -0,0 +1,28 @@
+#include "ksyms.hpp"
+
+extern "C" uint32_t ksyms_count;
+extern "C" MesaOS::System::KernelSymbol ksyms_table[];
+extern "C" char __text_end[]; // linker.ld
+
+namespace MesaOS::System {
+
+uint32_t KernelSymbols::count() {
+    return ksyms_count;
+}
+
+const KernelSymbol* KernelSymbols::lookup(uint32_t addr, uint32_t* offset) {
+    if (ksyms_count == 0 || addr < ksyms_table[0].address || addr >= (uint32_t)__text_end) return 0;
+
+    // Last entry whose address is <= addr
+    uint32_t low = 0, high = ksyms_count;
+    while (high - low > 1) {
+        uint32_t mid = (low + high) / 2;
+        if (ksyms_table[mid].address <= addr) low = mid;
+        else high = mid;
+    }
+
+    if (offset) *offset = addr - ksyms_table[low].address;
+    return &ksyms_table[low];
+}
+
+} // namespace MesaOS::System
@@ -0,0 +1,24 @@
+#ifndef KSYMS_HPP
+#define KSYMS_HPP
+
+#include <stdint.h>
+
+namespace MesaOS::System {
+
+// One entry of the table generated by scripts/gen_ksyms.sh, sorted by address
+struct KernelSymbol {
+    uint32_t address;
+    const char* name;
+};
+
+class KernelSymbols {
+public:
+    // Symbol containing addr, or 0 if it is outside the kernel text.
+    // *offset receives addr minus the symbol start.
+    static const KernelSymbol* lookup(uint32_t addr, uint32_t* offset = 0);
+    static uint32_t count();
+};
+
+} // namespace MesaOS::System
+
+#endif
@@ -0,0 +1,8 @@
+# Empty symbol table for the first link pass; see scripts/gen_ksyms.sh
+.section .ksyms, "a"
+.align 4
+.global ksyms_count
+ksyms_count:
+    .long 0
+.global ksyms_table
+ksyms_table:
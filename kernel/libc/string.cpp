@@ -1,27 +1,60 @@
 #include <string.h>
+#include <stdint.h>
+
+// Below this size the setup of the dword path costs more than it saves
+#define STRING_SMALL_COPY 16
+
+typedef uint32_t __attribute__((may_alias)) word_alias_t;
 
 extern "C" {
 
+// Bulk routines use the x86 string instructions and rely on DF=0, which the
+// interrupt and syscall entry stubs guarantee. The destination is aligned to
+// 4 bytes first; unaligned source loads are cheap, split stores are not.
 void* memset(void* bufptr, int value, size_t size) {
-	unsigned char* buf = (unsigned char*) bufptr;
-	for (size_t i = 0; i < size; i++)
-		buf[i] = (unsigned char) value;
+	void* dst = bufptr;
+	if (size >= STRING_SMALL_COPY) {
+		size_t head = (0 - (uintptr_t)dst) & 3;
+		uint32_t pattern = (uint8_t)value * 0x01010101u;
+		size -= head;
+		size_t words = size >> 2;
+		size &= 3;
+		asm volatile("rep stosb" : "+D"(dst), "+c"(head) : "a"(pattern) : "memory");
+		asm volatile("rep stosl" : "+D"(dst), "+c"(words) : "a"(pattern) : "memory");
+	}
+	asm volatile("rep stosb" : "+D"(dst), "+c"(size) : "a"(value) : "memory");
 	return bufptr;
 }
 
 void* memcpy(void* dstptr, const void* srcptr, size_t size) {
-	unsigned char* dst = (unsigned char*) dstptr;
-	const unsigned char* src = (const unsigned char*) srcptr;
-	for (size_t i = 0; i < size; i++)
-		dst[i] = src[i];
+	void* dst = dstptr;
+	const void* src = srcptr;
+	if (size >= STRING_SMALL_COPY) {
+		size_t head = (0 - (uintptr_t)dst) & 3;
+		size -= head;
+		size_t words = size >> 2;
+		size &= 3;
+		asm volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(head) : : "memory");
+		asm volatile("rep movsl" : "+D"(dst), "+S"(src), "+c"(words) : : "memory");
+	}
+	asm volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(size) : : "memory");
 	return dstptr;
 }
 
+// Word at a time once aligned: a dword holds a zero byte iff
+// (v - 0x01010101) & ~v & 0x80808080 is non-zero. Aligned loads never cross
+// into the next page, so reading past the terminator is safe.
 size_t strlen(const char* str) {
-	size_t len = 0;
-	while (str[len])
-		len++;
-	return len;
+	const char* p = str;
+	while ((uintptr_t)p & 3) {
+		if (!*p) return p - str;
+		p++;
+	}
+	const word_alias_t* w = (const word_alias_t*)p;
+	while (!((*w - 0x01010101u) & ~*w & 0x80808080u)) w++;
+	p = (const char*)w;
+	while (*p) p++;
+	return p - str;
 }
 
 int memcmp(const void* s1, const void* s2, size_t n) {
@@ -94,18 +127,28 @@ char* strchr(const char* s, int c) {
 void* memmove(void* dest, const void* src, size_t n) {
     unsigned char* d = (unsigned char*)dest;
     const unsigned char* s = (const unsigned char*)src;
-    
-    if (d < s) {
-        // Copy forward
-        for (size_t i = 0; i < n; i++) {
-            d[i] = s[i];
-        }
-    } else if (d > s) {
-        // Copy backward
-        for (size_t i = n; i > 0; i--) {
-            d[i-1] = s[i-1];
-        }
+
+    if (d <= s || d >= s + n) {
+        // Copy forward; safe for any overlap with the destination below
+        return memcpy(dest, src, n);
     }
+
+    // Copy backward with DF set: the odd tail bytes first, then dwords
+    size_t tail = n & 3;
+    size_t words = n >> 2;
+    d += n - 1;
+    s += n - 1;
+    asm volatile(
+        "std\n\t"
+        "rep movsb\n\t"
+        "sub $3, %%esi\n\t"
+        "sub $3, %%edi\n\t"
+        "mov %[words], %%ecx\n\t"
+        "rep movsl\n\t"
+        "cld"
+        : "+D"(d), "+S"(s), "+c"(tail)
+        : [words] "r"(words)
+        : "memory", "cc");
     return dest;
 }
 
@@ -141,4 +184,24 @@ char* itoa(int value, char* str, int base) {
     return rc;
 }
 
+char* ulltoa(unsigned long long value, char* str, int base) {
+    char* ptr = str;
+    char* low = str;
+    if (base < 2 || base > 36) {
+        *str = '\0';
+        return str;
+    }
+    do {
+        *ptr++ = "0123456789abcdefghijklmnopqrstuvwxyz"[value % base];
+        value /= base;
+    } while (value);
+    *ptr-- = '\0';
+    while (low < ptr) {
+        char tmp = *low;
+        *low++ = *ptr;
+        *ptr-- = tmp;
+    }
+    return str;
+}
+
 }
@@ -0,0 +1,188 @@
+#include "logging.hpp"
+#include "arch/i386/cpu.hpp"
+#include "scheduler.hpp"
+#include "clock.hpp"
+#include "drivers/vga.hpp"
+#include <string.h>
+
+namespace MesaOS::System {
+
+volatile uint8_t Logging::record_level = LOG_INFO;
+volatile uint8_t Logging::console_level = LOG_WARN;
+LogRecord Logging::ring[LOG_RING_SIZE];
+volatile uint32_t Logging::next_seq = 0;
+volatile uint32_t Logging::clear_seq = 0;
+uint32_t Logging::console_seq = 0;
+bool Logging::writer_running = false;
+WaitQueue Logging::writer_wait = { 0 };
+
+uint32_t Logging::ratelimit_start_ms = 0;
+uint32_t Logging::ratelimit_count = 0;
+uint32_t Logging::suppressed = 0;
+uint32_t Logging::suppressed_total = 0;
+
+using MesaOS::Arch::x86::save_flags_cli;
+using MesaOS::Arch::x86::restore_flags;
+
+static const char* level_names[] = { "error", "warn", "info", "debug" };
+
+// Called with interrupts disabled
+static void store(LogRecord* ring, volatile uint32_t* next_seq, uint8_t level,
+                  const char* msg, uint32_t len, uint64_t now_ns) {
+    uint32_t seq = (*next_seq)++;
+    LogRecord* rec = &ring[seq % LOG_RING_SIZE];
+    rec->timestamp_ns = now_ns;
+    rec->seq = seq;
+    rec->level = level;
+    rec->length = (uint8_t)len;
+    memcpy(rec->text, msg, len);
+    rec->text[len] = 0;
+}
+
+void Logging::append(LogLevel level, const char* msg) {
+    if (!msg) return;
+    uint32_t len = 0;
+    while (len < LOG_MSG_MAX && msg[len]) len++;
+
+    uint64_t now_ns = Clock::now_ns();
+    uint32_t now_ms = (uint32_t)(now_ns / 1000000);
+    uint32_t flags = save_flags_cli();
+
+    // Errors always get through; everything else shares one token window
+    if (now_ms - ratelimit_start_ms >= LOG_RATELIMIT_INTERVAL_MS) {
+        if (suppressed) {
+            char note[48] = "logging: ";
+            char num[12];
+            strcat(note, itoa(suppressed, num, 10));
+            strcat(note, " messages suppressed");
+            store(ring, &next_seq, LOG_WARN, note, strlen(note), now_ns);
+            suppressed = 0;
+        }
+        ratelimit_start_ms = now_ms;
+        ratelimit_count = 0;
+    }
+    if (level != LOG_ERROR && ++ratelimit_count > LOG_RATELIMIT_BURST) {
+        suppressed++;
+        suppressed_total++;
+        restore_flags(flags);
+        return;
+    }
+
+    store(ring, &next_seq, level, msg, len, now_ns);
+    restore_flags(flags);
+
+    if (level <= console_level) {
+        if (writer_running) Scheduler::wake_one(&writer_wait);
+        else flush(); // Early boot: nobody else will print it
+    }
+}
+
+bool Logging::read(uint32_t* seq, LogRecord* out) {
+    uint32_t flags = save_flags_cli();
+    uint32_t oldest = next_seq > LOG_RING_SIZE ? next_seq - LOG_RING_SIZE : 0;
+    if (oldest < clear_seq) oldest = clear_seq;
+    if (*seq < oldest) *seq = oldest;
+
+    bool found = *seq < next_seq;
+    if (found) {
+        *out = ring[*seq % LOG_RING_SIZE];
+        (*seq)++;
+    }
+    restore_flags(flags);
+    return found;
+}
+
+uint32_t Logging::first_seq() {
+    uint32_t oldest = next_seq > LOG_RING_SIZE ? next_seq - LOG_RING_SIZE : 0;
+    return oldest < clear_seq ? clear_seq : oldest;
+}
+
+void Logging::clear() {
+    clear_seq = next_seq;
+}
+
+void Logging::format(const LogRecord* rec, char* out) {
+    char num[24];
+    uint64_t us = rec->timestamp_ns / 1000;
+
+    // "[    1.234567] warn: text"
+    strcpy(out, "[");
+    char* secs = ulltoa(us / 1000000, num, 10);
+    for (size_t i = strlen(secs); i < 5; i++) strcat(out, " ");
+    strcat(out, secs);
+    strcat(out, ".");
+    char* frac = ulltoa(us % 1000000, num, 10);
+    for (size_t i = strlen(frac); i < 6; i++) strcat(out, "0");
+    strcat(out, frac);
+    strcat(out, "] ");
+    if (rec->level != LOG_INFO) {
+        strcat(out, level_name(rec->level));
+        strcat(out, ": ");
+    }
+    strcat(out, rec->text);
+}
+
+void Logging::print_record(const LogRecord* rec) {
+    char line[LOG_MSG_MAX + 32];
+    format(rec, line);
+    strcat(line, "\n");
+    MesaOS::Drivers::VGADriver vga;
+    vga.write_string(line);
+}
+
+// Prints records the console hasn't seen yet. Records the ring overwrote
+// before we got to them are skipped; dmesg can't show them either.
+void Logging::flush() {
+    LogRecord rec;
+    for (;;) {
+        uint32_t flags = save_flags_cli();
+        uint32_t oldest = next_seq > LOG_RING_SIZE ? next_seq - LOG_RING_SIZE : 0;
+        if (console_seq < oldest) console_seq = oldest;
+        bool found = console_seq < next_seq;
+        if (found) rec = ring[console_seq++ % LOG_RING_SIZE];
+        restore_flags(flags);
+
+        if (!found) break;
+        if (rec.level <= console_level) print_record(&rec);
+    }
+}
+
+void Logging::klogd() {
+    for (;;) {
+        flush();
+
+        // Sleep until append() has something for the console
+        asm volatile("cli");
+        if (console_seq == next_seq) Scheduler::block(&writer_wait);
+        asm volatile("sti");
+    }
+}
+
+void Logging::start_writer() {
+    if (writer_running) return;
+    flush();
+    writer_running = true;
+    Scheduler::add_process("klogd", Logging::klogd);
+}
+
+void Logging::set_level(LogLevel level) { record_level = level; }
+LogLevel Logging::get_level() { return (LogLevel)record_level; }
+void Logging::set_console_level(LogLevel level) { console_level = level; }
+LogLevel Logging::get_console_level() { return (LogLevel)console_level; }
+uint32_t Logging::get_suppressed() { return suppressed_total; }
+
+const char* Logging::level_name(uint8_t level) {
+    return level <= LOG_DEBUG ? level_names[level] : "?";
+}
+
+bool Logging::parse_level(const char* name, LogLevel* level) {
+    for (uint8_t i = 0; i <= LOG_DEBUG; i++) {
+        if (strcmp(name, level_names[i]) == 0) {
+            *level = (LogLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace MesaOS::System
@@ -0,0 +1,86 @@
+#ifndef LOGGING_HPP
+#define LOGGING_HPP
+
+#include <stdint.h>
+
+namespace MesaOS::System {
+
+enum LogLevel : uint8_t {
+    LOG_ERROR = 0,
+    LOG_WARN  = 1,
+    LOG_INFO  = 2,
+    LOG_DEBUG = 3
+};
+
+struct WaitQueue;
+
+#define LOG_RING_SIZE 256 // Records kept for dmesg
+#define LOG_MSG_MAX   116 // Longer messages are truncated
+
+// Non-error messages above this many per interval are dropped and counted
+#define LOG_RATELIMIT_BURST       20
+#define LOG_RATELIMIT_INTERVAL_MS 1000
+
+struct LogRecord {
+    uint64_t timestamp_ns;
+    uint32_t seq;
+    uint8_t level;
+    uint8_t length;
+    char text[LOG_MSG_MAX + 2];
+};
+
+// Kernel log. Callers copy their message into a ring and return; the klogd
+// task writes records at or below the console level to the screen later.
+// Messages above the record level cost only the inline level check.
+class Logging {
+public:
+    static inline void error(const char* msg) { log(LOG_ERROR, msg); }
+    static inline void warn(const char* msg)  { log(LOG_WARN, msg); }
+    static inline void info(const char* msg)  { log(LOG_INFO, msg); }
+    static inline void debug(const char* msg) { log(LOG_DEBUG, msg); }
+
+    static inline void log(LogLevel level, const char* msg) {
+        if (__builtin_expect(level <= record_level, 1)) append(level, msg);
+    }
+
+    static void start_writer(); // Spawns klogd once the scheduler is up
+    static void flush();        // Synchronously print everything pending
+    static void format(const LogRecord* rec, char* out); // out: LOG_MSG_MAX + 32 bytes
+
+    static void set_level(LogLevel level);
+    static LogLevel get_level();
+    static void set_console_level(LogLevel level);
+    static LogLevel get_console_level();
+    static const char* level_name(uint8_t level);
+    static bool parse_level(const char* name, LogLevel* level);
+
+    // Copies the oldest record with sequence number >= *seq and advances *seq
+    // past it. Returns false once the reader has caught up.
+    static bool read(uint32_t* seq, LogRecord* out);
+    static uint32_t first_seq();
+    static void clear();
+    static uint32_t get_suppressed();
+
+private:
+    static void append(LogLevel level, const char* msg);
+    static void print_record(const LogRecord* rec);
+    static void klogd();
+
+    static volatile uint8_t record_level;
+    static volatile uint8_t console_level;
+    static LogRecord ring[LOG_RING_SIZE];
+    static volatile uint32_t next_seq;  // Sequence number of the next record
+    static volatile uint32_t clear_seq; // dmesg -c moves this forward
+    static uint32_t console_seq;        // Next record klogd will print
+    static bool writer_running;
+    static WaitQueue writer_wait;
+
+    static uint32_t ratelimit_start_ms;
+    static uint32_t ratelimit_count;
+    static uint32_t suppressed;
+    static uint32_t suppressed_total;
+};
+
+} // namespace MesaOS::System
+
+#endif
@@ -87,6 +87,24 @@ void* PMM::allocate_block() {
     return reinterpret_cast<void*>(static_cast<uintptr_t>(free_block) * BLOCK_SIZE);
 }
 
+// First fit over the bitmap; for DMA buffers that must be physically contiguous
+void* PMM::allocate_blocks(uint32_t count) {
+    if (!bitmap || count == 0) return nullptr;
+    uint32_t run = 0;
+    for (uint32_t block = 0; block < max_blocks; ++block) {
+        if (test_block(block)) {
+            run = 0;
+            continue;
+        }
+        if (++run == count) {
+            uint32_t first = block + 1 - count;
+            for (uint32_t i = first; i <= block; ++i) set_block(i);
+            return reinterpret_cast<void*>(static_cast<uintptr_t>(first) * BLOCK_SIZE);
+        }
+    }
+    return nullptr;
+}
+
 void PMM::free_block(void* addr) {
     if (!addr || !bitmap) return;
     uintptr_t addr_val = reinterpret_cast<uintptr_t>(addr);
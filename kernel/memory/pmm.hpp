@@ -11,6 +11,7 @@ class PMM {
 public:
     static void initialize(uint32_t start_addr, uint32_t size);
     static void* allocate_block();
+    static void* allocate_blocks(uint32_t count); // Physically contiguous run
     static void free_block(void* addr);
     static void load_memory_map(struct ::multiboot_info* mbt);
     
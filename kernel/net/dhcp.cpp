@@ -5,6 +5,7 @@
 #include "drivers/pcnet.hpp"
 #include "ethernet.hpp"
 #include "drivers/vga.hpp"
+#include "timer.hpp"
 #include <string.h>
 
 namespace MesaOS::Net {
@@ -58,18 +59,13 @@ void DHCP::discover() {
         UDP::send_packet(0xFFFFFFFF, 68, 67, (uint8_t*)&msg, sizeof(DHCPMessage));
         vga.write_string("SENT. Scanning...");
         
-        // Scan for 2 seconds (approx 60M cycles)
-        for(volatile int i=0; i<60000000; i++) {
-            // Poll both drivers to be sure
+        // Scan for 2 seconds, polling both drivers every 10ms
+        for (int i = 0; i < 200; i++) {
             MesaOS::Drivers::PCNet::poll();
             MesaOS::Drivers::RTL8139::receive_packet(); // Just in case
-            
+
             if (IPv4::get_ip() != 0) break; // Success!
-            
-            if ((i % 2000000) == 0) {
-                 // Check for ESC key? (Would require keyboard polling)
-                 // For now just visual feedback
-            }
+            MesaOS::System::Timer::sleep_ms(10);
         }
     }
     vga.write_string("\nDaemon Success! IP Obtained.\n");
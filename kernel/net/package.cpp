@@ -102,6 +102,7 @@ bool PackageManager::install_package(const char* package_path) {
     // Read package content
     char package_content[4096];
     uint32_t content_size = MesaOS::FS::read_fs(src_node, 0, sizeof(package_content) - 1, (uint8_t*)package_content);
+    MesaOS::FS::put_node(src_node);
     if (content_size == 0) {
         MesaOS::System::Logging::error("Empty package file");
         return false;
@@ -122,11 +123,15 @@ bool PackageManager::install_package(const char* package_path) {
         strcat(dest_path, exe_name);
 
         // Install the package (copy content to /bin)
-        if (MesaOS::FS::MesaFS::create_file(dest_path, 0, 0, 0644)) {
+        MesaOS::FS::fs_node* created = MesaOS::FS::MesaFS::create_file(dest_path, 0, 0, 0644);
+        if (created) {
+            MesaOS::FS::put_node(created);
             // Write the content
             MesaOS::FS::fs_node* node = MesaOS::FS::find_path_fs(MesaOS::FS::fs_root, dest_path);
             if (node) {
                 MesaOS::FS::MesaFS::write(node, 0, strlen(package_content), (uint8_t*)package_content);
+                MesaOS::FS::close_fs(node);
+                MesaOS::FS::put_node(node);
                 MesaOS::System::Logging::info("Package installed successfully: ");
                 MesaOS::System::Logging::info(exe_name);
                 return true;
@@ -171,6 +176,7 @@ bool PackageManager::list_installed_packages() {
             }
             i++;
         }
+        MesaOS::FS::put_node(bin_dir);
         return true;
     }
 
@@ -340,10 +346,12 @@ bool PackageManager::download_file(const char* url, const char* local_path) {
 
                 // Save body to file
                 if (body_len > 0) {
-                    MesaOS::FS::MesaFS::create_file(local_path, 0, 0, 0644);
+                    MesaOS::FS::put_node(MesaOS::FS::MesaFS::create_file(local_path, 0, 0, 0644));
                     MesaOS::FS::fs_node* node = MesaOS::FS::find_path_fs(MesaOS::FS::fs_root, local_path);
                     if (node) {
                         MesaOS::FS::MesaFS::write(node, 0, body_len, body_start);
+                        MesaOS::FS::close_fs(node);
+                        MesaOS::FS::put_node(node);
                     }
                     MesaOS::System::Logging::info("Downloaded file successfully");
                     MesaOS::Net::TCP::close(sock);
@@ -376,11 +384,13 @@ bool PackageManager::register_package(const PackageInfo* info) {
     strcat(metadata_path, info->name);
     strcat(metadata_path, ".meta");
 
-    MesaOS::FS::MesaFS::create_file(metadata_path, 0, 0, 0644);
+    MesaOS::FS::put_node(MesaOS::FS::MesaFS::create_file(metadata_path, 0, 0, 0644));
     MesaOS::FS::fs_node* node = MesaOS::FS::find_path_fs(MesaOS::FS::fs_root, metadata_path);
     if (node) {
         const char* meta = "package metadata";
         MesaOS::FS::MesaFS::write(node, 0, strlen(meta), (uint8_t*)meta);
+        MesaOS::FS::close_fs(node);
+        MesaOS::FS::put_node(node);
     }
     return true;
 }
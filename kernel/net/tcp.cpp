@@ -1,6 +1,8 @@
 #include "tcp.hpp"
 #include "memory/kheap.hpp"
 #include "logging.hpp"
+#include "clock.hpp"
+#include "trace.hpp"
 #include <string.h>
 
 namespace MesaOS::Net {
@@ -8,6 +10,8 @@ namespace MesaOS::Net {
 TCPConnection* TCP::connections = nullptr;
 uint16_t TCP::next_ephemeral_port = 49152; // Start of ephemeral ports
 
+DEFINE_TRACEPOINT(tcp_rx, "src=%x ports=%x flags_len=%x");
+
 void TCP::initialize() {
     connections = nullptr;
     next_ephemeral_port = 49152;
@@ -96,6 +100,13 @@ void TCP::send_packet(TCPConnection* conn, uint8_t flags, const uint8_t* data, u
         if (flags & TCP_SYN) conn->seq_number++;
         if (flags & TCP_FIN) conn->seq_number++;
 
+        // Time this segment if nothing else is being timed
+        if (!conn->rtt_timing) {
+            conn->rtt_timing = true;
+            conn->rtt_seq = conn->seq_number;
+            conn->rtt_start_ns = MesaOS::System::Clock::now_ns();
+        }
+
         // Update send window for data packets
         if (data_size > 0 && conn->state == ESTABLISHED) {
             conn->send_window_start += data_size;
@@ -145,6 +156,10 @@ TCPConnection* TCP::create_connection(uint32_t local_ip, uint32_t remote_ip, uin
     conn->rto = TCP_RETRANSMIT_TIMEOUT_MS;
     conn->retransmit_count = 0;
 
+    conn->srtt_us = 0;
+    conn->rttvar_us = 0;
+    conn->rtt_timing = false;
+
     // Initialize SYN flood protection
     conn->syn_timestamp = 0;
     conn->syn_cookie_enabled = true;
@@ -180,6 +195,8 @@ void TCP::handle_packet(uint32_t src_ip, uint8_t* data, uint32_t size) {
     uint32_t data_offset = (header->data_offset >> 4) * 4;
     uint32_t data_size = size - data_offset;
     uint8_t* payload = data + data_offset;
+    TRACE(tcp_rx, src_ip, ((uint32_t)header->src_port << 16) | header->dest_port,
+          ((uint32_t)header->flags << 16) | (data_size & 0xFFFF));
 
     TCPConnection* conn = find_connection(IPv4::get_ip(), src_ip, header->dest_port, header->src_port);
 
@@ -190,7 +207,7 @@ void TCP::handle_packet(uint32_t src_ip, uint8_t* data, uint32_t size) {
             // SYN flood protection: Check if we've seen too many SYNs recently
             static uint32_t syn_count = 0;
             static uint32_t last_syn_time = 0;
-            uint32_t current_time = 0; // TODO: Get actual timestamp
+            uint32_t current_time = MesaOS::System::Clock::now_ms();
 
             if (current_time - last_syn_time < 1000) { // Within 1 second
                 syn_count++;
@@ -220,7 +237,7 @@ void TCP::handle_packet(uint32_t src_ip, uint8_t* data, uint32_t size) {
 
     // Handle acknowledgments
     if (header->flags & TCP_ACK) {
-        // Acknowledgment received - could implement more advanced ACK handling here
+        update_rtt(conn, header->ack_number);
     }
 
     // Handle different states
@@ -306,6 +323,31 @@ void TCP::handle_packet(uint32_t src_ip, uint8_t* data, uint32_t size) {
     }
 }
 
+// RFC 6298: SRTT/RTTVAR from one timed segment per round trip. There is no
+// retransmission yet, so every sample satisfies Karn's rule.
+void TCP::update_rtt(TCPConnection* conn, uint32_t ack_number) {
+    if (!conn->rtt_timing || (int32_t)(ack_number - conn->rtt_seq) < 0) return;
+    conn->rtt_timing = false;
+
+    uint64_t elapsed = MesaOS::System::Clock::now_ns() - conn->rtt_start_ns;
+    uint32_t sample = (uint32_t)(elapsed / 1000);
+    if (sample == 0) sample = 1;
+
+    if (conn->srtt_us == 0) {
+        conn->srtt_us = sample;
+        conn->rttvar_us = sample / 2;
+    } else {
+        uint32_t delta = (conn->srtt_us > sample) ? conn->srtt_us - sample : sample - conn->srtt_us;
+        conn->rttvar_us = (3 * conn->rttvar_us + delta) / 4;   // beta = 1/4
+        conn->srtt_us = (7 * conn->srtt_us + sample) / 8;      // alpha = 1/8
+    }
+
+    uint32_t rto = (conn->srtt_us + 4 * conn->rttvar_us) / 1000;
+    if (rto < TCP_MIN_RTO_MS) rto = TCP_MIN_RTO_MS;
+    if (rto > TCP_MAX_RTO_MS) rto = TCP_MAX_RTO_MS;
+    conn->rto = rto;
+}
+
 // Server functions
 int TCP::listen(uint16_t port) {
     TCPConnection* conn = create_connection(IPv4::get_ip(), 0, port, 0);
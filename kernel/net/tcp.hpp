@@ -57,6 +57,8 @@ enum TCPState {
 #define TCP_MAX_WINDOW_SIZE 65535
 #define TCP_DEFAULT_WINDOW_SIZE 8192
 #define TCP_RETRANSMIT_TIMEOUT_MS 1000
+#define TCP_MIN_RTO_MS 200
+#define TCP_MAX_RTO_MS 60000
 #define TCP_MAX_RETRIES 5
 
 struct TCPConnection {
@@ -84,9 +86,16 @@ struct TCPConnection {
 
     // Retransmission handling for lost packets
     uint32_t last_ack_time;      // Timestamp of last ACK
-    uint32_t rto;                // Retransmission timeout
+    uint32_t rto;                // Retransmission timeout (ms)
     uint8_t retransmit_count;    // Number of retransmits
 
+    // RTT estimation (RFC 6298), one timed segment in flight at a time
+    uint32_t srtt_us;            // Smoothed round-trip time, 0 until the first sample
+    uint32_t rttvar_us;          // Round-trip time variation
+    uint32_t rtt_seq;            // ACK that completes the timed segment
+    uint64_t rtt_start_ns;       // When the timed segment was sent
+    bool rtt_timing;             // A segment is being timed
+
     // SYN flood protection mechanisms
     uint32_t syn_timestamp;      // When SYN was received
     bool syn_cookie_enabled;     // Use SYN cookies for protection
@@ -119,6 +128,7 @@ private:
     static TCPConnection* find_connection(uint32_t local_ip, uint32_t remote_ip, uint16_t local_port, uint16_t remote_port);
     static TCPConnection* create_connection(uint32_t local_ip, uint32_t remote_ip, uint16_t local_port, uint16_t remote_port);
     static void remove_connection(TCPConnection* conn);
+    static void update_rtt(TCPConnection* conn, uint32_t ack_number);
 };
 
 } // namespace MesaOS::Net
@@ -0,0 +1,179 @@
+#include "profiler.hpp"
+#include "ksyms.hpp"
+#include "clock.hpp"
+#include "scheduler.hpp"
+#include "arch/i386/apic.hpp"
+#include <string.h>
+
+namespace MesaOS::System {
+
+ProfileRing Profiler::rings[PROFILER_MAX_CPUS];
+bool Profiler::running = false;
+uint64_t Profiler::start_cycles = 0;
+uint64_t Profiler::elapsed_cycles = 0;
+
+// Only identity-mapped low memory is safe to dereference from the walker
+#define STACK_WALK_LIMIT (64 * 1024 * 1024)
+
+void Profiler::start() {
+    if (running) return;
+    start_cycles = Clock::now_cycles();
+    running = true;
+    // Chained behind the PIT handler on IRQ0
+    MesaOS::Arch::x86::register_irq_handler(IRQ0, Profiler::sample, "profiler");
+}
+
+void Profiler::stop() {
+    if (!running) return;
+    MesaOS::Arch::x86::unregister_irq_handler(IRQ0, Profiler::sample);
+    running = false;
+    elapsed_cycles += Clock::now_cycles() - start_cycles;
+}
+
+void Profiler::reset() {
+    bool was_running = running;
+    stop();
+    memset(rings, 0, sizeof(rings));
+    elapsed_cycles = 0;
+    if (was_running) start();
+}
+
+bool Profiler::is_running() {
+    return running;
+}
+
+uint32_t Profiler::current_cpu() {
+    uint32_t id = MesaOS::Arch::x86::LocalAPIC::get_id();
+    return id < PROFILER_MAX_CPUS ? id : 0;
+}
+
+void Profiler::sample(MesaOS::Arch::x86::Registers* regs) {
+    ProfileRing* ring = &rings[current_cpu()];
+    ProfileSample* s = &ring->samples[ring->head];
+
+    Process* current = Scheduler::get_current();
+    s->eip = regs->eip;
+    s->pid = current ? current->pid : 0;
+    s->user = (regs->cs & 0x3) != 0;
+    s->depth = 0;
+
+    // Follow saved EBPs: [ebp] = caller's ebp, [ebp+4] = return address.
+    // Frames must move up the stack, which also stops on corrupt chains.
+    if (!s->user) {
+        uint32_t ebp = regs->ebp;
+        while (s->depth < PROFILER_STACK_DEPTH) {
+            if (ebp == 0 || (ebp & 3) || ebp >= STACK_WALK_LIMIT - 8) break;
+            uint32_t* frame = (uint32_t*)ebp;
+            uint32_t ret = frame[1];
+            if (ret == 0) break;
+            s->stack[s->depth++] = ret;
+            if (frame[0] <= ebp) break;
+            ebp = frame[0];
+        }
+    }
+
+    ring->head = (ring->head + 1) % PROFILER_RING_SIZE;
+    if (ring->count < PROFILER_RING_SIZE) ring->count++;
+    else ring->overwritten++;
+}
+
+struct HistogramEntry {
+    const KernelSymbol* symbol; // 0 = outside the symbol table
+    uint32_t self;
+    uint32_t total;
+};
+
+static const int MAX_HISTOGRAM = 256;
+static HistogramEntry histogram[MAX_HISTOGRAM];
+
+static HistogramEntry* histogram_slot(const KernelSymbol* symbol, int* used) {
+    for (int i = 0; i < *used; i++) {
+        if (histogram[i].symbol == symbol) return &histogram[i];
+    }
+    if (*used >= MAX_HISTOGRAM) return 0;
+    HistogramEntry* entry = &histogram[(*used)++];
+    entry->symbol = symbol;
+    entry->self = 0;
+    entry->total = 0;
+    return entry;
+}
+
+static void print_padded(void (*print)(const char*), const char* text, size_t width) {
+    for (size_t i = strlen(text); i < width; i++) print(" ");
+    print(text);
+}
+
+void Profiler::dump(void (*print)(const char*), uint32_t max_rows) {
+    char buf[24];
+    bool was_running = running;
+    stop(); // The ring must not move while it is aggregated
+
+    int used = 0;
+    uint32_t samples = 0, overwritten = 0;
+    for (int cpu = 0; cpu < PROFILER_MAX_CPUS; cpu++) {
+        ProfileRing* ring = &rings[cpu];
+        samples += ring->count;
+        overwritten += ring->overwritten;
+
+        for (uint32_t i = 0; i < ring->count; i++) {
+            ProfileSample* s = &ring->samples[i];
+            const KernelSymbol* leaf = s->user ? 0 : KernelSymbols::lookup(s->eip);
+            HistogramEntry* entry = histogram_slot(leaf, &used);
+            if (!entry) continue;
+            entry->self++;
+            entry->total++;
+
+            // Inclusive counts: once per function per sample, however deep the recursion
+            const KernelSymbol* seen[PROFILER_STACK_DEPTH + 1];
+            int seen_count = 0;
+            seen[seen_count++] = leaf;
+            for (int d = 0; d < s->depth; d++) {
+                const KernelSymbol* caller = KernelSymbols::lookup(s->stack[d] - 1);
+                bool dup = false;
+                for (int k = 0; k < seen_count; k++) if (seen[k] == caller) dup = true;
+                if (dup) continue;
+                seen[seen_count++] = caller;
+                HistogramEntry* caller_entry = histogram_slot(caller, &used);
+                if (caller_entry) caller_entry->total++;
+            }
+        }
+    }
+
+    print("Samples: "); print(itoa(samples, buf, 10));
+    print("  Overwritten: "); print(itoa(overwritten, buf, 10));
+    print("  Duration: "); print(ulltoa(Clock::cycles_to_ns(elapsed_cycles) / 1000000, buf, 10));
+    print(" ms  Symbols: "); print(itoa(KernelSymbols::count(), buf, 10));
+    print("\n");
+    if (samples == 0) {
+        if (was_running) start();
+        return;
+    }
+
+    // Selection sort on self count; the table is small
+    for (int i = 0; i < used; i++) {
+        int best = i;
+        for (int j = i + 1; j < used; j++) {
+            if (histogram[j].self > histogram[best].self ||
+                (histogram[j].self == histogram[best].self && histogram[j].total > histogram[best].total)) best = j;
+        }
+        HistogramEntry tmp = histogram[i];
+        histogram[i] = histogram[best];
+        histogram[best] = tmp;
+    }
+
+    print("  SELF%   SELF  TOTAL  SYMBOL\n");
+    for (int i = 0; i < used && (uint32_t)i < max_rows; i++) {
+        HistogramEntry* entry = &histogram[i];
+        print_padded(print, itoa(entry->self * 100 / samples, buf, 10), 6);
+        print("%");
+        print_padded(print, itoa(entry->self, buf, 10), 7);
+        print_padded(print, itoa(entry->total, buf, 10), 7);
+        print("  ");
+        print(entry->symbol ? entry->symbol->name : "[user/unknown]");
+        print("\n");
+    }
+
+    if (was_running) start();
+}
+
+} // namespace MesaOS::System
@@ -0,0 +1,51 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <stdint.h>
+#include "arch/i386/isr.hpp"
+
+namespace MesaOS::System {
+
+#define PROFILER_STACK_DEPTH 6
+#define PROFILER_RING_SIZE   4096
+#define PROFILER_MAX_CPUS    1
+
+struct ProfileSample {
+    uint32_t eip;                           // Interrupted instruction
+    uint32_t stack[PROFILER_STACK_DEPTH];   // Return addresses from the frame-pointer chain
+    uint8_t depth;
+    uint8_t user;                           // Interrupted in user mode (no stack walk)
+    uint16_t pid;
+};
+
+// Each CPU writes only to its own ring from its timer interrupt
+struct ProfileRing {
+    ProfileSample samples[PROFILER_RING_SIZE];
+    uint32_t head;       // Next slot to write
+    uint32_t count;      // Valid samples, saturates at PROFILER_RING_SIZE
+    uint32_t overwritten;
+};
+
+class Profiler {
+public:
+    static void start();
+    static void stop();
+    static void reset();
+    static bool is_running();
+
+    // Prints a symbolised histogram: self samples and samples anywhere on the stack
+    static void dump(void (*print)(const char*), uint32_t max_rows = 20);
+
+private:
+    static void sample(MesaOS::Arch::x86::Registers* regs);
+    static uint32_t current_cpu();
+
+    static ProfileRing rings[PROFILER_MAX_CPUS];
+    static bool running;
+    static uint64_t start_cycles;
+    static uint64_t elapsed_cycles;
+};
+
+} // namespace MesaOS::System
+
+#endif
@@ -1,5 +1,7 @@
 #include "scheduler.hpp"
 #include "memory/kheap.hpp"
+#include "arch/i386/cpu.hpp"
+#include "trace.hpp"
 #include <string.h>
 
 namespace MesaOS::System {
@@ -7,16 +9,30 @@ namespace MesaOS::System {
 Process* Scheduler::process_list = 0;
 Process* Scheduler::current_process = 0;
 uint32_t Scheduler::next_pid = 0;
+uint32_t Scheduler::context_switches = 0;
+bool Scheduler::reschedule_pending = false;
+bool Scheduler::reschedule_voluntary = false;
+
+DEFINE_TRACEPOINT(sched_switch, "prev=%u next=%u voluntary=%u");
+DEFINE_TRACEPOINT(sched_wakeup, "pid=%u");
+
+static void yield_interrupt(MesaOS::Arch::x86::Registers* regs) {
+    (void)regs;
+    Scheduler::request_reschedule(true);
+}
 
 void Scheduler::initialize() {
     process_list = 0;
     current_process = 0;
     next_pid = 0;
+    context_switches = 0;
     
     // The kernel itself is PID 0
     add_process("kernel", 0); 
     current_process = process_list;
     current_process->state = RUNNING;
+
+    MesaOS::Arch::x86::register_interrupt_handler(129, yield_interrupt, "yield");
 }
 
 void Scheduler::add_process(const char* name, void (*entry_point)()) {
@@ -26,6 +42,7 @@ void Scheduler::add_process(const char* name, void (*entry_point)()) {
     proc->pid = next_pid++;
     strcpy(proc->name, name);
     proc->state = READY;
+    proc->last_switch_tsc = MesaOS::Arch::x86::rdtsc();
     
     // Stack allocation
     uint32_t stack_size = 8192;
@@ -45,23 +62,104 @@ void Scheduler::add_process(const char* name, void (*entry_point)()) {
     process_list = proc;
 }
 
-uint32_t Scheduler::schedule(uint32_t current_stack) {
+uint32_t Scheduler::schedule(uint32_t current_stack, bool voluntary) {
     if (!current_process) return current_stack;
 
-    // Save current stack
-    current_process->stack_ptr = current_stack;
-    current_process->state = READY;
+    uint64_t now = MesaOS::Arch::x86::rdtsc();
+    Process* prev = current_process;
 
-    // Simple Round Robin
-    current_process = current_process->next;
-    if (!current_process) current_process = process_list;
-    
+    // Save current stack and charge the slice we just ran
+    prev->stack_ptr = current_stack;
+    prev->cpu_cycles += now - prev->last_switch_tsc;
+    prev->last_switch_tsc = now;
+    if (prev->state == RUNNING) prev->state = READY;
+
+    // Round robin over runnable processes. The kernel process (PID 0) never
+    // blocks, so the walk always finds one.
+    Process* next = prev;
+    do {
+        next = next->next;
+        if (!next) next = process_list;
+    } while (next->state != READY && next != prev);
+    current_process = next;
+
+    if (current_process != prev) {
+        if (voluntary) prev->nr_voluntary++;
+        else prev->nr_involuntary++;
+        current_process->nr_switches++;
+        context_switches++;
+        TRACE(sched_switch, prev->pid, current_process->pid, voluntary);
+    }
+
+    // Time since it was last switched out was spent waiting on the run queue
+    current_process->wait_cycles += now - current_process->last_switch_tsc;
+    current_process->last_switch_tsc = now;
     current_process->state = RUNNING;
     
     // Return the stack pointer of the new process
     return current_process->stack_ptr;
 }
 
+void Scheduler::yield() {
+    // INT 0x81 re-enters schedule() with the voluntary flag set
+    asm volatile("int $0x81");
+}
+
+void Scheduler::request_reschedule(bool voluntary) {
+    // A yield stays voluntary even if a timer tick or wake-up also asks
+    reschedule_pending = true;
+    reschedule_voluntary |= voluntary;
+}
+
+uint32_t Scheduler::reschedule_if_pending(uint32_t current_stack) {
+    if (!reschedule_pending) return current_stack;
+    bool voluntary = reschedule_voluntary;
+    reschedule_pending = false;
+    reschedule_voluntary = false;
+    return schedule(current_stack, voluntary);
+}
+
+void Scheduler::block(WaitQueue* queue) {
+    Process* proc = current_process;
+    if (!proc) return;
+
+    proc->state = BLOCKED;
+    proc->wait_queue = queue;
+    proc->wait_next = 0;
+    Process** tail = &queue->head;
+    while (*tail) tail = &(*tail)->wait_next;
+    *tail = proc;
+
+    // INT works with interrupts disabled; we resume here once woken
+    yield();
+}
+
+void Scheduler::wake(Process* proc) {
+    if (!proc || proc->state != BLOCKED) return;
+
+    if (proc->wait_queue) {
+        Process** link = &proc->wait_queue->head;
+        while (*link && *link != proc) link = &(*link)->wait_next;
+        if (*link) *link = proc->wait_next;
+    }
+    proc->wait_queue = 0;
+    proc->wait_next = 0;
+    proc->state = READY;
+    proc->last_switch_tsc = MesaOS::Arch::x86::rdtsc(); // Run-queue wait starts now, not at block()
+    TRACE(sched_wakeup, proc->pid, 0, 0);
+
+    // Let the woken process run as soon as the current interrupt returns
+    request_reschedule();
+}
+
+void Scheduler::wake_one(WaitQueue* queue) {
+    if (queue->head) wake(queue->head);
+}
+
+void Scheduler::wake_all(WaitQueue* queue) {
+    while (queue->head) wake(queue->head);
+}
+
 Process* Scheduler::get_current() {
     return current_process;
 }
@@ -70,4 +168,8 @@ Process* Scheduler::get_process_list() {
     return process_list;
 }
 
+uint32_t Scheduler::get_context_switches() {
+    return context_switches;
+}
+
 } // namespace MesaOS::System
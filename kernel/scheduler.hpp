@@ -10,15 +10,35 @@ enum ProcessState {
     READY,
     RUNNING,
     SUSPENDED,
+    BLOCKED,   // Parked on a WaitQueue
     TERMINATED
 };
 
+struct Process;
+
+// Processes blocked on an event, woken by Scheduler::wake_*()
+struct WaitQueue {
+    Process* head;
+};
+
 struct Process {
     uint32_t pid;
     char name[32];
     ProcessState state;
     MesaOS::Arch::x86::Registers regs;
     uint32_t stack_ptr;
+
+    // Scheduler statistics (TSC cycles)
+    uint64_t cpu_cycles;      // Time spent RUNNING
+    uint64_t wait_cycles;     // Time spent READY on the run queue
+    uint64_t last_switch_tsc; // TSC of the last switch in or out
+    uint32_t nr_switches;     // Times this process was switched in
+    uint32_t nr_voluntary;    // Gave up the CPU through yield()
+    uint32_t nr_involuntary;  // Preempted by the timer
+
+    WaitQueue* wait_queue;    // Queue this process is blocked on, if any
+    struct Process* wait_next;
+
     struct Process* next;
 };
 
@@ -26,14 +46,28 @@ class Scheduler {
 public:
     static void initialize();
     static void add_process(const char* name, void (*entry_point)());
-    static uint32_t schedule(uint32_t current_stack);
+    static uint32_t schedule(uint32_t current_stack, bool voluntary = false);
+    static void yield();
+    static void request_reschedule(bool voluntary = false);
+    static uint32_t reschedule_if_pending(uint32_t current_stack);
+
+    // Blocking. block() must be called with interrupts disabled so the
+    // wakeup condition can't slip in between the caller's check and sleeping.
+    static void block(WaitQueue* queue);
+    static void wake(Process* proc);
+    static void wake_one(WaitQueue* queue);
+    static void wake_all(WaitQueue* queue);
     static Process* get_current();
     static Process* get_process_list();
+    static uint32_t get_context_switches();
 
 private:
     static Process* process_list;
     static Process* current_process;
     static uint32_t next_pid;
+    static uint32_t context_switches;
+    static bool reschedule_pending;
+    static bool reschedule_voluntary;
 };
 
 } // namespace MesaOS::System
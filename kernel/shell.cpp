@@ -3,12 +3,20 @@
 #include "arch/i386/io_port.hpp"
 #include "drivers/rtc.hpp"
 #include "apps/nano.hpp"
+#include "apps/top.hpp"
 #include "fs/vfs.hpp"
 #include "fs/ramfs.hpp"
 #include "fs/mesafs.hpp"
+#include "fs/bcache.hpp"
+#include "fs/dcache.hpp"
 #include "scheduler.hpp"
+#include "memory/kheap.hpp"
 #include "drivers/keyboard.hpp"
 #include "fs/mbr.hpp"
+#include "drivers/ide.hpp"
+#include "drivers/ahci.hpp"
+#include "drivers/virtio_blk.hpp"
+#include "drivers/block.hpp"
 #include "drivers/rtl8139.hpp"
 #include "net/ipv4.hpp"
 #include "net/dhcp.hpp"
@@ -16,6 +24,14 @@
 #include "net/ethernet.hpp"
 #include "net/icmp.hpp"
 #include "drivers/pcnet.hpp"
+#include "drivers/pit.hpp"
+#include "drivers/irqmod.hpp"
+#include "syscall.hpp"
+#include "timer.hpp"
+#include "clock.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
+#include "logging.hpp"
 #include <string.h>
 
 namespace MesaOS::System {
@@ -27,6 +43,12 @@ char Shell::current_user[32] = "mesa";
 bool Shell::is_admin = false;
 char Shell::current_path[128] = "/";
 
+// Input queue
+char Shell::input_queue[128];
+volatile uint32_t Shell::input_head = 0;
+volatile uint32_t Shell::input_tail = 0;
+static WaitQueue input_wait = { 0 };
+
 // History
 static char history[10][256];
 static int history_count = 0;
@@ -83,7 +105,7 @@ void Shell::kprint(const char* text) {
         if (!node) {
             // Create if not exists
             if (strncmp(full_path, "/disk/", 6) == 0) {
-                 MesaOS::FS::MesaFS::create_file(full_path + 6);
+                 MesaOS::FS::put_node(MesaOS::FS::MesaFS::create_file(full_path + 6));
             } else {
                  MesaOS::FS::RAMFS::create_file(redir_file, ""); 
             }
@@ -92,6 +114,8 @@ void Shell::kprint(const char* text) {
 
         if (node) {
             MesaOS::FS::write_fs(node, node->length, strlen(text), (uint8_t*)text);
+            MesaOS::FS::close_fs(node);
+            MesaOS::FS::put_node(node);
         }
     } else {
         // Normal VGA Output
@@ -108,6 +132,37 @@ void Shell::initialize() {
     prompt();
 }
 
+void Shell::run() {
+    initialize();
+    for (;;) {
+        char c;
+        while (dequeue_input(&c)) handle_input(c);
+        MesaOS::Apps::Top::update();
+
+        // Sleep until a key arrives; top needs a wakeup every second to redraw
+        asm volatile("cli");
+        if (input_head == input_tail) {
+            Timer::sleep_on(&input_wait, MesaOS::Apps::Top::is_running() ? 1000 : TIMER_WAIT_FOREVER);
+        }
+        asm volatile("sti");
+    }
+}
+
+void Shell::queue_input(char c) {
+    uint32_t next = (input_head + 1) % sizeof(input_queue);
+    if (next == input_tail) return; // Full: drop the keystroke
+    input_queue[input_head] = c;
+    input_head = next;
+    Scheduler::wake_all(&input_wait);
+}
+
+bool Shell::dequeue_input(char* c) {
+    if (input_tail == input_head) return false;
+    *c = input_queue[input_tail];
+    input_tail = (input_tail + 1) % sizeof(input_queue);
+    return true;
+}
+
 uint32_t string_to_ip(char* str) {
     uint32_t ip = 0;
     int octet = 0;
@@ -125,6 +180,15 @@ uint32_t string_to_ip(char* str) {
     return ip;
 }
 
+uint32_t parse_uint(const char* str) {
+    uint32_t value = 0;
+    while (*str >= '0' && *str <= '9') {
+        value = value * 10 + (*str - '0');
+        str++;
+    }
+    return value;
+}
+
 // Helper for grep
 char* k_strstr(const char* haystack, const char* needle) {
     if (!*needle) return (char*)haystack;
@@ -141,6 +205,49 @@ char* k_strstr(const char* haystack, const char* needle) {
     return 0;
 }
 
+// Byte-at-a-time references for membench, equivalent to the old libc loops.
+// volatile stops the compiler from turning them back into library calls.
+static void bench_byte_copy(void* dst, const void* src, size_t n) {
+    volatile unsigned char* d = (volatile unsigned char*)dst;
+    const volatile unsigned char* s = (const volatile unsigned char*)src;
+    for (size_t i = 0; i < n; i++) d[i] = s[i];
+}
+
+static void bench_byte_move_back(void* dst, const void* src, size_t n) {
+    volatile unsigned char* d = (volatile unsigned char*)dst;
+    const volatile unsigned char* s = (const volatile unsigned char*)src;
+    for (size_t i = n; i > 0; i--) d[i - 1] = s[i - 1];
+}
+
+static void bench_byte_set(void* dst, int value, size_t n) {
+    volatile unsigned char* d = (volatile unsigned char*)dst;
+    for (size_t i = 0; i < n; i++) d[i] = (unsigned char)value;
+}
+
+static size_t bench_byte_strlen(const char* str) {
+    const volatile char* p = str;
+    size_t len = 0;
+    while (p[len]) len++;
+    return len;
+}
+
+// Average cycles for one call of operation 'op' (0 memcpy, 1 memset,
+// 2 overlapping memmove, 3 strlen) on 'size' bytes
+static uint32_t bench_op(int op, bool libc, uint8_t* dst, uint8_t* src, size_t size, uint32_t rounds) {
+    volatile size_t sink = 0;
+    uint64_t start = MesaOS::System::Clock::now_cycles();
+    for (uint32_t r = 0; r < rounds; r++) {
+        switch (op) {
+            case 0: if (libc) memcpy(dst, src, size); else bench_byte_copy(dst, src, size); break;
+            case 1: if (libc) memset(dst, r, size); else bench_byte_set(dst, r, size); break;
+            case 2: if (libc) memmove(dst + 1, dst, size); else bench_byte_move_back(dst + 1, dst, size); break;
+            case 3: sink = libc ? strlen((const char*)src) : bench_byte_strlen((const char*)src); break;
+        }
+    }
+    (void)sink;
+    return (uint32_t)((MesaOS::System::Clock::now_cycles() - start) / rounds);
+}
+
 bool Shell::is_app_running() {
     return app_running;
 }
@@ -171,6 +278,14 @@ void Shell::prompt() {
 
 void Shell::handle_input(char c) {
     if (app_running) {
+        if (MesaOS::Apps::Top::is_running()) {
+            MesaOS::Apps::Top::handle_input(c);
+            if (!MesaOS::Apps::Top::is_running()) {
+                app_running = false;
+                prompt();
+            }
+            return;
+        }
         MesaOS::Apps::Nano::handle_input(c);
         if (!MesaOS::Apps::Nano::is_running()) {
             app_running = false;
@@ -277,10 +392,12 @@ void Shell::handle_input(char c) {
                         vga.put_char('/');
                      }
                 }
+                MesaOS::FS::put_node(child);
                 
             } else if (match_count > 1) {
                 // Beep or show list? For now do nothing or partial.
             }
+            MesaOS::FS::put_node(dir);
         }
         return;
     }
@@ -376,6 +493,7 @@ void Shell::execute_command(const char* command_in) {
                 }
                 MesaOS::FS::fs_node* node = MesaOS::FS::find_path_fs(MesaOS::FS::fs_root, full_path);
                 if (node) {
+                    MesaOS::FS::put_node(node);
                     MesaOS::FS::RAMFS::delete_file(redir_file);
                 }
             }
@@ -409,11 +527,26 @@ void Shell::execute_command(const char* command_in) {
         kprint("=== MesaOS Help System ===\n\n");
         kprint("System Core:\n");
         kprint("  sdstat   - Check internal SD health\n");
-        kprint("  sync     - Flush buffers\n");
+        kprint("  sync     - Write dirty disk buffers back now\n");
+        kprint("  bcache   - Buffer cache hit rate and write-back statistics\n");
+        kprint("  dcache   - Dentry cache hit rate and size\n");
+        kprint("  df       - MesaFS space and inode usage\n");
+        kprint("  hdinfo   - IDE/AHCI/virtio disk identity and transfer modes\n");
+        kprint("  lsblk    - Block devices and request queue statistics\n");
+        kprint("  dmesg    - Kernel log (dmesg [-c] clears after printing)\n");
+        kprint("  loglevel - Log filters (loglevel [record|console <level>])\n");
         
         kprint("\nProcess Management:\n");
         kprint("  ps       - List living processes\n");
         kprint("  kill     - Terminate a process\n");
+        kprint("  top      - Live CPU usage per process\n");
+        kprint("  schedstat- Dump scheduler statistics\n");
+        kprint("  syscallbench - Compare INT 0x80 and SYSENTER cost\n");
+        kprint("  membench - Time libc memcpy/memset/memmove/strlen against byte loops\n");
+        kprint("  interrupts - Per-vector interrupt counts and cost\n");
+        kprint("  irqmod   - NIC interrupt moderation (irqmod <dev> <pkts> <usecs>)\n");
+        kprint("  prof     - Sampling profiler (prof start|stop|reset|dump)\n");
+        kprint("  trace    - Tracepoints (trace list|on [name]|off [name]|clear|dump)\n");
 
         kprint("\nMemory & Truth:\n");
         kprint("  meminfo  - Display raw memory usage\n");
@@ -449,16 +582,242 @@ void Shell::execute_command(const char* command_in) {
              kprint(": ");
              kprint("Vendor 0x"); kprint(itoa(dev.vendor_id, buf, 16));
              kprint(" Device 0x"); kprint(itoa(dev.device_id, buf, 16));
+             if (dev.msix_cap) kprint(" MSI-X");
+             else if (dev.msi_cap) kprint(" MSI");
+             if (MesaOS::Drivers::PCIDriver::msi_enabled(&dev)) kprint("+");
              kprint("\n");
         }
     } else if (strcmp(cmd, "top") == 0) {
-        MesaOS::Drivers::VGADriver vga; // Local instance for special screen control
-        vga.initialize();
-        vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::BLACK, MesaOS::Drivers::VGAColor::LIGHT_GREY));
-        vga.write_string(" MesaOS Task Manager | CPU: 100% | Press any key to exit                    \n");
-        vga.set_color(MesaOS::Drivers::vga_entry_color(MesaOS::Drivers::VGAColor::WHITE, MesaOS::Drivers::VGAColor::BLACK));
-        execute_command("ps");
-        vga.write_string("\n[ TASK SWITCHING: ENABLED ]");
+        app_running = true;
+        MesaOS::Apps::Top::run();
+    } else if (strcmp(cmd, "schedstat") == 0) {
+        char buf[24];
+        kprint("Context switches: ");
+        kprint(itoa(MesaOS::System::Scheduler::get_context_switches(), buf, 10));
+        kprint("  Uptime ticks: ");
+        kprint(itoa(MesaOS::Drivers::PIT::get_ticks(), buf, 10));
+        kprint("  Uptime: ");
+        kprint(ulltoa(MesaOS::System::Clock::now_us(), buf, 10));
+        kprint(" us\n");
+        MesaOS::System::Process* proc = MesaOS::System::Scheduler::get_process_list();
+        while (proc) {
+            kprint("pid "); kprint(itoa(proc->pid, buf, 10));
+            kprint(" ("); kprint(proc->name); kprint(")\n");
+            kprint("  cpu_cycles:     "); kprint(ulltoa(proc->cpu_cycles, buf, 10));
+            kprint(" ("); kprint(ulltoa(MesaOS::System::Clock::cycles_to_ns(proc->cpu_cycles) / 1000, buf, 10)); kprint(" us)\n");
+            kprint("  wait_cycles:    "); kprint(ulltoa(proc->wait_cycles, buf, 10));
+            kprint(" ("); kprint(ulltoa(MesaOS::System::Clock::cycles_to_ns(proc->wait_cycles) / 1000, buf, 10)); kprint(" us)\n");
+            kprint("  nr_switches:    "); kprint(itoa(proc->nr_switches, buf, 10)); kprint("\n");
+            kprint("  nr_voluntary:   "); kprint(itoa(proc->nr_voluntary, buf, 10)); kprint("\n");
+            kprint("  nr_involuntary: "); kprint(itoa(proc->nr_involuntary, buf, 10)); kprint("\n");
+            proc = proc->next;
+        }
+    } else if (strcmp(cmd, "syscallbench") == 0) {
+        uint32_t iterations = strlen(arg) > 0 ? parse_uint(arg) : 100000;
+        uint32_t int80 = 0, fast = 0;
+        char buf[16];
+        kprint("Running "); kprint(itoa(iterations, buf, 10)); kprint(" getpid calls per path...\n");
+        MesaOS::System::Syscall::benchmark(iterations, &int80, &fast);
+        kprint("  INT 0x80: "); kprint(itoa(int80, buf, 10)); kprint(" cycles/call\n");
+        if (MesaOS::System::Syscall::has_fast_path()) {
+            kprint("  SYSENTER: "); kprint(itoa(fast, buf, 10)); kprint(" cycles/call\n");
+        } else {
+            kprint("  SYSENTER: not supported by this CPU\n");
+        }
+    } else if (strcmp(cmd, "membench") == 0) {
+        static const char* op_names[] = { "memcpy ", "memset ", "memmove", "strlen " };
+        static const size_t sizes[] = { 64, 1500, 4096 };
+        uint32_t rounds = strlen(arg) > 0 ? parse_uint(arg) : 1000;
+        if (rounds == 0) rounds = 1;
+        char buf[16];
+
+        // Odd source offset so the alignment head/tail paths are exercised
+        uint8_t* dst = (uint8_t*)kmalloc(4096 + 16);
+        uint8_t* src_block = (uint8_t*)kmalloc(4096 + 16);
+        if (!dst || !src_block) {
+            kprint("membench: out of memory\n");
+            if (dst) kfree(dst);
+            if (src_block) kfree(src_block);
+            return;
+        }
+        uint8_t* src = src_block + 1;
+
+        kprint("OP        SIZE   BYTE-LOOP      LIBC  SPEEDUP (cycles/call)\n");
+        for (int op = 0; op < 4; op++) {
+            for (int s = 0; s < 3; s++) {
+                size_t size = sizes[s];
+                memset(src, 'a', size);
+                src[size - 1] = 0; // strlen terminator
+
+                uint32_t slow = bench_op(op, false, dst, src, size, rounds);
+                uint32_t fast = bench_op(op, true, dst, src, size, rounds);
+
+                kprint(op_names[op]);
+                const char* col = itoa(size, buf, 10);
+                for (size_t k = strlen(col); k < 7; k++) kprint(" ");
+                kprint(col);
+                col = itoa(slow, buf, 10);
+                for (size_t k = strlen(col); k < 12; k++) kprint(" ");
+                kprint(col);
+                col = itoa(fast, buf, 10);
+                for (size_t k = strlen(col); k < 10; k++) kprint(" ");
+                kprint(col);
+                uint32_t speedup = fast ? slow * 10 / fast : 0;
+                col = itoa(speedup / 10, buf, 10);
+                for (size_t k = strlen(col); k < 7; k++) kprint(" ");
+                kprint(col); kprint("."); kprint(itoa(speedup % 10, buf, 10)); kprint("x\n");
+            }
+        }
+        kfree(dst);
+        kfree(src_block);
+    } else if (strcmp(cmd, "interrupts") == 0) {
+        char buf[24];
+        kprint(" VEC       COUNT      CYCLES     AVG  SPUR  HANDLERS\n");
+        for (int v = 0; v < 256; v++) {
+            MesaOS::Arch::x86::IRQDescriptor* desc = MesaOS::Arch::x86::get_irq_descriptor(v);
+            if (!desc->actions && desc->count == 0 && desc->spurious == 0) continue;
+
+            const char* col = itoa(v, buf, 10);
+            for (size_t k = strlen(col); k < 4; k++) kprint(" ");
+            kprint(col);
+            col = ulltoa(desc->count, buf, 10);
+            for (size_t k = strlen(col); k < 12; k++) kprint(" ");
+            kprint(col);
+            col = ulltoa(desc->cycles, buf, 10);
+            for (size_t k = strlen(col); k < 12; k++) kprint(" ");
+            kprint(col);
+            col = ulltoa(desc->count ? desc->cycles / desc->count : 0, buf, 10);
+            for (size_t k = strlen(col); k < 8; k++) kprint(" ");
+            kprint(col);
+            col = itoa(desc->spurious, buf, 10);
+            for (size_t k = strlen(col); k < 6; k++) kprint(" ");
+            kprint(col);
+            kprint("  ");
+            for (MesaOS::Arch::x86::IRQAction* action = desc->actions; action; action = action->next) {
+                kprint(action->name);
+                if (action->next) kprint(",");
+            }
+            kprint("\n");
+        }
+    } else if (strcmp(cmd, "prof") == 0) {
+        if (strcmp(arg, "start") == 0) {
+            Profiler::start();
+            kprint("Profiler started (IRQ0 sampling)\n");
+        } else if (strcmp(arg, "stop") == 0) {
+            Profiler::stop();
+            kprint("Profiler stopped\n");
+        } else if (strcmp(arg, "reset") == 0) {
+            Profiler::reset();
+        } else if (strcmp(arg, "dump") == 0) {
+            Profiler::dump(Shell::kprint);
+        } else {
+            kprint("Usage: prof start|stop|reset|dump\n");
+            kprint(Profiler::is_running() ? "Profiler is running\n" : "Profiler is stopped\n");
+        }
+    } else if (strcmp(cmd, "dmesg") == 0) {
+        uint32_t seq = 0;
+        MesaOS::System::LogRecord rec;
+        char line[LOG_MSG_MAX + 32];
+        while (MesaOS::System::Logging::read(&seq, &rec)) {
+            MesaOS::System::Logging::format(&rec, line);
+            kprint(line); kprint("\n");
+        }
+        if (strcmp(arg, "-c") == 0) MesaOS::System::Logging::clear();
+    } else if (strcmp(cmd, "loglevel") == 0) {
+        using MesaOS::System::Logging;
+        char buf[16];
+        if (strlen(arg) > 0) {
+            // loglevel record|console <level>
+            bool console = strncmp(arg, "console ", 8) == 0;
+            if (!console && strncmp(arg, "record ", 7) != 0) {
+                kprint("Usage: loglevel [record|console error|warn|info|debug]\n");
+                return;
+            }
+            MesaOS::System::LogLevel level;
+            if (!Logging::parse_level(arg + (console ? 8 : 7), &level)) {
+                kprint("loglevel: unknown level\n");
+                return;
+            }
+            if (console) Logging::set_console_level(level);
+            else Logging::set_level(level);
+        }
+        kprint("record:  "); kprint(Logging::level_name(Logging::get_level())); kprint("\n");
+        kprint("console: "); kprint(Logging::level_name(Logging::get_console_level())); kprint("\n");
+        kprint("suppressed: "); kprint(itoa(Logging::get_suppressed(), buf, 10)); kprint("\n");
+    } else if (strcmp(cmd, "trace") == 0) {
+        char buf[16];
+        // First word is the subcommand; on/off take an optional name after it
+        char verb[8];
+        uint32_t verb_len = 0;
+        const char* name = arg;
+        while (*name && *name != ' ') {
+            if (verb_len < sizeof(verb) - 1) verb[verb_len++] = *name;
+            name++;
+        }
+        verb[verb_len] = '\0';
+        while (*name == ' ') name++;
+
+        if (strcmp(verb, "on") == 0 || strcmp(verb, "off") == 0) {
+            bool enable = verb[1] == 'n';
+            if (*name && !MesaOS::System::Trace::find(name)) {
+                kprint("trace: no such tracepoint: "); kprint(name); kprint("\n");
+                return;
+            }
+            MesaOS::System::Trace::set_enabled(*name ? name : 0, enable);
+        } else if (strcmp(arg, "clear") == 0) {
+            MesaOS::System::Trace::clear();
+        } else if (strcmp(arg, "dump") == 0) {
+            uint32_t written = MesaOS::System::Trace::dump_serial();
+            kprint(itoa(written, buf, 10)); kprint(" records written to COM1\n");
+        } else if (strcmp(arg, "list") == 0 || strlen(arg) == 0) {
+            uint32_t count;
+            MesaOS::System::Tracepoint* tps = MesaOS::System::Trace::get_tracepoints(&count);
+            for (uint32_t i = 0; i < count; i++) {
+                kprint(tps[i].enabled ? "  [on]  " : "  [off] ");
+                kprint(tps[i].name); kprint("\n");
+            }
+            kprint(itoa(MesaOS::System::Trace::get_record_count(), buf, 10));
+            kprint(" records buffered\n");
+        } else {
+            kprint("Usage: trace list|on [name]|off [name]|clear|dump\n");
+        }
+    } else if (strcmp(cmd, "irqmod") == 0) {
+        char buf[16];
+        if (strlen(arg) > 0) {
+            // irqmod <dev> <packets> <usecs>
+            char dev_name[16];
+            int n = 0;
+            const char* p = arg;
+            while (*p && *p != ' ' && n < 15) dev_name[n++] = *p++;
+            dev_name[n] = 0;
+            while (*p == ' ') p++;
+            uint32_t packets = parse_uint(p);
+            while (*p && *p != ' ') p++;
+            while (*p == ' ') p++;
+            uint32_t usecs = parse_uint(p);
+            if (!MesaOS::Drivers::IRQModeration::configure(dev_name, packets, usecs)) {
+                kprint("irqmod: no such device: "); kprint(dev_name); kprint("\n");
+                return;
+            }
+        }
+        int count = MesaOS::Drivers::IRQModeration::get_device_count();
+        if (count == 0) {
+            kprint("irqmod: no NIC registered\n");
+            return;
+        }
+        kprint("DEVICE      PKTS   USECS    IRQS   POLLS  FRAMES\n");
+        for (int i = 0; i < count; i++) {
+            MesaOS::Drivers::ModerationDevice* dev = &MesaOS::Drivers::IRQModeration::get_devices()[i];
+            kprint(dev->name);
+            for (size_t k = strlen(dev->name); k < 8; k++) kprint(" ");
+            uint32_t cols[5] = { dev->max_packets, dev->max_usecs, dev->interrupts, dev->polls, dev->frames };
+            for (int c = 0; c < 5; c++) {
+                const char* col = itoa(cols[c], buf, 10);
+                for (size_t k = strlen(col); k < 8; k++) kprint(" ");
+                kprint(col);
+            }
+            kprint(dev->held ? "  (polling)\n" : "\n");
+        }
     } else if (strcmp(cmd, "cd") == 0) {
         if (strlen(arg) > 0) {
             if (strcmp(arg, "/") == 0) {
@@ -483,6 +842,7 @@ void Shell::execute_command(const char* command_in) {
                 } else {
                     kprint("cd: "); kprint(arg); kprint(": No such directory\n");
                 }
+                MesaOS::FS::put_node(node);
             }
         } else {
             strcpy(current_path, "/");
@@ -499,6 +859,112 @@ void Shell::execute_command(const char* command_in) {
         }
     } else if (strcmp(cmd, "fdisk") == 0) {
         MesaOS::FS::PartitionManager::list_partitions();
+    } else if (strcmp(cmd, "lsblk") == 0) {
+        using MesaOS::Drivers::BlockLayer;
+        using MesaOS::Drivers::BlockDevice;
+        char buf[24];
+        if (BlockLayer::get_device_count() == 0) {
+            kprint("lsblk: no block devices\n");
+            return;
+        }
+        for (int i = 0; i < BlockLayer::get_device_count(); i++) {
+            BlockDevice* dev = &BlockLayer::get_devices()[i];
+            kprint(dev == BlockLayer::get_default() ? "* " : "  ");
+            kprint(dev->name); kprint("  ");
+            kprint(ulltoa(dev->sector_count / 2048, buf, 10)); kprint(" MB\n");
+            kprint("    bios "); kprint(itoa(dev->bios, buf, 10));
+            kprint("  merged "); kprint(itoa(dev->merges, buf, 10));
+            kprint("  requests "); kprint(itoa(dev->requests, buf, 10));
+            kprint("  expired "); kprint(itoa(dev->expired, buf, 10));
+            kprint("  errors "); kprint(itoa(dev->errors, buf, 10)); kprint("\n");
+            kprint("    read "); kprint(ulltoa(dev->sectors_read / 2, buf, 10));
+            kprint(" KB  written "); kprint(ulltoa(dev->sectors_written / 2, buf, 10)); kprint(" KB\n");
+        }
+    } else if (strcmp(cmd, "sync") == 0) {
+        MesaOS::FS::BufferCache::sync();
+    } else if (strcmp(cmd, "df") == 0) {
+        const MesaOS::FS::MesaFSSuperblock* sb = MesaOS::FS::MesaFS::get_superblock();
+        char buf[16];
+        if (!sb) {
+            kprint("df: no MesaFS volume mounted\n");
+            return;
+        }
+        uint32_t data_blocks = sb->total_blocks - sb->data_start;
+        kprint("/disk  MesaFS v"); kprint(itoa(sb->version, buf, 10)); kprint("\n");
+        kprint("Size:   "); kprint(itoa(data_blocks * 4, buf, 10)); kprint(" KB\n");
+        kprint("Used:   "); kprint(itoa((data_blocks - sb->free_blocks) * 4, buf, 10)); kprint(" KB\n");
+        kprint("Free:   "); kprint(itoa(sb->free_blocks * 4, buf, 10)); kprint(" KB\n");
+        kprint("Inodes: "); kprint(itoa(sb->inode_count - sb->free_inodes - 1, buf, 10));
+        kprint(" used of "); kprint(itoa(sb->inode_count - 1, buf, 10)); kprint("\n");
+    } else if (strcmp(cmd, "bcache") == 0) {
+        const MesaOS::FS::BufferCacheStats* st = MesaOS::FS::BufferCache::get_stats();
+        char buf[16];
+        uint32_t lookups = st->hits + st->misses;
+        kprint("Buffers:     "); kprint(itoa(st->buffers, buf, 10));
+        kprint(" x 4 KB ("); kprint(itoa(st->buffers * 4, buf, 10)); kprint(" KB)\n");
+        kprint("Hits:        "); kprint(itoa(st->hits, buf, 10));
+        kprint("  misses "); kprint(itoa(st->misses, buf, 10));
+        kprint("  ("); kprint(itoa(lookups ? (uint32_t)((uint64_t)st->hits * 100 / lookups) : 0, buf, 10)); kprint("% hit)\n");
+        kprint("Evictions:   "); kprint(itoa(st->evictions, buf, 10)); kprint("\n");
+        kprint("Read-ahead:  "); kprint(itoa(st->readahead, buf, 10)); kprint(" blocks\n");
+        kprint("Dirty:       "); kprint(itoa(st->dirty, buf, 10)); kprint("\n");
+        kprint("Writebacks:  "); kprint(itoa(st->writebacks, buf, 10));
+        kprint("  errors "); kprint(itoa(st->write_errors, buf, 10)); kprint("\n");
+    } else if (strcmp(cmd, "dcache") == 0) {
+        const MesaOS::FS::DentryCacheStats* st = MesaOS::FS::DentryCache::get_stats();
+        char buf[16];
+        uint32_t lookups = st->hits + st->negative_hits + st->misses;
+        kprint("Entries:     "); kprint(itoa(st->entries, buf, 10));
+        kprint(" / "); kprint(itoa(DCACHE_ENTRIES, buf, 10)); kprint("\n");
+        kprint("Hits:        "); kprint(itoa(st->hits, buf, 10));
+        kprint("  negative "); kprint(itoa(st->negative_hits, buf, 10));
+        kprint("  misses "); kprint(itoa(st->misses, buf, 10));
+        kprint("  ("); kprint(itoa(lookups ? (uint32_t)((uint64_t)(st->hits + st->negative_hits) * 100 / lookups) : 0, buf, 10)); kprint("% hit)\n");
+        kprint("Evictions:   "); kprint(itoa(st->evictions, buf, 10)); kprint("\n");
+    } else if (strcmp(cmd, "hdinfo") == 0) {
+        using MesaOS::Drivers::IDEDriver;
+        using MesaOS::Drivers::AHCIDriver;
+        char buf[24];
+        using MesaOS::Drivers::VirtioBlkDriver;
+        if (!IDEDriver::is_present() && !AHCIDriver::is_present() && !VirtioBlkDriver::is_present()) {
+            kprint("hdinfo: no IDE, AHCI or virtio disk found\n");
+            return;
+        }
+        if (IDEDriver::is_present()) {
+            kprint("IDE primary master\n");
+            kprint("Model:    "); kprint(IDEDriver::get_model()); kprint("\n");
+            kprint("Sectors:  "); kprint(ulltoa(IDEDriver::get_sector_count(), buf, 10));
+            kprint(" ("); kprint(ulltoa(IDEDriver::get_sector_count() / 2048, buf, 10)); kprint(" MB)\n");
+            kprint("Address:  "); kprint(IDEDriver::has_lba48() ? "LBA48\n" : "LBA28\n");
+            kprint("Multiple: "); kprint(itoa(IDEDriver::get_multiple_sectors(), buf, 10)); kprint(" sectors/block\n");
+            kprint("Transfer: ");
+            if (IDEDriver::dma_enabled()) {
+                kprint("bus-master DMA at 0x"); kprint(itoa(IDEDriver::get_bus_master_base(), buf, 16)); kprint(", IRQ14\n");
+            } else {
+                kprint("PIO\n");
+            }
+        }
+        if (AHCIDriver::is_present()) {
+            kprint("AHCI port "); kprint(itoa(AHCIDriver::get_port(), buf, 10)); kprint("\n");
+            kprint("Model:    "); kprint(AHCIDriver::get_model()); kprint("\n");
+            kprint("Sectors:  "); kprint(ulltoa(AHCIDriver::get_sector_count(), buf, 10));
+            kprint(" ("); kprint(ulltoa(AHCIDriver::get_sector_count() / 2048, buf, 10)); kprint(" MB)\n");
+            kprint("Address:  "); kprint(AHCIDriver::has_lba48() ? "LBA48\n" : "LBA28\n");
+            kprint("Transfer: ");
+            if (AHCIDriver::ncq_enabled()) {
+                kprint("NCQ, "); kprint(itoa(AHCIDriver::get_queue_depth(), buf, 10)); kprint(" commands deep\n");
+            } else {
+                kprint("DMA, one command at a time\n");
+            }
+        }
+        if (VirtioBlkDriver::is_present()) {
+            kprint("virtio-blk\n");
+            kprint("Sectors:  "); kprint(ulltoa(VirtioBlkDriver::get_sector_count(), buf, 10));
+            kprint(" ("); kprint(ulltoa(VirtioBlkDriver::get_sector_count() / 2048, buf, 10)); kprint(" MB)\n");
+            kprint("Queue:    "); kprint(itoa(VirtioBlkDriver::get_queue_size(), buf, 10));
+            kprint(VirtioBlkDriver::has_indirect() ? " entries, indirect descriptors\n" : " entries\n");
+            kprint("Notifies: "); kprint(itoa(VirtioBlkDriver::get_notifications(), buf, 10)); kprint("\n");
+        }
     } else if (strcmp(cmd, "mkdir") == 0) {
         if (strlen(arg) > 0) {
             // ... (rest of mkdir logic same)
@@ -511,7 +977,7 @@ void Shell::execute_command(const char* command_in) {
             }
             
             if (strncmp(full_path, "/disk/", 6) == 0) {
-                MesaOS::FS::MesaFS::create_dir(full_path + 6);
+                MesaOS::FS::put_node(MesaOS::FS::MesaFS::create_dir(full_path + 6));
             } else {
                 MesaOS::FS::RAMFS::create_dir(arg); // Simple RAMFS mkdir
             }
@@ -555,10 +1021,12 @@ void Shell::execute_command(const char* command_in) {
                 } else {
                      kprint(de->name);
                 }
+                MesaOS::FS::put_node(child);
                 kprint("  ");
                 i++;
             }
             kprint("\n");
+            MesaOS::FS::put_node(dir);
         } else {
             kprint("Directory not found.\n");
         }
@@ -573,7 +1041,7 @@ void Shell::execute_command(const char* command_in) {
             }
             
             if (strncmp(full_path, "/disk/", 6) == 0) {
-                MesaOS::FS::MesaFS::create_file(full_path + 6);
+                MesaOS::FS::put_node(MesaOS::FS::MesaFS::create_file(full_path + 6));
             } else {
                 MesaOS::FS::RAMFS::create_file(arg, ""); // Still use relative name for RAMFS internals for now
             }
@@ -592,11 +1060,17 @@ void Shell::execute_command(const char* command_in) {
             }
             MesaOS::FS::fs_node* node = MesaOS::FS::find_path_fs(MesaOS::FS::fs_root, full_path);
             if (node) {
+                // Stream it; sequential reads let MesaFS read ahead
                 char buf[2048];
-                uint32_t len = MesaOS::FS::read_fs(node, 0, 2047, (uint8_t*)buf);
-                buf[len] = '\0';
-                kprint(buf);
+                uint32_t offset = 0;
+                uint32_t len;
+                while ((len = MesaOS::FS::read_fs(node, offset, 2047, (uint8_t*)buf)) > 0) {
+                    buf[len] = '\0';
+                    kprint(buf);
+                    offset += len;
+                }
                 kprint("\n");
+                MesaOS::FS::put_node(node);
             } else {
                 kprint("File not found.\n");
             }
@@ -681,6 +1155,7 @@ void Shell::execute_command(const char* command_in) {
             
             if (proc->state == MesaOS::System::READY) kprint("READY\n");
             else if (proc->state == MesaOS::System::RUNNING) kprint("RUNNING\n");
+            else if (proc->state == MesaOS::System::BLOCKED) kprint("SLEEPING\n");
             else kprint("SUSPENDED\n");
             
             proc = proc->next;
@@ -709,10 +1184,10 @@ void Shell::execute_command(const char* command_in) {
                  if (abort_requested) break;
                  MesaOS::Net::ICMP::send_echo_request(target_ip, 0x1234, i+1);
                  
-                 // Wait for reply (polling)
-                 for(volatile int j=0; j<20000000; j++) {
+                 // Wait up to a second for the reply, polling every 10ms
+                 for (int j = 0; j < 100 && !abort_requested; j++) {
                       MesaOS::Drivers::PCNet::poll();
-                      if (abort_requested) break;
+                      Timer::sleep_ms(10);
                  }
              }
              kprint("Ping statistics: Transmitted packets.\n");
@@ -768,6 +1243,7 @@ void Shell::execute_command(const char* command_in) {
         MesaOS::Drivers::VGADriver vga; vga.initialize(); 
     } else if (strcmp(command, "reboot") == 0) {
         kprint("Rebooting...\n");
+        MesaOS::FS::BufferCache::sync(); // Don't lose write-back data
         // Pulse the CPU reset line
         uint8_t good = 0x02;
         while (good & 0x02)
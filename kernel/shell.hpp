@@ -2,12 +2,15 @@
 #define SHELL_HPP
 
 #include <stddef.h>
+#include <stdint.h>
 
 namespace MesaOS::System {
 
 class Shell {
 public:
     static void initialize();
+    static void run(); // Shell task main loop
+    static void queue_input(char c); // Called from the keyboard IRQ
     static void handle_input(char c);
     static void execute_command(const char* command);
     static bool is_app_running();
@@ -37,6 +40,13 @@ private:
     static char current_user[32];
     static bool is_admin;
     static char current_path[128];
+
+    // Keystrokes are queued by the IRQ and consumed by the shell task,
+    // so commands run in process context and are free to sleep
+    static char input_queue[128];
+    static volatile uint32_t input_head;
+    static volatile uint32_t input_tail;
+    static bool dequeue_input(char* c);
 };
 
 } // namespace MesaOS::System
@@ -0,0 +1,110 @@
+#include "syscall.hpp"
+#include "scheduler.hpp"
+#include "drivers/pit.hpp"
+#include "drivers/vga.hpp"
+#include "arch/i386/cpu.hpp"
+#include <string.h>
+
+extern "C" void sysenter_entry();
+
+namespace MesaOS::System {
+
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+SyscallFn Syscall::table[MAX_SYSCALLS];
+bool Syscall::sysenter_enabled = false;
+
+// SYSENTER loads ESP from an MSR, so fast syscalls run on their own stack.
+// They run with interrupts disabled and must not block or reschedule.
+static uint8_t sysenter_stack[4096] __attribute__((aligned(16)));
+
+static uint32_t sys_getpid(uint32_t, uint32_t, uint32_t, uint32_t, uint32_t) {
+    Process* current = Scheduler::get_current();
+    return current ? current->pid : 0;
+}
+
+static uint32_t sys_getticks(uint32_t, uint32_t, uint32_t, uint32_t, uint32_t) {
+    return MesaOS::Drivers::PIT::get_ticks();
+}
+
+static uint32_t sys_write(uint32_t buffer, uint32_t size, uint32_t, uint32_t, uint32_t) {
+    if (!buffer) return (uint32_t)-1;
+    MesaOS::Drivers::VGADriver vga;
+    vga.write((const char*)buffer, size);
+    return size;
+}
+
+void Syscall::initialize() {
+    memset(table, 0, sizeof(table));
+    register_syscall(SYS_GETPID, sys_getpid);
+    register_syscall(SYS_GETTICKS, sys_getticks);
+    register_syscall(SYS_WRITE, sys_write);
+    MesaOS::Arch::x86::register_interrupt_handler(128, Syscall::handle_interrupt, "syscall");
+
+    // SEP flag: CPUID.1:EDX[11]. Early Pentium Pro report it without supporting it.
+    uint32_t eax, ebx, ecx, edx;
+    MesaOS::Arch::x86::cpuid(1, &eax, &ebx, &ecx, &edx);
+    uint32_t family = (eax >> 8) & 0xF;
+    uint32_t model = (eax >> 4) & 0xF;
+    uint32_t stepping = eax & 0xF;
+    sysenter_enabled = (edx & (1 << 11)) && !(family == 6 && model < 3 && stepping < 3);
+
+    if (sysenter_enabled) {
+        // SYSEXIT derives the user selectors from CS: +16 = 0x1B code, +24 = 0x23 data
+        MesaOS::Arch::x86::wrmsr(MSR_SYSENTER_CS, 0x08);
+        MesaOS::Arch::x86::wrmsr(MSR_SYSENTER_ESP, (uint32_t)(sysenter_stack + sizeof(sysenter_stack)));
+        MesaOS::Arch::x86::wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+    }
+}
+
+bool Syscall::register_syscall(uint32_t num, SyscallFn fn) {
+    if (num >= MAX_SYSCALLS) return false;
+    table[num] = fn;
+    return true;
+}
+
+uint32_t Syscall::dispatch(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
+    if (num >= MAX_SYSCALLS || !table[num]) return (uint32_t)-1;
+    return table[num](a1, a2, a3, a4, a5);
+}
+
+void Syscall::handle_interrupt(MesaOS::Arch::x86::Registers* regs) {
+    regs->eax = dispatch(regs->eax, regs->ebx, regs->ecx, regs->edx, regs->esi, regs->edi);
+}
+
+bool Syscall::has_fast_path() {
+    return sysenter_enabled;
+}
+
+void Syscall::benchmark(uint32_t iterations, uint32_t* int80_cycles, uint32_t* sysenter_cycles) {
+    if (iterations == 0) iterations = 1;
+    *int80_cycles = 0;
+    *sysenter_cycles = 0;
+
+    uint64_t start = MesaOS::Arch::x86::rdtsc();
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint32_t ret;
+        asm volatile("int $0x80"
+                     : "=a"(ret)
+                     : "a"(SYS_GETPID), "b"(0), "c"(0), "d"(0), "S"(0), "D"(0)
+                     : "memory");
+        (void)ret;
+    }
+    *int80_cycles = (uint32_t)((MesaOS::Arch::x86::rdtsc() - start) / iterations);
+
+    if (!sysenter_enabled) return;
+
+    start = MesaOS::Arch::x86::rdtsc();
+    for (uint32_t i = 0; i < iterations; i++) {
+        sysenter_call(SYS_GETPID, 0, 0, 0, 0, 0);
+    }
+    *sysenter_cycles = (uint32_t)((MesaOS::Arch::x86::rdtsc() - start) / iterations);
+}
+
+} // namespace MesaOS::System
+
+extern "C" uint32_t syscall_dispatch(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5) {
+    return MesaOS::System::Syscall::dispatch(num, a1, a2, a3, a4, a5);
+}
@@ -0,0 +1,41 @@
+#ifndef SYSCALL_HPP
+#define SYSCALL_HPP
+
+#include <stdint.h>
+#include "arch/i386/isr.hpp"
+
+namespace MesaOS::System {
+
+enum SyscallNumber {
+    SYS_GETPID = 0,
+    SYS_GETTICKS = 1,
+    SYS_WRITE = 2,
+    MAX_SYSCALLS = 64
+};
+
+// All syscalls take up to five arguments and return a single value in EAX
+typedef uint32_t (*SyscallFn)(uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5);
+
+class Syscall {
+public:
+    static void initialize();
+    static bool register_syscall(uint32_t num, SyscallFn fn);
+    static uint32_t dispatch(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5);
+    static void handle_interrupt(MesaOS::Arch::x86::Registers* regs); // INT 0x80 path
+    static bool has_fast_path();
+
+    // Average cycles per call through INT 0x80 and SYSENTER
+    static void benchmark(uint32_t iterations, uint32_t* int80_cycles, uint32_t* sysenter_cycles);
+
+private:
+    static SyscallFn table[MAX_SYSCALLS];
+    static bool sysenter_enabled;
+};
+
+} // namespace MesaOS::System
+
+// Entry points shared with sysenter.s
+extern "C" uint32_t syscall_dispatch(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5);
+extern "C" uint32_t sysenter_call(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5);
+
+#endif
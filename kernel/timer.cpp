@@ -0,0 +1,171 @@
+#include "timer.hpp"
+#include "arch/i386/cpu.hpp"
+#include "drivers/pit.hpp"
+
+namespace MesaOS::System {
+
+TimerEvent* Timer::heap[MAX_TIMERS];
+int Timer::heap_size = 0;
+
+// Tick counters wrap; compare through the signed difference
+static inline bool tick_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+using MesaOS::Arch::x86::save_flags_cli;
+using MesaOS::Arch::x86::restore_flags;
+
+void Timer::initialize() {
+    heap_size = 0;
+}
+
+void Timer::init_event(TimerEvent* event, TimerCallback callback, void* data) {
+    event->callback = callback;
+    event->data = data;
+    event->expires = 0;
+    event->period_ticks = 0;
+    event->heap_index = -1;
+}
+
+uint32_t Timer::ms_to_ticks(uint32_t ms) {
+    uint32_t hz = MesaOS::Drivers::PIT::get_frequency();
+    if (hz == 0) hz = 100;
+    uint32_t ticks = (uint32_t)(((uint64_t)ms * hz + 999) / 1000);
+    return ticks ? ticks : 1;
+}
+
+bool Timer::start(TimerEvent* event, uint32_t delay_ms, uint32_t period_ms) {
+    uint32_t flags = save_flags_cli();
+    if (event->heap_index >= 0) heap_remove(event->heap_index);
+
+    event->expires = MesaOS::Drivers::PIT::get_ticks() + ms_to_ticks(delay_ms);
+    event->period_ticks = period_ms ? ms_to_ticks(period_ms) : 0;
+    bool ok = heap_insert(event);
+
+    restore_flags(flags);
+    return ok;
+}
+
+void Timer::cancel(TimerEvent* event) {
+    uint32_t flags = save_flags_cli();
+    if (event->heap_index >= 0) heap_remove(event->heap_index);
+    restore_flags(flags);
+}
+
+bool Timer::is_pending(TimerEvent* event) {
+    return event->heap_index >= 0;
+}
+
+uint32_t Timer::get_pending_count() {
+    return heap_size;
+}
+
+// Only the root has to be looked at; everything behind it expires later
+void Timer::tick() {
+    uint32_t now = MesaOS::Drivers::PIT::get_ticks();
+    while (heap_size > 0 && !tick_before(now, heap[0]->expires)) {
+        TimerEvent* event = heap[0];
+        heap_remove(0);
+
+        if (event->period_ticks) {
+            event->expires += event->period_ticks;
+            // Don't replay ticks we missed while interrupts were off
+            if (tick_before(event->expires, now)) event->expires = now + event->period_ticks;
+            heap_insert(event);
+        }
+        event->callback(event->data);
+    }
+}
+
+static void wake_sleeper(void* data) {
+    Scheduler::wake((Process*)data);
+}
+
+bool Timer::sleep_on(WaitQueue* queue, uint32_t timeout_ms) {
+    uint32_t flags = save_flags_cli();
+    Process* self = Scheduler::get_current();
+
+    // The kernel process is the idle task and must stay runnable: it halts instead
+    if (!self || self->pid == 0) {
+        uint32_t deadline = MesaOS::Drivers::PIT::get_ticks() + ms_to_ticks(timeout_ms);
+        while (tick_before(MesaOS::Drivers::PIT::get_ticks(), deadline)) {
+            asm volatile("sti; hlt; cli");
+        }
+        restore_flags(flags);
+        return false;
+    }
+
+    TimerEvent timeout;
+    init_event(&timeout, wake_sleeper, self);
+    if (timeout_ms != TIMER_WAIT_FOREVER && !start(&timeout, timeout_ms)) {
+        // No free timer slot: blocking now could mean never waking up
+        restore_flags(flags);
+        return false;
+    }
+
+    Scheduler::block(queue);
+
+    // Still armed means something else woke us first
+    bool woken = timeout_ms == TIMER_WAIT_FOREVER || is_pending(&timeout);
+    cancel(&timeout);
+    restore_flags(flags);
+    return woken;
+}
+
+void Timer::sleep_ms(uint32_t ms) {
+    WaitQueue queue = { 0 };
+    sleep_on(&queue, ms);
+}
+
+void Timer::heap_swap(int a, int b) {
+    TimerEvent* tmp = heap[a];
+    heap[a] = heap[b];
+    heap[b] = tmp;
+    heap[a]->heap_index = a;
+    heap[b]->heap_index = b;
+}
+
+void Timer::sift_up(int index) {
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (!tick_before(heap[index]->expires, heap[parent]->expires)) break;
+        heap_swap(index, parent);
+        index = parent;
+    }
+}
+
+void Timer::sift_down(int index) {
+    for (;;) {
+        int left = index * 2 + 1;
+        int right = left + 1;
+        int smallest = index;
+        if (left < heap_size && tick_before(heap[left]->expires, heap[smallest]->expires)) smallest = left;
+        if (right < heap_size && tick_before(heap[right]->expires, heap[smallest]->expires)) smallest = right;
+        if (smallest == index) break;
+        heap_swap(index, smallest);
+        index = smallest;
+    }
+}
+
+bool Timer::heap_insert(TimerEvent* event) {
+    if (heap_size >= MAX_TIMERS) return false;
+    heap[heap_size] = event;
+    event->heap_index = heap_size;
+    heap_size++;
+    sift_up(heap_size - 1);
+    return true;
+}
+
+void Timer::heap_remove(int index) {
+    TimerEvent* event = heap[index];
+    heap_size--;
+    if (index != heap_size) {
+        heap[index] = heap[heap_size];
+        heap[index]->heap_index = index;
+        sift_down(index);
+        sift_up(index);
+    }
+    event->heap_index = -1;
+}
+
+} // namespace MesaOS::System
@@ -0,0 +1,56 @@
+#ifndef TIMER_HPP
+#define TIMER_HPP
+
+#include <stdint.h>
+#include "scheduler.hpp"
+
+namespace MesaOS::System {
+
+// Runs in interrupt context from the PIT tick: must not sleep
+typedef void (*TimerCallback)(void* data);
+
+// Owned by the caller (static or on a stack that outlives it). Periodic
+// events re-arm themselves every period_ticks until cancelled.
+struct TimerEvent {
+    TimerCallback callback;
+    void* data;
+    uint32_t expires;      // PIT tick the event fires at
+    uint32_t period_ticks; // 0 = one-shot
+    int heap_index;        // Position in the heap, -1 when not armed
+};
+
+#define TIMER_WAIT_FOREVER 0xFFFFFFFF
+
+class Timer {
+public:
+    static void initialize();
+    static void tick(); // Called from PIT::callback
+
+    static void init_event(TimerEvent* event, TimerCallback callback, void* data);
+    static bool start(TimerEvent* event, uint32_t delay_ms, uint32_t period_ms = 0);
+    static void cancel(TimerEvent* event);
+    static bool is_pending(TimerEvent* event);
+
+    // Parks the calling process instead of spinning
+    static void sleep_ms(uint32_t ms);
+    // Blocks on queue until woken or timeout_ms elapses. Returns false on timeout.
+    static bool sleep_on(WaitQueue* queue, uint32_t timeout_ms);
+
+    static uint32_t ms_to_ticks(uint32_t ms);
+    static uint32_t get_pending_count();
+
+private:
+    static void heap_swap(int a, int b);
+    static void sift_up(int index);
+    static void sift_down(int index);
+    static void heap_remove(int index);
+    static bool heap_insert(TimerEvent* event);
+
+    static const int MAX_TIMERS = 64;
+    static TimerEvent* heap[MAX_TIMERS]; // Min-heap on expires
+    static int heap_size;
+};
+
+} // namespace MesaOS::System
+
+#endif
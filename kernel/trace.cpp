@@ -0,0 +1,142 @@
+#include "trace.hpp"
+#include "clock.hpp"
+#include "arch/i386/cpu.hpp"
+#include "arch/i386/apic.hpp"
+#include "drivers/serial.hpp"
+#include <string.h>
+
+// Bounds of the .tracepoints section, from linker.ld
+extern "C" MesaOS::System::Tracepoint __start_tracepoints[];
+extern "C" MesaOS::System::Tracepoint __stop_tracepoints[];
+
+namespace MesaOS::System {
+
+TraceRing Trace::rings[TRACE_MAX_CPUS];
+
+static uint32_t current_cpu() {
+    uint32_t id = MesaOS::Arch::x86::LocalAPIC::get_id();
+    return id < TRACE_MAX_CPUS ? id : 0;
+}
+
+// Lock-free: the slot is claimed with an atomic increment, so an interrupt
+// that traces in the middle of a record gets the next slot. seq is published
+// last, which lets the reader skip records that are half written or overwritten.
+void Trace::record(Tracepoint* tp, uint32_t a0, uint32_t a1, uint32_t a2) {
+    uint32_t cpu = current_cpu();
+    TraceRing* ring = &rings[cpu];
+    uint32_t slot = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    TraceRecord* rec = &ring->records[slot % TRACE_RING_SIZE];
+
+    rec->seq = 0;
+    rec->tsc = MesaOS::Arch::x86::rdtsc();
+    rec->event = (uint16_t)(tp - __start_tracepoints);
+    rec->cpu = (uint16_t)cpu;
+    rec->args[0] = a0;
+    rec->args[1] = a1;
+    rec->args[2] = a2;
+    __atomic_store_n(&rec->seq, slot + 1, __ATOMIC_RELEASE);
+}
+
+Tracepoint* Trace::get_tracepoints(uint32_t* count) {
+    *count = __stop_tracepoints - __start_tracepoints;
+    return __start_tracepoints;
+}
+
+Tracepoint* Trace::find(const char* name) {
+    for (Tracepoint* tp = __start_tracepoints; tp < __stop_tracepoints; tp++) {
+        if (strcmp(tp->name, name) == 0) return tp;
+    }
+    return 0;
+}
+
+void Trace::set_enabled(const char* name, bool enabled) {
+    for (Tracepoint* tp = __start_tracepoints; tp < __stop_tracepoints; tp++) {
+        if (!name || strcmp(tp->name, name) == 0) tp->enabled = enabled;
+    }
+}
+
+void Trace::clear() {
+    for (int cpu = 0; cpu < TRACE_MAX_CPUS; cpu++) {
+        for (uint32_t i = 0; i < TRACE_RING_SIZE; i++) rings[cpu].records[i].seq = 0;
+    }
+}
+
+uint32_t Trace::get_record_count() {
+    uint32_t total = 0;
+    for (int cpu = 0; cpu < TRACE_MAX_CPUS; cpu++) {
+        for (uint32_t i = 0; i < TRACE_RING_SIZE; i++) {
+            if (rings[cpu].records[i].seq) total++;
+        }
+    }
+    return total;
+}
+
+static void format_record(char* out, Tracepoint* tp, TraceRecord* rec, uint64_t base_tsc) {
+    char num[24];
+    uint64_t ns = Clock::cycles_to_ns(rec->tsc - base_tsc);
+
+    // "[seconds.micros] name: args"
+    strcpy(out, "[");
+    char* secs = ulltoa(ns / 1000000000ULL, num, 10);
+    for (size_t i = strlen(secs); i < 5; i++) strcat(out, " ");
+    strcat(out, secs);
+    strcat(out, ".");
+    char* us = ulltoa((ns / 1000) % 1000000, num, 10);
+    for (size_t i = strlen(us); i < 6; i++) strcat(out, "0");
+    strcat(out, us);
+    strcat(out, "] ");
+    strcat(out, tp->name);
+    strcat(out, ": ");
+
+    char* p = out + strlen(out);
+    int arg = 0;
+    for (const char* f = tp->format; *f && p < out + 200; f++) {
+        if (*f == '%' && f[1] && arg < 3) {
+            f++;
+            uint32_t value = rec->args[arg++];
+            // Unsigned except %d: kernel addresses and ports have the top bit set
+            if (*f == 'x') ulltoa(value, num, 16);
+            else if (*f == 'd' && (int32_t)value < 0) { num[0] = '-'; ulltoa(0u - value, num + 1, 10); }
+            else ulltoa(value, num, 10);
+            strcpy(p, num);
+            p += strlen(num);
+        } else {
+            *p++ = *f;
+        }
+    }
+    *p++ = '\n';
+    *p = 0;
+}
+
+uint32_t Trace::dump_serial() {
+    using MesaOS::Drivers::Serial;
+    if (!Serial::is_present()) return 0;
+    char line[256];
+    uint32_t written = 0;
+
+    for (int cpu = 0; cpu < TRACE_MAX_CPUS; cpu++) {
+        TraceRing* ring = &rings[cpu];
+        uint32_t head = ring->head;
+        uint32_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+        uint64_t base_tsc = 0;
+
+        Serial::write("# trace cpu ");
+        Serial::write(itoa(cpu, line, 10));
+        Serial::write("\n");
+
+        for (uint32_t slot = first; slot < head; slot++) {
+            TraceRecord* rec = &ring->records[slot % TRACE_RING_SIZE];
+            if (rec->seq != slot + 1) continue; // Overwritten, cleared or still being written
+            if (rec->event >= (uint32_t)(__stop_tracepoints - __start_tracepoints)) continue;
+            if (!base_tsc) base_tsc = rec->tsc;
+
+            format_record(line, &__start_tracepoints[rec->event], rec, base_tsc);
+            Serial::write(line);
+            written++;
+        }
+    }
+    Serial::flush();
+    return written;
+}
+
+} // namespace MesaOS::System
@@ -0,0 +1,63 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <stdint.h>
+
+namespace MesaOS::System {
+
+// A static event. Definitions are collected by the linker into the
+// .tracepoints section, so no registration code runs at boot.
+struct Tracepoint {
+    const char* name;
+    const char* format; // %u, %d and %x consume the three arguments in order
+    volatile bool enabled;
+} __attribute__((aligned(4)));
+
+// Fixed-size binary record; formatting happens only when the ring is dumped
+struct TraceRecord {
+    uint64_t tsc;
+    volatile uint32_t seq; // Slot number + 1 once the record is complete
+    uint16_t event;        // Index into the .tracepoints section
+    uint16_t cpu;
+    uint32_t args[3];
+};
+
+#define TRACE_RING_SIZE 4096
+#define TRACE_MAX_CPUS  1
+
+struct TraceRing {
+    TraceRecord records[TRACE_RING_SIZE];
+    volatile uint32_t head; // Next slot to reserve; only ever increases
+};
+
+class Trace {
+public:
+    static void record(Tracepoint* tp, uint32_t a0, uint32_t a1, uint32_t a2);
+
+    static Tracepoint* get_tracepoints(uint32_t* count);
+    static Tracepoint* find(const char* name);
+    static void set_enabled(const char* name, bool enabled); // name 0 = all
+    static void clear();
+    static uint32_t get_record_count();
+
+    // Formats every complete record in time order and writes it to the serial port
+    static uint32_t dump_serial();
+
+private:
+    static TraceRing rings[TRACE_MAX_CPUS];
+};
+
+} // namespace MesaOS::System
+
+#define DEFINE_TRACEPOINT(tp, fmt) \
+    static MesaOS::System::Tracepoint __tracepoint_##tp \
+        __attribute__((section(".tracepoints"), used)) = { #tp, fmt, false }
+
+// Disabled cost: one load and a not-taken branch
+#define TRACE(tp, a0, a1, a2) \
+    do { \
+        if (__builtin_expect(__tracepoint_##tp.enabled, 0)) \
+            MesaOS::System::Trace::record(&__tracepoint_##tp, (uint32_t)(a0), (uint32_t)(a1), (uint32_t)(a2)); \
+    } while (0)
+
+#endif
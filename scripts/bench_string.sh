@@ -0,0 +1,20 @@
+#!/bin/sh
+# Builds kernel/libc/string.cpp for the host, renames its symbols with a
+# kern_ prefix and runs scripts/bench_string.cpp, which checks the routines
+# against glibc and times both. The kernel code is i386 assembly, so this
+# needs a 32-bit host libc (e.g. Debian's gcc-multilib).
+# Usage: sh scripts/bench_string.sh [rounds]
+
+set -e
+cd "$(dirname "$0")/.."
+
+HOSTCXX=${HOSTCXX:-g++}
+OUT=${TMPDIR:-/tmp}/mesaos-bench-string
+mkdir -p "$OUT"
+
+# Same flags as the kernel build, against the kernel's own headers
+$HOSTCXX -m32 -c kernel/libc/string.cpp -o "$OUT/string.o" \
+    -Ikernel/include -ffreestanding -O2 -fno-exceptions -fno-rtti
+objcopy --prefix-symbols=kern_ "$OUT/string.o" "$OUT/kern_string.o"
+$HOSTCXX -m32 -O2 scripts/bench_string.cpp "$OUT/kern_string.o" -o "$OUT/bench_string"
+"$OUT/bench_string" "$@"
@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+# Generates kernel/drivers/font.cpp: an 8x16 PSF1 console font for the
+# framebuffer console. Glyphs are drawn below on a 5x7 grid and stretched to
+# two scanlines per row, leaving a one-pixel border inside the 8x16 cell.
+#
+#   python3 scripts/gen_font.py > kernel/drivers/font.cpp
+
+GLYPHS = {
+    ' ': ".....|.....|.....|.....|.....|.....|.....",
+    '!': "..#..|..#..|..#..|..#..|.....|.....|..#..",
+    '"': ".#.#.|.#.#.|.#.#.|.....|.....|.....|.....",
+    '#': ".#.#.|.#.#.|#####|.#.#.|#####|.#.#.|.#.#.",
+    '$': "..#..|.####|#.#..|.###.|..#.#|####.|..#..",
+    '%': "##...|##..#|...#.|..#..|.#...|#..##|...##",
+    '&': ".##..|#..#.|#.#..|.#...|#.#.#|#..#.|.##.#",
+    "'": "..#..|..#..|.#...|.....|.....|.....|.....",
+    '(': "...#.|..#..|.#...|.#...|.#...|..#..|...#.",
+    ')': ".#...|..#..|...#.|...#.|...#.|..#..|.#...",
+    '*': ".....|..#..|#.#.#|.###.|#.#.#|..#..|.....",
+    '+': ".....|..#..|..#..|#####|..#..|..#..|.....",
+    ',': ".....|.....|.....|.....|.##..|..#..|.#...",
+    '-': ".....|.....|.....|#####|.....|.....|.....",
+    '.': ".....|.....|.....|.....|.....|.##..|.##..",
+    '/': ".....|....#|...#.|..#..|.#...|#....|.....",
+    '0': ".###.|#...#|#..##|#.#.#|##..#|#...#|.###.",
+    '1': "..#..|.##..|..#..|..#..|..#..|..#..|.###.",
+    '2': ".###.|#...#|....#|...#.|..#..|.#...|#####",
+    '3': "#####|...#.|..#..|...#.|....#|#...#|.###.",
+    '4': "...#.|..##.|.#.#.|#..#.|#####|...#.|...#.",
+    '5': "#####|#....|####.|....#|....#|#...#|.###.",
+    '6': "..##.|.#...|#....|####.|#...#|#...#|.###.",
+    '7': "#####|....#|...#.|..#..|.#...|.#...|.#...",
+    '8': ".###.|#...#|#...#|.###.|#...#|#...#|.###.",
+    '9': ".###.|#...#|#...#|.####|....#|...#.|.##..",
+    ':': ".....|.##..|.##..|.....|.##..|.##..|.....",
+    ';': ".....|.##..|.##..|.....|.##..|..#..|.#...",
+    '<': "...#.|..#..|.#...|#....|.#...|..#..|...#.",
+    '=': ".....|.....|#####|.....|#####|.....|.....",
+    '>': ".#...|..#..|...#.|....#|...#.|..#..|.#...",
+    '?': ".###.|#...#|....#|...#.|..#..|.....|..#..",
+    '@': ".###.|#...#|....#|.##.#|#.#.#|#.#.#|.###.",
+    'A': ".###.|#...#|#...#|#...#|#####|#...#|#...#",
+    'B': "####.|#...#|#...#|####.|#...#|#...#|####.",
+    'C': ".###.|#...#|#....|#....|#....|#...#|.###.",
+    'D': "###..|#..#.|#...#|#...#|#...#|#..#.|###..",
+    'E': "#####|#....|#....|####.|#....|#....|#####",
+    'F': "#####|#....|#....|####.|#....|#....|#....",
+    'G': ".###.|#...#|#....|#.###|#...#|#...#|.####",
+    'H': "#...#|#...#|#...#|#####|#...#|#...#|#...#",
+    'I': ".###.|..#..|..#..|..#..|..#..|..#..|.###.",
+    'J': "..###|...#.|...#.|...#.|...#.|#..#.|.##..",
+    'K': "#...#|#..#.|#.#..|##...|#.#..|#..#.|#...#",
+    'L': "#....|#....|#....|#....|#....|#....|#####",
+    'M': "#...#|##.##|#.#.#|#.#.#|#...#|#...#|#...#",
+    'N': "#...#|#...#|##..#|#.#.#|#..##|#...#|#...#",
+    'O': ".###.|#...#|#...#|#...#|#...#|#...#|.###.",
+    'P': "####.|#...#|#...#|####.|#....|#....|#....",
+    'Q': ".###.|#...#|#...#|#...#|#.#.#|#..#.|.##.#",
+    'R': "####.|#...#|#...#|####.|#.#..|#..#.|#...#",
+    'S': ".####|#....|#....|.###.|....#|....#|####.",
+    'T': "#####|..#..|..#..|..#..|..#..|..#..|..#..",
+    'U': "#...#|#...#|#...#|#...#|#...#|#...#|.###.",
+    'V': "#...#|#...#|#...#|#...#|#...#|.#.#.|..#..",
+    'W': "#...#|#...#|#...#|#.#.#|#.#.#|#.#.#|.#.#.",
+    'X': "#...#|#...#|.#.#.|..#..|.#.#.|#...#|#...#",
+    'Y': "#...#|#...#|#...#|.#.#.|..#..|..#..|..#..",
+    'Z': "#####|....#|...#.|..#..|.#...|#....|#####",
+    '[': ".###.|.#...|.#...|.#...|.#...|.#...|.###.",
+    '\\': ".....|#....|.#...|..#..|...#.|....#|.....",
+    ']': ".###.|...#.|...#.|...#.|...#.|...#.|.###.",
+    '^': "..#..|.#.#.|#...#|.....|.....|.....|.....",
+    '_': ".....|.....|.....|.....|.....|.....|#####",
+    '`': ".#...|..#..|...#.|.....|.....|.....|.....",
+    'a': ".....|.....|.###.|....#|.####|#...#|.####",
+    'b': "#....|#....|#.##.|##..#|#...#|#...#|####.",
+    'c': ".....|.....|.###.|#....|#....|#...#|.###.",
+    'd': "....#|....#|.##.#|#..##|#...#|#...#|.####",
+    'e': ".....|.....|.###.|#...#|#####|#....|.###.",
+    'f': "..##.|.#..#|.#...|###..|.#...|.#...|.#...",
+    'g': ".....|.####|#...#|#...#|.####|....#|.###.",
+    'h': "#....|#....|#.##.|##..#|#...#|#...#|#...#",
+    'i': "..#..|.....|.##..|..#..|..#..|..#..|.###.",
+    'j': "...#.|.....|..##.|...#.|...#.|#..#.|.##..",
+    'k': "#....|#....|#..#.|#.#..|##...|#.#..|#..#.",
+    'l': ".##..|..#..|..#..|..#..|..#..|..#..|.###.",
+    'm': ".....|.....|##.#.|#.#.#|#.#.#|#...#|#...#",
+    'n': ".....|.....|#.##.|##..#|#...#|#...#|#...#",
+    'o': ".....|.....|.###.|#...#|#...#|#...#|.###.",
+    'p': ".....|.....|####.|#...#|####.|#....|#....",
+    'q': ".....|.....|.##.#|#..##|.####|....#|....#",
+    'r': ".....|.....|#.##.|##..#|#....|#....|#....",
+    's': ".....|.....|.###.|#....|.###.|....#|####.",
+    't': ".#...|.#...|###..|.#...|.#...|.#..#|..##.",
+    'u': ".....|.....|#...#|#...#|#...#|#..##|.##.#",
+    'v': ".....|.....|#...#|#...#|#...#|.#.#.|..#..",
+    'w': ".....|.....|#...#|#...#|#.#.#|#.#.#|.#.#.",
+    'x': ".....|.....|#...#|.#.#.|..#..|.#.#.|#...#",
+    'y': ".....|.....|#...#|#...#|.####|....#|.###.",
+    'z': ".....|.....|#####|...#.|..#..|.#...|#####",
+    '{': "...#.|..#..|..#..|.#...|..#..|..#..|...#.",
+    '|': "..#..|..#..|..#..|..#..|..#..|..#..|..#..",
+    '}': ".#...|..#..|..#..|...#.|..#..|..#..|.#...",
+    '~': ".....|.....|.#...|#.#.#|...#.|.....|.....",
+}
+
+CHARSIZE = 16
+
+
+def glyph_bytes(art):
+    rows = art.split('|')
+    assert len(rows) == 7 and all(len(r) == 5 for r in rows), art
+    out = [0] * CHARSIZE
+    for i, row in enumerate(rows):
+        bits = 0
+        for j, ch in enumerate(row):
+            if ch == '#':
+                bits |= 0x80 >> (j + 1)  # Column 0 is the left border
+        out[1 + 2 * i] = bits
+        out[2 + 2 * i] = bits
+    return out
+
+
+def main():
+    font = [[0] * CHARSIZE for _ in range(256)]
+    for ch, art in GLYPHS.items():
+        font[ord(ch)] = glyph_bytes(art)
+    font[0xDB] = [0xFF] * CHARSIZE  # CP437 full block
+
+    data = [0x36, 0x04, 0x00, CHARSIZE]  # PSF1 magic, mode 0 (256 glyphs)
+    for glyph in font:
+        data.extend(glyph)
+
+    print('// Generated by scripts/gen_font.py - do not edit.')
+    print('#include "font.hpp"')
+    print()
+    print('namespace MesaOS::Drivers {')
+    print()
+    print('const uint8_t console_font_psf[] = {')
+    for i in range(0, len(data), 16):
+        print('    ' + ', '.join('0x%02x' % b for b in data[i:i + 16]) + ',')
+    print('};')
+    print()
+    print('const uint32_t console_font_psf_size = sizeof(console_font_psf);')
+    print()
+    print('} // namespace MesaOS::Drivers')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Turns `nm -n -C` output of the first-pass kernel image into an assembly
+# file holding a sorted (address, name) table in the .ksyms section.
+# Usage: i686-elf-nm -n -C MesaOS.bin.tmp | scripts/gen_ksyms.sh > kernel/ksyms_table.s
+
+awk '
+BEGIN { n = 0 }
+# Text symbols only: T/t (global/local), W/w (weak, e.g. inline functions)
+$2 ~ /^[TtWw]$/ {
+    addr[n] = $1
+    name = $0
+    sub(/^[0-9a-fA-F]+ [A-Za-z] /, "", name)
+    gsub(/\\/, "\\\\", name)
+    gsub(/"/, "\\\"", name)
+    names[n] = name
+    n++
+}
+END {
+    print "# Generated by scripts/gen_ksyms.sh - do not edit"
+    print ".section .ksyms, \"a\""
+    print ".align 4"
+    print ".global ksyms_count"
+    print "ksyms_count:"
+    print "    .long " n
+    print ".global ksyms_table"
+    print "ksyms_table:"
+    for (i = 0; i < n; i++) print "    .long 0x" addr[i] ", .Lksym" i
+    for (i = 0; i < n; i++) print ".Lksym" i ": .asciz \"" names[i] "\""
+}
+'